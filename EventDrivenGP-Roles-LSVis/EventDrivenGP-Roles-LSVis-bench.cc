@@ -0,0 +1,369 @@
+// Native microbenchmarks for the deme evaluation hot paths (build with: make bench).
+//
+// Usage: ./EventDrivenGP-Roles-LSVis-bench [--demes 5,16,32,64,128] [--progs 1x8,4x16,8x32] [--seed N]
+//                                          [--min-ms MS] [--landscape-max-work N] [--inbox CAP:POLICY]
+//                                          [--topology NAME[:PARAM]] [--fixed 0|1] [--threads N]
+//                                          [--hardware default|compact] [--batch N] [--optimize none|timing|fast]
+//   --demes               Deme side lengths to sweep (square demes).
+//   --progs               Program sizes to sweep, as <functions>x<instructions per function>.
+//   --seed                Random seed (programs are generated deterministically from it).
+//   --min-ms              Minimum measured time per benchmark.
+//   --landscape-max-work  Skip full landscapes when cells * program instructions (* mutations per instruction,
+//                         for mutational landscapes) exceeds this.
+//   --inbox               Per-cell inbox capacity (0 => unbounded) and policy (see deme/EventInbox.h).
+//   --topology            Deme topology and its parameter, if any (see deme/Topology.h).
+//   --fixed               Also time compile-time sized demes (FixedDeme) for 5/16/32/64/128 sides (default 1).
+//   --threads             Threads (one deme each) for cell landscapes (default: hardware concurrency).
+//   --hardware            Cell hardware profile (see deme/HardwareProfile.h); compact benchmarks get '/compact'.
+//   --batch               Programs per batch for evaluate_batch/evaluate_deme (straight-line programs, see
+//                         deme/BatchEvaluator.h) (default 64; 0 => skip). Gated like landscapes.
+//   --optimize            Optimize programs as demes load them (see deme/ProgramOptimizer.h); benchmarks get
+//                         '/opt=LEVEL' and what optimizing each program did goes to stderr.
+//
+// Output: CSV (one row per benchmark/deme size/program size; '/fixed' benchmarks use FixedDeme) on stdout:
+//   benchmark,deme_width,deme_height,num_funs,fun_len,reps,ops,ns_per_op,bytes_per_cell
+// bytes_per_cell is the deme's estimated memory footprint (see DemeFootprint) after one evaluation.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include "base/Ptr.h"
+#include "base/vector.h"
+#include "tools/Random.h"
+#include "tools/string_utils.h"
+
+#include "deme/Deme.h"
+#include "deme/RoleTask.h"
+#include "deme/Landscape.h"
+#include "deme/SubstitutionLandscape.h"
+#include "deme/RandomProgram.h"
+#include "deme/BatchEvaluator.h"
+
+using bench_clock_t = std::chrono::steady_clock;
+
+struct BenchConfig {
+  emp::vector<size_t> deme_sizes = {5, 16, 32, 64, 128};
+  emp::vector<std::pair<size_t, size_t>> prog_sizes = {{1, 8}, {4, 16}, {8, 32}};
+  int seed = 1;
+  double min_ms = 200.0;
+  size_t landscape_max_work = 32 * 32 * 32;
+  size_t inbox_capacity = DEFAULT_INBOX_CAPACITY;
+  InboxPolicy inbox_policy = InboxPolicy::DROP_OLDEST;
+  TopologyType topology_type = TopologyType::DEFAULT;
+  double topology_param = 0.0;
+  bool fixed = true;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  HardwareProfile hw_profile = HardwareProfile::Default();
+  size_t batch_size = 64;
+  ProgramOptLevel opt_level = ProgramOptLevel::NONE;
+};
+
+double bench_sink = 0.0; // Keeps benchmarked results live.
+
+/// Appended to benchmark names for non-default hardware and program optimization.
+std::string BenchVariant(const BenchConfig & config) {
+  std::string variant = config.hw_profile == HardwareProfile::Compact() ? "/compact" : "";
+  if (config.opt_level != ProgramOptLevel::NONE) variant += std::string("/opt=") + ProgramOptLevelName(config.opt_level);
+  return variant;
+}
+
+/// Repeat (untimed) setup followed by (timed) op until at least min_ms has been spent in op.
+/// op returns the number of operations it performed.
+template<typename SETUP_FUN, typename OP_FUN>
+void RunBench(const std::string & name, const BenchConfig & config, size_t w, size_t h,
+              size_t num_funs, size_t fun_len, double bytes_per_cell, SETUP_FUN setup, OP_FUN op) {
+  size_t reps = 0;
+  size_t ops = 0;
+  double elapsed_ns = 0.0;
+  while (reps == 0 || elapsed_ns < config.min_ms * 1000000.0) {
+    setup();
+    const auto start = bench_clock_t::now();
+    ops += op();
+    elapsed_ns += std::chrono::duration<double, std::nano>(bench_clock_t::now() - start).count();
+    ++reps;
+  }
+  std::cout << name << "," << w << "," << h << "," << num_funs << "," << fun_len << ","
+            << reps << "," << ops << "," << (elapsed_ns / (double)ops) << "," << bytes_per_cell << std::endl;
+}
+
+// Runtime demes get the configured topology; fixed demes always have the default one.
+// Returns false (complaining) if the configured topology can't be built for deme.
+bool ConfigureTopology(Deme & deme, const BenchConfig & config, emp::Random & rnd) {
+  const Topology topology = BuildTopology(config.topology_type, deme.GetWidth(), deme.GetHeight(), rnd, config.topology_param);
+  if (!topology.GetSize()) {
+    std::cerr << "Can't build a " << deme.GetWidth() << "x" << deme.GetHeight() << " " << TopologyName(config.topology_type)
+              << " topology with parameter " << config.topology_param << "." << std::endl;
+    return false;
+  }
+  deme.SetTopology(topology);
+  return true;
+}
+
+template<size_t W, size_t H>
+bool ConfigureTopology(FixedDeme<W, H> &, const BenchConfig &, emp::Random &) { return true; }
+
+/// Benchmark a side x side deme of type DEME_T; variant is appended to benchmark names.
+template<typename DEME_T>
+void BenchDeme(const BenchConfig & config, size_t side, size_t num_funs, size_t fun_len,
+               emp::Ptr<event_lib_t> event_lib, emp::Ptr<inst_lib_t> inst_lib, const std::string & variant="") {
+  emp::Random rnd(config.seed);
+  program_t prog = GenRandomProgram(rnd, inst_lib, num_funs, fun_len);
+  Agent agent(prog);
+  DEME_T deme(&rnd, side, side, event_lib, inst_lib, config.hw_profile);
+  deme.SetInboxCapacity(config.inbox_capacity, config.inbox_policy);
+  deme.SetOptLevel(config.opt_level);
+  if (!ConfigureTopology(deme, config, rnd)) return;
+  const size_t num_cells = deme.grid.size();
+  auto no_setup = [](){ ; };
+  auto load = [&deme, &agent]() { deme.LoadAgent(&agent); };
+  deme.LoadAgent(&agent);
+  if (config.opt_level != ProgramOptLevel::NONE && side == config.deme_sizes[0]) {
+    const OptimizeReport & report = deme.GetOptReport();
+    std::cerr << "optimize " << num_funs << "x" << fun_len << variant << ": work " << report.work_before << " -> "
+              << report.work_after << ", instructions " << report.inst_cnt_before << " -> " << report.inst_cnt_after
+              << " (" << report.folded << " folded, " << report.dead << " dead)" << std::endl;
+  }
+  deme.Advance(EVAL_TIME);
+  const double bytes_per_cell = deme.GetFootprint().GetBytesPerCell();
+
+  RunBench("single_advance" + variant, config, side, side, num_funs, fun_len, bytes_per_cell, load, [&deme]() {
+    for (size_t t = 0; t < EVAL_TIME; ++t) deme.SingleAdvance();
+    return EVAL_TIME;
+  });
+
+  // Message dispatch (one message from every cell per op batch).
+  typename DEME_T::memory_t msg;
+  for (size_t i = 0; i < CPU_SIZE; ++i) msg[(int)i] = (double)i;
+  const event_t broadcast(deme.event_lib->GetID("Message"), GenRandomAffinity(rnd), msg, {"broadcast"});
+  const event_t send(deme.event_lib->GetID("Message"), GenRandomAffinity(rnd), msg, {"send"});
+  RunBench("dispatch_broadcast" + variant, config, side, side, num_funs, fun_len, bytes_per_cell, load, [&deme, &broadcast, num_cells]() {
+    for (size_t i = 0; i < num_cells; ++i) deme.DispatchMessage(*deme.grid[i], broadcast);
+    return num_cells;
+  });
+  RunBench("dispatch_send" + variant, config, side, side, num_funs, fun_len, bytes_per_cell, load, [&deme, &send, num_cells]() {
+    for (size_t i = 0; i < num_cells; ++i) deme.DispatchMessage(*deme.grid[i], send);
+    return num_cells;
+  });
+
+  RunBench("random_neighbor" + variant, config, side, side, num_funs, fun_len, bytes_per_cell, no_setup, [&deme, num_cells]() {
+    size_t sum = 0;
+    for (size_t i = 0; i < num_cells; ++i) sum += deme.GetRandomNeighbor(i);
+    bench_sink += (double)sum;
+    return num_cells;
+  });
+
+  RunBench("load_agent" + variant, config, side, side, num_funs, fun_len, bytes_per_cell, no_setup, [&deme, &agent]() {
+    deme.LoadAgent(&agent);
+    return (size_t)1;
+  });
+  RunBench("reset" + variant, config, side, side, num_funs, fun_len, bytes_per_cell, load, [&deme]() {
+    deme.Reset();
+    return (size_t)1;
+  });
+
+  // Fitness of a deme that's been run.
+  deme.LoadAgent(&agent);
+  deme.Advance(EVAL_TIME);
+  RunBench("fit_fun" + variant, config, side, side, num_funs, fun_len, bytes_per_cell, no_setup, [&deme]() {
+    for (size_t i = 0; i < 100; ++i) bench_sink += RoleIDFitness(&deme);
+    return (size_t)100;
+  });
+
+  // Knock out the second function and every third instruction.
+  std::set<int> func_knockouts = {1};
+  std::set<std::pair<int, int>> inst_knockouts;
+  for (size_t fID = 0; fID < prog.GetSize(); ++fID)
+    for (size_t iID = 0; iID < prog[fID].GetSize(); iID += 3) inst_knockouts.emplace((int)fID, (int)iID);
+  RunBench("build_cur_program" + variant, config, side, side, num_funs, fun_len, bytes_per_cell, no_setup, [&]() {
+    std::map<std::pair<int, int>, std::pair<int, int>> pos_map;
+    program_t built = BuildKnockoutProgram(prog, func_knockouts, inst_knockouts, pos_map);
+    bench_sink += (double)built.GetSize();
+    return (size_t)1;
+  });
+
+  if (num_cells * prog.GetInstCnt() <= config.landscape_max_work) {
+    Agent ls_agent(prog);
+    auto eval_program = [&deme, &ls_agent](emp::Ptr<program_t> prog_ptr) {
+      ls_agent.program = *prog_ptr;
+      return EvaluateAgent(deme, &ls_agent, EVAL_TIME);
+    };
+    RunBench("landscape" + variant, config, side, side, num_funs, fun_len, bytes_per_cell, no_setup, [&]() {
+      KnockoutLandscape(prog, eval_program, [](int, int, double fitness) { bench_sink += fitness; });
+      return (size_t)1;
+    });
+  }
+}
+
+/// Benchmark cell knockout landscapes (with one knockout sample per cell) and full mutational landscapes
+/// (uncached, then fully cached) of a side x side deme, on one deme and on config.threads demes.
+void BenchCellLandscape(const BenchConfig & config, size_t side, size_t num_funs, size_t fun_len,
+                        emp::Ptr<event_lib_t> event_lib, emp::Ptr<inst_lib_t> inst_lib) {
+  emp::Random rnd(config.seed);
+  program_t prog = GenRandomProgram(rnd, inst_lib, num_funs, fun_len);
+  Agent agent(prog);
+  const size_t num_cells = side * side;
+  if (num_cells * prog.GetInstCnt() > config.landscape_max_work) return;
+  const Topology topology = BuildTopology(config.topology_type, side, side, rnd, config.topology_param);
+  if (!topology.GetSize()) return;  // BenchDeme already complained.
+  emp::vector<emp::Ptr<emp::Random>> deme_rnds;
+  emp::vector<emp::Ptr<Deme>> demes;
+  for (size_t t = 0; t < config.threads; ++t) {
+    deme_rnds.emplace_back(emp::NewPtr<emp::Random>(config.seed));
+    demes.emplace_back(emp::NewPtr<Deme>(deme_rnds.back(), side, side, event_lib, inst_lib, config.hw_profile));
+    demes.back()->SetInboxCapacity(config.inbox_capacity, config.inbox_policy);
+    demes.back()->SetTopology(topology);
+    demes.back()->SetOptLevel(config.opt_level);
+  }
+  auto eval_deme = [&agent](Deme & deme) { return EvaluateAgent(deme, &agent, EVAL_TIME); };
+  auto no_setup = [](){ ; };
+  bench_sink += eval_deme(*demes[0]);
+  const double bytes_per_cell = demes[0]->GetFootprint().GetBytesPerCell();
+  const std::string variant = BenchVariant(config);
+  emp::vector<size_t> deme_counts = {1};
+  if (config.threads > 1) deme_counts.emplace_back(config.threads);
+  for (size_t num_demes : deme_counts) {
+    const emp::vector<emp::Ptr<Deme>> used_demes(demes.begin(), demes.begin() + num_demes);
+    RunBench("cell_landscape" + variant + "/threads=" + emp::to_string(num_demes), config, side, side, num_funs, fun_len, bytes_per_cell, no_setup, [&]() {
+      CellLandscape landscape = CellKnockoutLandscape(used_demes, {}, eval_deme, rnd, num_cells, 2);
+      bench_sink += landscape.GetMeanSampleFitness();
+      return (size_t)1;
+    });
+    if (num_cells * prog.GetInstCnt() * (inst_lib->GetSize() + 2 * MAX_INST_ARGS) > config.landscape_max_work) continue;
+    LandscapeCache cache;
+    auto eval_program = [](Deme & deme, const program_t & mut_prog) {
+      Agent mut_agent(mut_prog);
+      return EvaluateAgent(deme, &mut_agent, EVAL_TIME);
+    };
+    RunBench("mutation_landscape" + variant + "/threads=" + emp::to_string(num_demes), config, side, side, num_funs, fun_len, bytes_per_cell, [&cache]() { cache.Clear(); }, [&]() {
+      bench_sink += SubstitutionLandscape(prog, used_demes, eval_program, config.seed, cache).base_fitness;
+      return (size_t)1;
+    });
+    RunBench("mutation_landscape_cached" + variant + "/threads=" + emp::to_string(num_demes), config, side, side, num_funs, fun_len, bytes_per_cell, no_setup, [&]() {
+      bench_sink += SubstitutionLandscape(prog, used_demes, eval_program, config.seed, cache).base_fitness;
+      return (size_t)1;
+    });
+  }
+  for (auto deme : demes) deme.Delete();
+  for (auto deme_rnd : deme_rnds) deme_rnd.Delete();
+}
+
+/// Benchmark evaluating config.batch_size straight-line programs on a side x side deme with the batch
+/// interpreter and one at a time on a deme (ops are programs evaluated).
+void BenchBatch(const BenchConfig & config, size_t side, size_t num_funs, size_t fun_len,
+                emp::Ptr<event_lib_t> event_lib, emp::Ptr<inst_lib_t> inst_lib) {
+  const size_t num_cells = side * side;
+  if (config.batch_size == 0 || num_cells * num_funs * fun_len > config.landscape_max_work) return;
+  emp::Random rnd(config.seed);
+  Deme deme(&rnd, side, side, event_lib, inst_lib, config.hw_profile);
+  BatchEvaluator batch(*inst_lib);
+  batch.Configure(deme, EVAL_TIME);
+  if (!batch.IsEnabled()) { std::cerr << "Batch interpreter disabled (unknown end-of-main behavior)." << std::endl; return; }
+  emp::vector<program_t> progs;
+  emp::vector<emp::Ptr<const program_t>> prog_ptrs;
+  for (size_t i = 0; i < config.batch_size; ++i) progs.emplace_back(GenRandomProgram(rnd, inst_lib, num_funs, fun_len, batch.GetBatchInsts()));
+  for (const program_t & prog : progs) prog_ptrs.emplace_back(&prog);
+  auto eval_deme = [&deme](const program_t & prog) {
+    Agent agent(prog);
+    return EvaluateAgent(deme, &agent, EVAL_TIME);
+  };
+  // Both must agree (see RunProgramJobs).
+  const emp::vector<double> batch_fitness = batch.Evaluate(prog_ptrs);
+  for (size_t i = 0; i < progs.size(); ++i) {
+    if (batch_fitness[i] != eval_deme(progs[i])) { std::cerr << "Batch interpreter disagrees with deme." << std::endl; return; }
+  }
+  const double bytes_per_cell = deme.GetFootprint().GetBytesPerCell();
+  const std::string variant = BenchVariant(config);
+  auto no_setup = [](){ ; };
+  RunBench("evaluate_batch" + variant, config, side, side, num_funs, fun_len, bytes_per_cell, no_setup, [&]() {
+    for (double fitness : batch.Evaluate(prog_ptrs)) bench_sink += fitness;
+    return progs.size();
+  });
+  RunBench("evaluate_deme" + variant, config, side, side, num_funs, fun_len, bytes_per_cell, no_setup, [&]() {
+    for (const program_t & prog : progs) bench_sink += eval_deme(prog);
+    return progs.size();
+  });
+}
+
+int main(int argc, char * argv[]) {
+  BenchConfig config;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string arg(argv[i]);
+    const std::string val(argv[i+1]);
+    emp::vector<std::string> items;
+    if (arg == "--demes") {
+      emp::slice(val, items, ',');
+      config.deme_sizes.clear();
+      for (const auto & item : items) config.deme_sizes.emplace_back(std::stoul(item));
+    } else if (arg == "--progs") {
+      emp::slice(val, items, ',');
+      config.prog_sizes.clear();
+      for (const auto & item : items) {
+        emp::vector<std::string> dims;
+        emp::slice(item, dims, 'x');
+        if (dims.size() != 2) { std::cerr << "Bad program size: " << item << std::endl; return 1; }
+        config.prog_sizes.emplace_back(std::stoul(dims[0]), std::stoul(dims[1]));
+      }
+    } else if (arg == "--seed") config.seed = std::stoi(val);
+    else if (arg == "--min-ms") config.min_ms = std::stod(val);
+    else if (arg == "--fixed") config.fixed = (val != "0");
+    else if (arg == "--threads") config.threads = std::max(1ul, std::stoul(val));
+    else if (arg == "--hardware") {
+      if (!ParseHardwareProfile(val, config.hw_profile)) { std::cerr << "Bad hardware profile: " << val << std::endl; return 1; }
+    }
+    else if (arg == "--landscape-max-work") config.landscape_max_work = std::stoul(val);
+    else if (arg == "--batch") config.batch_size = std::stoul(val);
+    else if (arg == "--optimize") {
+      if (!ParseProgramOptLevel(val, config.opt_level)) { std::cerr << "Bad optimization level: " << val << std::endl; return 1; }
+    }
+    else if (arg == "--inbox") {
+      emp::slice(val, items, ':');
+      config.inbox_capacity = std::stoul(items[0]);
+      if (items.size() > 1 && !ParseInboxPolicy(items[1], config.inbox_policy)) {
+        std::cerr << "Bad inbox policy: " << items[1] << std::endl; return 1;
+      }
+    }
+    else if (arg == "--topology") {
+      emp::slice(val, items, ':');
+      if (!ParseTopologyType(items[0], config.topology_type)) {
+        std::cerr << "Bad topology: " << items[0] << std::endl; return 1;
+      }
+      if (items.size() > 1) config.topology_param = std::stod(items[1]);
+    }
+    else { std::cerr << "Unknown option: " << arg << std::endl; return 1; }
+  }
+
+  emp::Ptr<event_lib_t> event_lib = emp::NewPtr<event_lib_t>(*emp::EventDrivenGP::DefaultEventLib());
+  emp::Ptr<inst_lib_t> inst_lib = emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib());
+  AddRoleInstructions(*inst_lib);
+
+  std::cout << "benchmark,deme_width,deme_height,num_funs,fun_len,reps,ops,ns_per_op,bytes_per_cell" << std::endl;
+  for (size_t side : config.deme_sizes) {
+    for (const auto & prog_size : config.prog_sizes) {
+      const size_t num_funs = prog_size.first;
+      const size_t fun_len = prog_size.second;
+      BenchDeme<Deme>(config, side, num_funs, fun_len, event_lib, inst_lib, BenchVariant(config));
+      BenchCellLandscape(config, side, num_funs, fun_len, event_lib, inst_lib);
+      BenchBatch(config, side, num_funs, fun_len, event_lib, inst_lib);
+      // Compile-time sized counterparts of the default sweep (default topology only).
+      if (!config.fixed || config.topology_type != TopologyType::DEFAULT) continue;
+      switch (side) {
+        case 5: BenchDeme<FixedDeme<5, 5>>(config, side, num_funs, fun_len, event_lib, inst_lib, "/fixed" + BenchVariant(config)); break;
+        case 16: BenchDeme<FixedDeme<16, 16>>(config, side, num_funs, fun_len, event_lib, inst_lib, "/fixed" + BenchVariant(config)); break;
+        case 32: BenchDeme<FixedDeme<32, 32>>(config, side, num_funs, fun_len, event_lib, inst_lib, "/fixed" + BenchVariant(config)); break;
+        case 64: BenchDeme<FixedDeme<64, 64>>(config, side, num_funs, fun_len, event_lib, inst_lib, "/fixed" + BenchVariant(config)); break;
+        case 128: BenchDeme<FixedDeme<128, 128>>(config, side, num_funs, fun_len, event_lib, inst_lib, "/fixed" + BenchVariant(config)); break;
+        default: break;
+      }
+    }
+  }
+  std::cerr << "(sink: " << bench_sink << ")" << std::endl;
+
+  inst_lib.Delete();
+  event_lib.Delete();
+  return 0;
+}
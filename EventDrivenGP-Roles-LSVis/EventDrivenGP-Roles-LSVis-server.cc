@@ -0,0 +1,157 @@
+// Native evaluation server (build with: make server). Answers the same requests as the web worker (see
+// deme/EvalService.h) over a local Unix or TCP socket, spreading landscapes and batches over several demes
+// (one thread each).
+//
+// Usage: ./EventDrivenGP-Roles-LSVis-server (--unix PATH | --tcp PORT) [--threads N] [--store PATH]
+//   --unix     Listen on a Unix socket at PATH (replacing any old socket there; any other file is left alone).
+//   --tcp      Listen on 127.0.0.1:PORT.
+//   --threads  Demes/threads to evaluate with (default: hardware concurrency).
+//   --store    Keep landscapes in the landscape store at PATH (created if need be; see deme/LandscapeStore.h),
+//              answering repeated landscape requests from it. Without it, landscapes are kept until exit.
+//
+// Protocol: every message, both ways, is a frame: <4-byte big-endian payload length> <payload>.
+//   Request payload:  <kind>\n<EvalRequest text>   (kind: evaluate, landscape, cell_landscape, mutation_landscape, batch)
+//   Response payload: response lines (see deme/EvalService.h); long responses come in several frames, the
+//                     last of which ends with the line 'done'.
+// Connections are served one at a time; a connection can send any number of requests. A connection that
+// stalls mid-read or mid-write for CONNECTION_TIMEOUT_SEC, or sits idle that long, is dropped.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "base/Ptr.h"
+
+#include "deme/EvalService.h"
+
+constexpr uint32_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+constexpr int CONNECTION_TIMEOUT_SEC = 30;  // Per read/write; keeps one stuck client from blocking the rest.
+
+bool ReadAll(int fd, char * buf, size_t size) {
+  while (size) {
+    const ssize_t got = read(fd, buf, size);
+    if (got <= 0) return false;
+    buf += got;
+    size -= (size_t)got;
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const char * buf, size_t size) {
+  while (size) {
+    const ssize_t put = write(fd, buf, size);
+    if (put <= 0) return false;
+    buf += put;
+    size -= (size_t)put;
+  }
+  return true;
+}
+
+bool ReadFrame(int fd, std::string & payload) {
+  uint32_t size;
+  if (!ReadAll(fd, (char *)&size, sizeof(size))) return false;
+  size = ntohl(size);
+  if (size > MAX_FRAME_SIZE) return false;
+  payload.resize(size);
+  return ReadAll(fd, &payload[0], size);
+}
+
+bool WriteFrame(int fd, const std::string & payload) {
+  const uint32_t size = htonl((uint32_t)payload.size());
+  return WriteAll(fd, (const char *)&size, sizeof(size)) && WriteAll(fd, payload.data(), payload.size());
+}
+
+void ServeConnection(int fd, EvalService & service) {
+  timeval timeout;
+  timeout.tv_sec = CONNECTION_TIMEOUT_SEC;
+  timeout.tv_usec = 0;
+  if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) < 0) { close(fd); return; }
+  std::string payload;
+  while (ReadFrame(fd, payload)) {
+    const size_t kind_end = payload.find('\n');
+    const std::string kind = payload.substr(0, kind_end);
+    const std::string data = (kind_end == std::string::npos) ? "" : payload.substr(kind_end + 1);
+    bool open = true;
+    auto respond = [fd, &open](const std::string & chunk, bool) { open = open && WriteFrame(fd, chunk); };
+    if (!service.Handle(kind, data, respond)) respond("error unknown request " + kind + "\ndone\n", true);
+    if (!open) break;
+  }
+  close(fd);
+}
+
+int main(int argc, char * argv[]) {
+  std::string unix_path;
+  int tcp_port = -1;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string store_path;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string arg(argv[i]);
+    if (arg == "--unix") unix_path = argv[i+1];
+    else if (arg == "--tcp") tcp_port = std::stoi(argv[i+1]);
+    else if (arg == "--threads") threads = std::max(1ul, std::stoul(argv[i+1]));
+    else if (arg == "--store") store_path = argv[i+1];
+    else { std::cerr << "Unknown option: " << arg << std::endl; return 1; }
+  }
+  if (unix_path.empty() == (tcp_port < 0)) {
+    std::cerr << "Usage: " << argv[0] << " (--unix PATH | --tcp PORT) [--threads N] [--store PATH]" << std::endl;
+    return 1;
+  }
+
+  LandscapeStore store;
+  if (store_path.size()) {
+    if (!store.Open(store_path)) { std::cerr << "Not a landscape store: " << store_path << std::endl; return 1; }
+    std::cerr << "Landscape store " << store_path << ": " << store.GetNumLandscapes() << " landscapes." << std::endl;
+  }
+
+  signal(SIGPIPE, SIG_IGN);  // Clients hanging up mid-response shouldn't take the server down.
+  int listen_fd = -1;
+  if (unix_path.size()) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (unix_path.size() >= sizeof(addr.sun_path)) { std::cerr << "Socket path too long." << std::endl; return 1; }
+    std::strcpy(addr.sun_path, unix_path.c_str());
+    struct stat old;
+    if (lstat(unix_path.c_str(), &old) == 0) {
+      if (!S_ISSOCK(old.st_mode)) { std::cerr << "Not a socket, refusing to replace: " << unix_path << std::endl; return 1; }
+      unlink(unix_path.c_str());
+    } else if (errno != ENOENT) { perror("lstat"); return 1; }
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0) { perror("bind"); return 1; }
+  } else {
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // Local only.
+    addr.sin_port = htons((uint16_t)tcp_port);
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    const int reuse = 1;
+    if (listen_fd >= 0) setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (listen_fd < 0 || bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0) { perror("bind"); return 1; }
+  }
+  if (listen(listen_fd, 8) < 0) { perror("listen"); return 1; }
+  std::cerr << "Serving on " << (unix_path.size() ? unix_path : "127.0.0.1:" + std::to_string(tcp_port))
+            << " with " << threads << " demes." << std::endl;
+
+  EvalService service(threads);
+  service.SetStore(&store);
+  while (true) {
+    const int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) continue;
+    ServeConnection(fd, service);
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+// Native landscape store summarizer (build with: make store). Reads every landscape in a landscape store
+// (see deme/LandscapeStore.h; e.g., written by the server's --store) in one pass and summarizes each one,
+// so landscapes can be compared across programs and runs without re-evaluating anything.
+//
+// Usage: ./EventDrivenGP-Roles-LSVis-store <store> [--kind knockout|substitution] [--all 0|1]
+//   --kind  Only summarize landscapes of this kind.
+//   --all   Also summarize landscapes superseded by later ones for the same program/setup/seed (default 0).
+//
+// Output: CSV (one row per landscape) on stdout:
+//   prog_hash,context_hash,kind,seed,results,base_fitness,mean_relative,deleterious,neutral,beneficial
+// Relative fitness is fitness / base fitness (see RelativeFitness); deleterious/neutral/beneficial are the
+// fractions of results (base program excluded) below, at and above 1.
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "deme/Landscape.h"
+#include "deme/LandscapeStore.h"
+
+int main(int argc, char * argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <store> [--kind knockout|substitution] [--all 0|1]" << std::endl;
+    return 1;
+  }
+  std::string kind_name;
+  bool all = false;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    const std::string arg(argv[i]);
+    if (arg == "--kind") kind_name = argv[i+1];
+    else if (arg == "--all") all = (std::string(argv[i+1]) != "0");
+    else { std::cerr << "Unknown option: " << arg << std::endl; return 1; }
+  }
+
+  LandscapeStore store;
+  if (!store.Open(argv[1])) { std::cerr << "Not a landscape store: " << argv[1] << std::endl; return 1; }
+  LandscapeTable table;
+  const auto start = std::chrono::steady_clock::now();
+  store.LoadTable(table, !all);
+  const double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << "Loaded " << table.GetNumLandscapes() << " landscapes (" << table.GetSize() << " results) in "
+            << load_ms << " ms." << std::endl;
+
+  std::cout << "prog_hash,context_hash,kind,seed,results,base_fitness,mean_relative,deleterious,neutral,beneficial" << std::endl;
+  for (size_t l = 0; l < table.GetNumLandscapes(); ++l) {
+    const size_t begin = table.starts[l];
+    const size_t end = table.starts[l+1];
+    if (begin == end) continue;
+    const LandscapeKind kind = table.kind[begin];
+    if (kind_name.size() && kind_name != LandscapeKindName(kind)) continue;
+    double base_fitness = -1.0;
+    for (size_t row = begin; row < end; ++row) {
+      if (table.fID[row] < 0) { base_fitness = table.fitness[row]; break; }
+    }
+    double rel_sum = 0.0;
+    size_t count = 0, deleterious = 0, neutral = 0, beneficial = 0;
+    for (size_t row = begin; row < end; ++row) {
+      if (table.fID[row] < 0) continue;
+      const double rel = RelativeFitness(table.fitness[row], base_fitness);
+      if (rel < 0.0) continue;
+      rel_sum += rel;
+      ++count;
+      if (rel < 1.0) ++deleterious;
+      else if (rel > 1.0) ++beneficial;
+      else ++neutral;
+    }
+    const double denom = count ? (double)count : 1.0;
+    std::cout << std::hex << std::setfill('0') << std::setw(16) << table.prog_hash[begin] << ","
+              << std::setw(16) << table.context_hash[begin] << std::dec << ","
+              << LandscapeKindName(kind) << "," << table.seed[begin] << "," << count << "," << base_fitness << ","
+              << (count ? rel_sum / denom : 0.0) << "," << deleterious / denom << "," << neutral / denom << ","
+              << beneficial / denom << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,59 @@
+// Native deme run tracer (build with: make trace). Runs a program in a deme and writes a binary trace of
+// the run (see deme/DemeTrace.h) that the web app can open and replay.
+//
+// Usage: ./EventDrivenGP-Roles-LSVis-trace <program.gp> <out.trace> [--seed N] [--size W H] [--time T]
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "base/Ptr.h"
+#include "tools/Random.h"
+
+#include "deme/Deme.h"
+#include "deme/RoleTask.h"
+#include "deme/ProgramIO.h"
+#include "deme/DemeTrace.h"
+
+int main(int argc, char * argv[]) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <program.gp> <out.trace> [--seed N] [--size W H] [--time T]" << std::endl;
+    return 1;
+  }
+  int seed = DEFAULT_RANDOM_SEED;
+  size_t width = DIST_SYS_WIDTH;
+  size_t height = DIST_SYS_HEIGHT;
+  size_t eval_time = EVAL_TIME;
+  for (int i = 3; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    if (arg == "--seed" && i + 1 < argc) seed = std::stoi(argv[++i]);
+    else if (arg == "--size" && i + 2 < argc) { width = std::stoul(argv[++i]); height = std::stoul(argv[++i]); }
+    else if (arg == "--time" && i + 1 < argc) eval_time = std::stoul(argv[++i]);
+    else { std::cerr << "Unknown option: " << arg << std::endl; return 1; }
+  }
+
+  emp::Ptr<event_lib_t> event_lib = emp::NewPtr<event_lib_t>(*emp::EventDrivenGP::DefaultEventLib());
+  emp::Ptr<inst_lib_t> inst_lib = emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib());
+  AddRoleInstructions(*inst_lib);
+
+  std::ifstream prog_in(argv[1]);
+  if (!prog_in) { std::cerr << "Could not open " << argv[1] << std::endl; return 1; }
+  Agent agent(LoadProgram(prog_in, inst_lib));
+
+  emp::Random random(seed);
+  DemeTraceRecorder recorder;
+  double fitness = 0.0;
+  {
+    Deme deme(&random, width, height, event_lib, inst_lib);
+    deme.SetTraceRecorder(&recorder);
+    fitness = EvaluateAgent(deme, &agent, eval_time);
+  }
+
+  std::ofstream trace_out(argv[2], std::ios::binary);
+  recorder.Write(trace_out);
+  std::cout << "Fitness: " << fitness << "; wrote " << recorder.GetNumUpdates() << " updates ("
+            << recorder.GetBytes().size() << " bytes) to " << argv[2] << std::endl;
+
+  inst_lib.Delete();
+  event_lib.Delete();
+  return 0;
+}
@@ -0,0 +1,52 @@
+// Web worker for EventDrivenGP-Roles-LSVis: runs deme evaluations (and landscapes) off of the
+// page's main thread. Built with -s BUILD_AS_WORKER=1 (see makefile: web-worker).
+//
+// Requests are EvalRequest text (see deme/EvalRequest.h); each worker function answers one kind of request
+// (see deme/EvalService.h for the requests and their responses). Long responses are streamed back in chunks.
+
+#include <emscripten.h>
+
+#include <string>
+#include "base/Ptr.h"
+
+#include "deme/EvalService.h"
+
+constexpr double PROVISIONAL_RESPONSE_INTERVAL = 100.0; // Milliseconds between streamed landscape chunks.
+
+emp::Ptr<EvalService> service;
+emp::Ptr<LandscapeStore> store;     // Landscapes worked out so far (for as long as the page is open).
+
+void Respond(const std::string & msg, bool final) {
+  std::string resp(msg);
+  if (final) emscripten_worker_respond(&resp[0], (int)resp.size());
+  else emscripten_worker_respond_provisionally(&resp[0], (int)resp.size());
+}
+
+void HandleRequest(const std::string & kind, char * data, int size) {
+  // No threads in here; the service gets a single deme.
+  if (!service) {
+    service = emp::NewPtr<EvalService>(1, PROVISIONAL_RESPONSE_INTERVAL);
+    store = emp::NewPtr<LandscapeStore>();
+    service->SetStore(store);
+  }
+  service->Handle(kind, std::string(data, (size_t)size), Respond);
+}
+
+extern "C" {
+
+EMSCRIPTEN_KEEPALIVE
+void lsvis_worker_evaluate(char * data, int size) { HandleRequest("evaluate", data, size); }
+
+EMSCRIPTEN_KEEPALIVE
+void lsvis_worker_landscape(char * data, int size) { HandleRequest("landscape", data, size); }
+
+EMSCRIPTEN_KEEPALIVE
+void lsvis_worker_cell_landscape(char * data, int size) { HandleRequest("cell_landscape", data, size); }
+
+EMSCRIPTEN_KEEPALIVE
+void lsvis_worker_mutation_landscape(char * data, int size) { HandleRequest("mutation_landscape", data, size); }
+
+EMSCRIPTEN_KEEPALIVE
+void lsvis_worker_batch(char * data, int size) { HandleRequest("batch", data, size); }
+
+}
@@ -1,3 +1,25 @@
+// EventDrivenGP-Roles-LSVis web app: runs an EventDrivenGP program in the Role-ID deme environment and shows
+// its landscapes.
+//
+//   Landscape          Knocks out (Nops) each instruction in turn and shades it by the resulting fitness. Fills in
+//                      a chunk at a time: base program, then the instructions on screen (scrolling re-prioritizes),
+//                      then the rest by how often they ran in the last run (see deme/LandscapeScheduler.h).
+//                      Changing the program or any knockout cancels what's left.
+//   Cell Landscape     Shades each deme cell by the fitness with it knocked out, and reports the mean fitness of
+//                      random 2-cell knockouts.
+//   Mutations          Tries every single-point mutation (each opcode at each position, plus each argument moved
+//                      by one) and shades each position by its min/mean/max effect. Results are cached per
+//                      program; Mutations (Matrix) downloads them (format in deme/SubstitutionLandscape.h).
+//   Estimate           Averages fitness over seeds until the 95% confidence interval is tight enough or the seed
+//                      budget runs out (see deme/FitnessEstimate.h).
+//   Save Trace         Downloads the last run as a deme trace (see deme/DemeTrace.h); Replay Run replays it, and
+//                      Open Trace opens one (e.g., from the native tracer). The slider scrubs through updates.
+// Landscapes run programs through the peephole optimizer (deme/ProgramOptimizer.h) and are kept in a landscape
+// store (deme/LandscapeStore.h); the worker and server also batch straight-line programs (deme/BatchEvaluator.h).
+// The program view only draws the rows on screen (drawProgVis in web/js/lib.js). Functions collapse (+/-) to a
+// row summarizing their instructions' landscape; programs over 1024 instructions start out collapsed.
+// With 'make web-worker' (-DLSVIS_WORKER), evaluations and landscapes run on a web worker
+// (EventDrivenGP-Roles-LSVis-worker.cc) and stream into the program view as they come in.
 
 #include <iostream>
 #include <sstream>
@@ -21,6 +43,22 @@
 #include "web/d3/visualizations.h"
 #include "web/d3/dataset.h"
 
+#include "deme/Deme.h"
+#include "deme/RoleTask.h"
+#include "deme/ProgramIO.h"
+#include "deme/Landscape.h"
+#include "deme/SubstitutionLandscape.h"
+#include "deme/FitnessEstimate.h"
+#include "deme/DemePool.h"
+#include "deme/DemeProfiler.h"
+#include "deme/EvalRequest.h"
+#include "deme/LandscapeStore.h"
+#include "deme/LandscapeScheduler.h"
+
+#ifdef LSVIS_WORKER
+#include <emscripten.h>
+#endif
+
 // @amlalejini - TODO:
 // [ ] Switch to using linear scales
 // [x] Make sizing of everything dynamic
@@ -33,176 +71,6 @@
 // [ ] Parameterize everything.
 
 
-using event_lib_t = typename emp::EventDrivenGP::event_lib_t;
-using event_t = typename emp::EventDrivenGP::event_t;
-using inst_lib_t = typename::emp::EventDrivenGP::inst_lib_t;
-using inst_t = typename::emp::EventDrivenGP::inst_t;
-using affinity_t = typename::emp::EventDrivenGP::affinity_t;
-using program_t = emp::EventDrivenGP::Program;
-using fun_t = emp::EventDrivenGP::Function;
-using state_t = emp::EventDrivenGP::State;
-
-constexpr size_t EVAL_TIME = 50;
-constexpr size_t DIST_SYS_WIDTH = 5;
-constexpr size_t DIST_SYS_HEIGHT = 5;
-constexpr size_t DIST_SYS_SIZE = DIST_SYS_WIDTH * DIST_SYS_HEIGHT;
-
-constexpr size_t TRAIT_ID__ROLE_ID = 0;
-constexpr size_t TRAIT_ID__X_LOC = 1;
-constexpr size_t TRAIT_ID__Y_LOC = 2;
-
-constexpr size_t CPU_SIZE = emp::EventDrivenGP::CPU_SIZE;
-constexpr size_t MAX_INST_ARGS = emp::EventDrivenGP::MAX_INST_ARGS;
-
-constexpr int DEFAULT_RANDOM_SEED = -1;
-
-// This will be the target of evolution (what the world manages/etc.)
-struct Agent {
-  size_t valid_uid_cnt;
-  size_t valid_id_cnt;
-  program_t program;
-
-  Agent(emp::Ptr<inst_lib_t> _ilib)
-  : valid_uid_cnt(0), valid_id_cnt(0), program(_ilib) { ; }
-
-  Agent(const program_t & _program)
-  : valid_uid_cnt(0), valid_id_cnt(0), program(_program) { ; }
-
-};
-
-// Deme structure for holding distributed system.
-struct Deme {
-  using hardware_t = emp::EventDrivenGP;
-  using memory_t = typename emp::EventDrivenGP::memory_t;
-  using grid_t = emp::vector<emp::Ptr<hardware_t>>;
-  using pos_t = std::pair<size_t, size_t>;
-
-  grid_t grid;
-  size_t width;
-  size_t height;
-  emp::Ptr<emp::Random> rnd;
-  emp::Ptr<event_lib_t> event_lib;
-  emp::Ptr<inst_lib_t> inst_lib;
-
-  emp::Ptr<Agent> agent_ptr;
-  bool agent_loaded;
-
-  std::unordered_set<size_t> knockouts;
-
-  Deme(emp::Ptr<emp::Random> _rnd, size_t _w, size_t _h, emp::Ptr<event_lib_t> _elib, emp::Ptr<inst_lib_t> _ilib)
-    : grid(_w * _h), width(_w), height(_h), rnd(_rnd), event_lib(_elib), inst_lib(_ilib), agent_ptr(nullptr), agent_loaded(false), knockouts() {
-    // Register dispatch function.
-    event_lib->RegisterDispatchFun("Message", [this](hardware_t & hw_src, const event_t & event){ this->DispatchMessage(hw_src, event); });
-    // Fill out the grid with hardware.
-    for (size_t i = 0; i < width * height; ++i) {
-      grid[i].New(inst_lib, event_lib, rnd);
-      pos_t pos = GetPos(i);
-      grid[i]->SetTrait(TRAIT_ID__ROLE_ID, 0);
-      grid[i]->SetTrait(TRAIT_ID__X_LOC, pos.first);
-      grid[i]->SetTrait(TRAIT_ID__Y_LOC, pos.second);
-    }
-  }
-
-  ~Deme() {
-    Reset();
-    for (size_t i = 0; i < grid.size(); ++i) {
-      grid[i].Delete();
-    }
-    grid.resize(0);
-  }
-
-  void Reset() {
-    agent_ptr = nullptr;
-    agent_loaded = false;
-    for (size_t i = 0; i < grid.size(); ++i) {
-      grid[i]->ResetHardware();
-      grid[i]->SetTrait(TRAIT_ID__ROLE_ID, 0);
-    }
-  }
-
-  void LoadAgent(emp::Ptr<Agent> _agent_ptr) {
-    Reset();
-    agent_ptr = _agent_ptr;
-    for (size_t i = 0; i < grid.size(); ++i) {
-      grid[i]->SetProgram(agent_ptr->program);
-      grid[i]->SpawnCore(0, memory_t(), true);
-    }
-    agent_loaded = true;
-  }
-
-  size_t GetWidth() const { return width; }
-  size_t GetHeight() const { return height; }
-
-  pos_t GetPos(size_t id) { return pos_t(id % width, id / width); }
-  size_t GetID(size_t x, size_t y) { return (y * width) + x; }
-
-  void Print(std::ostream & os=std::cout) {
-    os << "=============DEME=============\n";
-    for (size_t i = 0; i < grid.size(); ++i) {
-      os << "--- Agent @ (" << GetPos(i).first << ", " << GetPos(i).second << ") ---\n";
-      grid[i]->PrintState(os); os << "\n";
-    }
-  }
-
-  void DispatchMessage(hardware_t & hw_src, const event_t & event) {
-    const size_t x = (size_t)hw_src.GetTrait(TRAIT_ID__X_LOC);
-    const size_t y = (size_t)hw_src.GetTrait(TRAIT_ID__Y_LOC);
-    emp::vector<size_t> recipients;
-    if (event.HasProperty("send")) {
-      // Send to random neighbor.
-      recipients.push_back(GetRandomNeighbor(GetID(x, y)));
-    } else {
-      // Treat as broadcast, send to all neighbors.
-      recipients.push_back(GetID((size_t)emp::Mod((int)x - 1, (int)width), (size_t)emp::Mod((int)y, (int)height)));
-      recipients.push_back(GetID((size_t)emp::Mod((int)x + 1, (int)width), (size_t)emp::Mod((int)y, (int)height)));
-      recipients.push_back(GetID((size_t)emp::Mod((int)x, (int)width), (size_t)emp::Mod((int)y - 1, (int)height)));
-      recipients.push_back(GetID((size_t)emp::Mod((int)x, (int)width), (size_t)emp::Mod((int)y + 1, (int)height)));
-    }
-    // Dispatch event to recipients.
-    for (size_t i = 0; i < recipients.size(); ++i)
-      grid[recipients[i]]->QueueEvent(event);
-  }
-
-  // Pulled this function from PopMng_Grid.
-  size_t GetRandomNeighbor(size_t id) {
-    const int offset = rnd->GetInt(9);
-    const int rand_x = (int)(id%width) + offset%3-1;
-    const int rand_y = (int)(id/width) + offset/3-1;
-    return ((size_t)emp::Mod(rand_x, (int)width) + (size_t)emp::Mod(rand_y, (int)height)*width);
-  }
-
-  void Advance(size_t t=1) { for (size_t i = 0; i < t; ++i) SingleAdvance(); }
-
-  void SingleAdvance() {
-    emp_assert(agent_loaded);
-    for (size_t i = 0; i < grid.size(); ++i) {
-      if (!knockouts.count(i)) grid[i]->SingleProcess();
-    }
-  }
-};
-
-// Some extra instructions for this experiment.
-void Inst_GetRoleID(emp::EventDrivenGP & hw, const inst_t & inst) {
-  state_t & state = *hw.GetCurState();
-  state.SetLocal(inst.args[0], hw.GetTrait(TRAIT_ID__ROLE_ID));
-}
-
-void Inst_SetRoleID(emp::EventDrivenGP & hw, const inst_t & inst) {
-  state_t & state = *hw.GetCurState();
-  hw.SetTrait(TRAIT_ID__ROLE_ID, (int)state.AccessLocal(inst.args[0]));
-}
-
-void Inst_GetXLoc(emp::EventDrivenGP & hw, const inst_t & inst) {
-  state_t & state = *hw.GetCurState();
-  state.SetLocal(inst.args[0], hw.GetTrait(TRAIT_ID__X_LOC));
-}
-
-void Inst_GetYLoc(emp::EventDrivenGP & hw, const inst_t & inst) {
-  state_t & state = *hw.GetCurState();
-  state.SetLocal(inst.args[0], hw.GetTrait(TRAIT_ID__Y_LOC));
-}
-
-
 namespace emp {
 namespace web {
 
@@ -216,6 +84,13 @@ protected:
                                 )
   };
 
+  struct MutationSummary {
+    EMP_BUILD_INTROSPECTIVE_TUPLE(double, mean,
+                                  double, min,
+                                  double, max
+                                )
+  };
+
   using pos_t = std::pair<int, int>;
 
   std::map<std::string, program_t> program_map;     // Map of available programs.
@@ -224,11 +99,17 @@ protected:
 
   std::map<pos_t, pos_t> program_pos_map; // Map from original(base) program fp/ip space to cur program fp/ip space.
   std::map<pos_t, double> landscape_map;  // Map from cur program fp/ip --> fitness contribution for that location.
+  size_t landscape_gen = 0;               // Bumped every time landscaping is reset (lets us drop stale async results).
+  std::map<pos_t, MutationSummary> mutation_map;  // Map from cur program fp/ip --> relative fitness over every single-point mutation there.
 
   std::set<std::pair<int, int>> inst_knockouts;
   std::set<int> func_knockouts;
+  std::set<int> func_collapsed;           // Functions drawn as a single summary row (original program space).
+  size_t auto_collapse_size = 1024;
 
-  std::function<double(Ptr<program_t>)> eval_program = [](Ptr<program_t>) { return 0.0; };
+  // Landscape() hands the built program (and current landscape generation) off to this function; results
+  // come back through AddLandscapeVal.
+  std::function<void(Ptr<program_t>, size_t)> landscape_program;
 
   std::function<bool(int, int)> is_knockedout = [this](int fID, int iID = -1) {
     if (iID == -1) {
@@ -238,6 +119,7 @@ protected:
   };
 
   std::function<void(int, int)> knockout_inst = [this](int fp, int ip) {
+    CancelLandscape();
     std::pair<int, int> inst_loc(fp, ip);
     if (this->inst_knockouts.count(inst_loc))
       this->inst_knockouts.erase(inst_loc);
@@ -246,12 +128,24 @@ protected:
   };
 
   std::function<void(int)> knockout_func = [this](int fp) {
+    CancelLandscape();
     if (this->func_knockouts.count(fp))
       this->func_knockouts.erase(fp);
     else
       this->func_knockouts.insert(fp);
   };
 
+  std::function<void(int)> collapse_func = [this](int fp) {
+    if (this->func_collapsed.count(fp))
+      this->func_collapsed.erase(fp);
+    else
+      this->func_collapsed.insert(fp);
+  };
+
+  std::function<bool(int)> is_collapsed = [this](int fp) {
+    return (bool)this->func_collapsed.count(fp);
+  };
+
   std::function<ProgramPosition(int, int)> original_to_built_space = [this](int fID, int iID) {
     std::pair<int, int> loc(fID, iID);
     ProgramPosition pos;
@@ -271,6 +165,59 @@ protected:
     return landscape_map.at(loc);
   };
 
+  std::function<bool(int, int)> has_landscape_val = [this](int fID, int iID) {
+    return (bool)landscape_map.count(std::make_pair(fID, iID));
+  };
+
+  std::function<MutationSummary(int, int)> get_mutation_summary = [this](int fID, int iID) {
+    std::pair<int, int> loc(fID, iID);
+    if (!mutation_map.count(loc)) return MutationSummary();
+    return mutation_map.at(loc);
+  };
+
+  std::function<bool(int, int)> has_mutation_summary = [this](int fID, int iID) {
+    return (bool)mutation_map.count(std::make_pair(fID, iID));
+  };
+
+  // Knockout landscape of a whole function (original program space): min/mean/max relative fitness over
+  // its instructions landscaped so far (min == -1 => none yet). Shown on collapsed functions.
+  std::function<MutationSummary(int)> get_func_landscape_summary = [this](int fID) {
+    MutationSummary summary;
+    summary.min(-1.0); summary.mean(-1.0); summary.max(-1.0);
+    if (!Has(program_map, display_program) || !landscape_map.count(pos_t(-1, -1))) return summary;
+    const program_t & program = program_map.at(display_program);
+    if (fID < 0 || fID >= (int)program.GetSize()) return summary;
+    const double base_fitness = landscape_map.at(pos_t(-1, -1));
+    double sum = 0.0;
+    size_t count = 0;
+    for (size_t iID = 0; iID < program[(size_t)fID].GetSize(); ++iID) {
+      auto pos_it = program_pos_map.find(pos_t(fID, (int)iID));
+      if (pos_it == program_pos_map.end()) continue;
+      auto ls_it = landscape_map.find(pos_it->second);
+      if (ls_it == landscape_map.end()) continue;
+      const double rel = RelativeFitness(ls_it->second, base_fitness);
+      if (rel < 0.0) continue;
+      if (!count || rel < summary.min()) summary.min(rel);
+      if (!count || rel > summary.max()) summary.max(rel);
+      sum += rel;
+      ++count;
+    }
+    if (count) summary.mean(sum / (double)count);
+    return summary;
+  };
+
+  Ptr<DemeProfiler> profiler;  // Profiler attached to the deme that runs cur_program (if any).
+
+  std::function<size_t(int, int)> get_exec_count = [this](int fID, int iID) {
+    if (!profiler || fID < 0 || iID < 0) return (size_t)0;
+    return profiler->GetPositionCount((size_t)fID, (size_t)iID);
+  };
+
+  std::function<size_t()> get_max_exec_count = [this]() {
+    if (!profiler) return (size_t)0;
+    return profiler->GetMaxPositionCount();
+  };
+
 
   std::function<void(std::string)> on_program_select = [this](std::string name) {
     DisplayProgram(name);
@@ -279,13 +226,23 @@ protected:
   void InitializeVariables() {
     JSWrap(knockout_func, "knockout_func");
     JSWrap(knockout_inst, "knockout_inst");
+    JSWrap(collapse_func, "collapse_func");
+    JSWrap(is_collapsed, "is_func_collapsed");
     JSWrap(is_knockedout, "is_code_knockedout");
     JSWrap(original_to_built_space, "original_to_built_prog_space");
     JSWrap(get_landscape_val, "get_landscape_val");
+    JSWrap(has_landscape_val, "has_landscape_val");
+    JSWrap(get_mutation_summary, "get_mutation_summary");
+    JSWrap(has_mutation_summary, "has_mutation_summary");
+    JSWrap(get_func_landscape_summary, "get_func_landscape_summary");
+    JSWrap(get_exec_count, "get_exec_count");
+    JSWrap(get_max_exec_count, "get_max_exec_count");
     JSWrap(on_program_select, "on_program_select");
     JSWrap([this](){ return this->program_data->GetID(); }, "get_prog_data_obj_id");
-    JSWrap([this](){ return this->GetSVG()->GetID(); }, "get_prog_vis_svg_obj_id");
-    EM_ASM({ window.addEventListener("resize", resizeProgVis); });
+    EM_ASM({
+      window.addEventListener("resize", resizeProgVis);
+      window.addEventListener("scroll", scheduleProgVisRender);
+    });
     GetSVG()->Move(0, 0);
   }
 
@@ -353,9 +310,76 @@ public:
     func_knockouts.clear();
   }
 
+  /// Programs bigger than this (in instructions) start out with every function collapsed.
+  void SetAutoCollapseSize(size_t size) { auto_collapse_size = size; }
+
+  void ResetCollapsed() {
+    func_collapsed.clear();
+    if (!Has(program_map, display_program)) return;
+    const program_t & program = program_map.at(display_program);
+    size_t num_insts = 0;
+    for (size_t fID = 0; fID < program.GetSize(); ++fID) num_insts += program[fID].GetSize();
+    if (num_insts <= auto_collapse_size) return;
+    for (size_t fID = 0; fID < program.GetSize(); ++fID) func_collapsed.insert((int)fID);
+  }
+
   void ResetLandscaping() {
     program_pos_map.clear();
     landscape_map.clear();
+    mutation_map.clear();
+    ++landscape_gen;
+  }
+
+  size_t GetLandscapeGen() const { return landscape_gen; }
+
+  /// Drop results of landscapes in progress (e.g., because what they're landscaping changed); what's been
+  /// drawn so far stays.
+  void CancelLandscape() { ++landscape_gen; }
+
+  /// Positions (in cur program space) of the instructions currently on screen, top to bottom.
+  emp::vector<pos_t> GetVisiblePositions() {
+    emp::vector<pos_t> visible;
+    if (!Has(program_map, display_program)) return visible;
+    const int first_row = EM_ASM_INT_V({ return visibleProgRows()[0]; });
+    const int last_row = EM_ASM_INT_V({ return visibleProgRows()[1]; });
+    const program_t & program = program_map.at(display_program);
+    int row = 0;   // Each function takes a row for its header, then a row per instruction (unless collapsed).
+    for (size_t fID = 0; fID < program.GetSize() && row <= last_row; ++fID) {
+      const int fun_rows = 1 + (func_collapsed.count((int)fID) ? 0 : (int)program[fID].GetSize());
+      if (row + fun_rows <= first_row) { row += fun_rows; continue; }
+      for (size_t iID = 0; iID < program[fID].GetSize(); ++iID) {
+        const int inst_row = row + 1 + (int)iID;
+        if (inst_row < first_row) continue;
+        if (inst_row > last_row) break;
+        auto it = program_pos_map.find(pos_t((int)fID, (int)iID));
+        if (it != program_pos_map.end()) visible.emplace_back(it->second);
+      }
+      row += fun_rows;
+    }
+    return visible;
+  }
+
+  /// Record a landscape result for the cur program position (fID, iID) ((-1, -1) is base fitness).
+  /// Results from an out-of-date landscape generation are dropped.
+  bool AddLandscapeVal(size_t gen, int fID, int iID, double fitness) {
+    if (gen != landscape_gen) return false;
+    landscape_map[std::make_pair(fID, iID)] = fitness;
+    return true;
+  }
+
+  /// Record a mutational landscape of the cur program (dropped if from an out-of-date landscape generation).
+  bool SetMutationLandscape(size_t gen, const SubstitutionMatrix & matrix) {
+    if (gen != landscape_gen) return false;
+    mutation_map.clear();
+    for (size_t row = 0; row < matrix.GetNumRows(); ++row) {
+      const SubstitutionMatrix::Summary summary = matrix.GetSummary(row);
+      if (!summary.count) continue;
+      MutationSummary & rel = mutation_map[pos_t((int)matrix.positions[row].first, (int)matrix.positions[row].second)];
+      rel.mean(RelativeFitness(summary.mean, matrix.base_fitness));
+      rel.min(RelativeFitness(summary.min, matrix.base_fitness));
+      rel.max(RelativeFitness(summary.max, matrix.base_fitness));
+    }
+    return true;
   }
 
   Ptr<D3::JSONDataset> GetDataset() { return program_data; }
@@ -374,23 +398,10 @@ public:
     emp_assert(Has(program_map, display_program));
     if (cur_program) cur_program.Delete();
     const program_t & ref_program = program_map.at(display_program);
-    cur_program = NewPtr<program_t>(ref_program.inst_lib);
     // Building a new program, reset landscaping.
     ResetLandscaping();
     // Build cur_program up, knocking out appropriate functions/instructions
-    for (size_t fID = 0; fID < ref_program.GetSize(); ++fID) {
-      if (func_knockouts.count(fID)) continue;
-      fun_t new_fun = fun_t(ref_program[fID].affinity);
-      for (size_t iID = 0; iID < ref_program[fID].GetSize(); ++iID) {
-        if (inst_knockouts.count(std::make_pair<int, int>(fID, iID))) continue;
-        program_pos_map.insert(std::make_pair(std::make_pair(fID, iID),
-                                              std::make_pair(cur_program->GetSize(), new_fun.GetSize())
-                                              )); // Lets me recover original position given cur program position.
-        new_fun.inst_seq.emplace_back(ref_program[fID].inst_seq[iID]);
-      }
-      // Add new function to program if not empty.
-      if (new_fun.GetSize()) cur_program->PushFunction(new_fun);
-    }
+    cur_program = NewPtr<program_t>(BuildKnockoutProgram(ref_program, func_knockouts, inst_knockouts, program_pos_map));
     std::cout << "Built program: " << std::endl;
     cur_program->PrintProgram();
   }
@@ -401,8 +412,15 @@ public:
     program_map.emplace(_name, _program);
   }
 
-  void SetEvalProgramFun(std::function<double(Ptr<program_t>)> eval_fun) {
-    eval_program = eval_fun;
+  void SetLandscapeProgramFun(std::function<void(Ptr<program_t>, size_t)> ls_fun) {
+    landscape_program = ls_fun;
+  }
+
+  /// Profile of cur_program's runs to overlay on the program.
+  void SetProfiler(Ptr<DemeProfiler> _profiler) { profiler = _profiler; }
+
+  void DrawProfile() {
+    EM_ASM({ profileProg(); });
   }
 
   // @amlalejini - TODO
@@ -428,163 +446,24 @@ public:
     ResetKnockouts();
     // Reset Landscaping.
     ResetLandscaping();
+    ResetCollapsed();
     // Set program data to correct program
     SetProgramData(name);
     // Draw program from program data.
     DrawProgram();
   }
 
-  // @amlalejini - TODO
+  /// Draw program from program data. Only what's on screen is drawn (see drawProgVis in lib.js), so
+  /// this stays cheap for big programs.
   void DrawProgram() {
     if (!program_data) return;
     EM_ASM({
       var program_data_obj_id = emp.get_prog_data_obj_id();
-      var svg_obj_id = emp.get_prog_vis_svg_obj_id();
       if (program_data_obj_id == 255) return; // TODO: make this more robust.
       var program_data = js.objects[program_data_obj_id][0];
-      var svg = js.objects[svg_obj_id];
-      var prg_name = program_data["name"];
-      var iblk_h= 20;
-      var iblk_w = 65;
-      var fblk_w = 100;
-      var fitblk_w = 10;
-      var iblk_lpad = fblk_w - (iblk_w + fitblk_w);
-      var txt_lpad = 2;
-
-      var vis_w = d3.select("#program-vis")[0][0].clientWidth;
-      var x_domain = Array(0, 100);
-      var x_range = Array(0, vis_w);
-      var xScale = d3.scale.linear().domain(x_domain).range(x_range);
-
-      // Compute program display height.
-      // @amlalejini - TODO: make this a function.
-      var prg_h = program_data["functions"].length * iblk_h;
-      for (fID = 0; fID < program_data["functions"].length; fID++) {
-        prg_h += program_data["functions"][fID].sequence_len * iblk_h;
-      }
-      // Reconfigure vis size based on program data.
-      svg.selectAll("*").remove();
-      svg.attr({"width": xScale(fblk_w), "height": prg_h});
       // Set program name.
-      d3.select("#select_prog_dropdown_btn").text("Current Program: " + prg_name);
-      // Add a group for each function.
-      var functions = svg.selectAll("g").data(program_data["functions"]);
-      functions.enter().append("g");
-      functions.exit().remove();
-      functions.attr({"class": "program-function",
-                      "knockout": function(func, fID) {
-                        var ko = (emp.is_code_knockedout(fID, -1)) ? "true" : "false";
-                        return ko;
-                      },
-                      "transform": function(func, fID) {
-                        var x_trans = xScale(0);
-                        var y_trans = (fID * iblk_h + func.cumulative_seq_len * iblk_h);
-                        return "translate(" + x_trans + "," + y_trans + ")";
-                      }});
-      var min_fsize = -1;
-      functions.selectAll(".function-def-rect").remove();
-      functions.selectAll(".function-def-txt").remove();
-      functions.append("rect")
-               .attr({
-                 "class": "function-def-rect",
-                 "width": xScale(fblk_w),
-                 "height": iblk_h,
-                 "knockout": function(func, fID) {
-                   var ko = (emp.is_code_knockedout(fID, -1)) ? "true" : "false";
-                   return ko;
-                 }
-                })
-               .on("click", on_func_click);
-      functions.append("text")
-               .attr({
-                 "class": "function-def-txt",
-                 "x": txt_lpad,
-                 "y": iblk_h,
-                 "pointer-events": "none"
-               })
-               .text(function(func, fID) { return "fn-" + fID + " " + func.affinity + ":"; })
-               .style("font-size", "1px")
-               .each(function(d) {
-                 var box = this.getBBox();
-                 var pbox = this.parentNode.getBBox();
-                 var fsize = Math.min(pbox.width/box.width, pbox.height/box.height)*0.9;
-                 if (min_fsize == -1 || fsize < min_fsize) {
-                   min_fsize = fsize;
-                 }
-               })
-               .style("font-size", min_fsize)
-               .each(function(d) {
-                 var box = this.getBBox();
-                 var pbox = this.parentNode.getBBox();
-                 d.shift = ((pbox.height - box.height)/2);
-               })
-               .attr({
-                 "dy": function(d) { return (-1 * (d.shift + 2)) + "px"; }
-               });
-      // Draw instructions for each function.
-      functions.each(function(func, fID) {
-        var instructions = d3.select(this).selectAll("g").data(func.sequence);
-        instructions.enter().append("g");
-        instructions.exit().remove();
-        instructions.attr({
-                          "class": "program-instruction",
-                          "transform": function(d, i) {
-                            var x_trans = xScale(iblk_lpad);
-                            var y_trans = (iblk_h + i * iblk_h);
-                            return "translate(" + x_trans + "," + y_trans + ")";
-                          },
-                          "knockout": function(inst, iID) { return emp.is_code_knockedout(fID, iID) ? "true" : "false"; }
-                        });
-        instructions.append("rect")
-                    .attr({
-                      "class": "program-instruction-blk",
-                      "width": function(d) { d.w = xScale(iblk_w); return d.w; },
-                      "height": iblk_h,
-                      "knockout": function(inst, iID) { return emp.is_code_knockedout(fID, iID) ? "true" : "false"; }
-                    })
-                    .on("click", on_inst_click);
-        var min_fsize = -1;
-        instructions.append("text")
-                    .attr({
-                      "class": "program-instruction-txt",
-                      "x": txt_lpad,
-                      "y": iblk_h,
-                      "pointer-events": "none"
-                    })
-                    .text(function(d, i) {
-                      var inst_str = d.name;
-                      if (d.has_affinity) inst_str += " " + d.affinity;
-                      for (arg = 0; arg < d.num_args; arg++) inst_str += " " + d.args[arg];
-                      return inst_str;
-                    })
-                    .style("font-size", "1px")
-                    .each(function(d) {
-                      var box = this.getBBox();
-                      var pbox = this.parentNode.getBBox();
-                      var fsize = Math.min(pbox.width/box.width, pbox.height/box.height)*0.9;
-                      if (min_fsize == -1 || fsize < min_fsize) {
-                        min_fsize = fsize;
-                      }
-                    })
-                    .style("font-size", min_fsize)
-                    .each(function(d) {
-                      var box = this.getBBox();
-                      var pbox = this.parentNode.getBBox();
-                      d.shift = ((pbox.height - box.height)/2);
-                    })
-                    .attr({
-                      "dy": function(d) { return (-1 * (d.shift + 2)) + "px"; }
-                    });
-        // Fitness contribution indicator.
-        instructions.append("rect")
-                    .attr({
-                      "class": "fitness-contribution-blk",
-                      "x": xScale(iblk_w),
-                      "width": xScale(fitblk_w),
-                      "height": iblk_h,
-                      "fill": "white"
-                    });
-      });
+      d3.select("#select_prog_dropdown_btn").text("Current Program: " + program_data["name"]);
+      drawProgVis(program_data);
     });
   }
 
@@ -593,29 +472,19 @@ public:
     std::cout << "Program vis::Landscape" << std::endl;
     // Build current program.
     BuildCurProgram();
-    // Get baseline fitness.
-    double base_fitness = eval_program(cur_program);
-    // Do single instruction knockouts.
-    program_t & base_prog = *cur_program;
-    landscape_map.insert(std::make_pair(std::make_pair(-1, -1), base_fitness));
-    program_t ko_prog(base_prog);
-    for (size_t fID = 0; fID < base_prog.GetSize(); ++fID) {
-      pos_t func_loc(fID, -1); // Key for function knockout fitness value.
-      for (size_t iID = 0; iID < base_prog[fID].GetSize(); ++iID) {
-        pos_t inst_loc(fID, iID); // Key for instruction knockout fitness value.
-        // Build program w/this location knocked out.
-        ko_prog.SetInst(fID, iID, ko_prog.inst_lib->GetID("Nop"));
-        // Evaluate program w/this location knocked out.
-        double ko_fitness = eval_program(&ko_prog);
-        // Store fitness value of program w/this location knocked out.
-        landscape_map.insert(std::make_pair(inst_loc, ko_fitness));
-        // Restore ko_prog.
-        ko_prog.SetInst(fID, iID, base_prog[fID].inst_seq[iID]);
-      }
-    }
-    // Update landscaping on visualization.
+    // Hand landscaping off.
+    emp_assert(landscape_program);
+    landscape_program(cur_program, landscape_gen);
+    DrawLandscape();
+  }
+
+  void DrawLandscape() {
     EM_ASM({ landscapeProg(); });
   }
+
+  void DrawMutationLandscape() {
+    EM_ASM({ mutationLandscapeProg(); });
+  }
 };
 
 class EventDrivenGP_DemeVis : public D3Visualization {
@@ -631,8 +500,11 @@ private:
   emp::Ptr<Deme> cur_deme;
   emp::vector<HardwareDatum> deme_data;
 
+  std::function<void()> on_knockout;   // Called whenever a cell is knocked out (or back in).
+
   std::function<void(size_t)> knockout = [this](size_t id) {
     if (!this->cur_deme) return;
+    if (this->on_knockout) this->on_knockout();
     if (this->cur_deme->knockouts.count(id))
       this->cur_deme->knockouts.erase(id);
     else
@@ -649,6 +521,8 @@ private:
 public:
   EventDrivenGP_DemeVis() : D3Visualization(1, 1) { ; }
 
+  void SetKnockoutFun(const std::function<void()> & fun) { on_knockout = fun; }
+
   void Setup() {
     std::cout << "Deme vis setup running." << std::endl;
     InitializeVariables();
@@ -670,11 +544,63 @@ public:
     // Resize deme data to match deme size.
     deme_data.resize(deme->grid.size());
     for (size_t i = 0; i < deme_data.size(); ++i) {
-      deme_data[i].role_id(deme->grid[i]->GetTrait(TRAIT_ID__ROLE_ID));
+      deme_data[i].role_id(deme->traits.role_id[i]);
       deme_data[i].loc(i);
       deme_data[i].knockedout((bool)deme->knockouts.count(i));
     }
+    DrawCells(deme->GetWidth(), deme->GetHeight());
+  }
+
+  /// Draw the deme as it was after the given update of a recorded run, along with the messages
+  /// sent during that update.
+  void DrawTrace(const DemeTrace & trace, size_t update) {
+    if (trace.IsEmpty()) return;
+    update = std::min(update, trace.GetNumUpdates());
+    emp::vector<int> role_ids;
+    emp::vector<size_t> core_cnts;
+    trace.GetState(update, role_ids, core_cnts);
+    deme_data.resize(role_ids.size());
+    for (size_t i = 0; i < deme_data.size(); ++i) {
+      deme_data[i].role_id(role_ids[i]);
+      deme_data[i].loc(i);
+      deme_data[i].knockedout(false);
+    }
+    DrawCells(trace.GetWidth(), trace.GetHeight());
+    // Message edges, flattened (src, dest, src, dest, ...).
+    const auto & msgs = trace.GetMessages(update);
+    emp::vector<uint32_t> edges;
+    for (const auto & msg : msgs) { edges.emplace_back((uint32_t)msg.first); edges.emplace_back((uint32_t)msg.second); }
+    EM_ASM_ARGS({
+      var svg = js.objects[$0];
+      var edges = HEAPU32.subarray($1 >> 2, ($1 >> 2) + $2);
+      var deme_width = $3;
+      var cell_size = svg.attr("width") / deme_width;
+      var center = function(loc, coord) {
+        var pos = (coord == 0) ? (loc % deme_width) : Math.floor(loc / deme_width);
+        return cell_size * (pos + 0.5);
+      };
+      for (var i = 0; i < edges.length; i += 2) {
+        svg.append("line")
+           .attr({"class": "deme-msg-edge",
+                  "x1": center(edges[i], 0), "y1": center(edges[i], 1),
+                  "x2": center(edges[i+1], 0), "y2": center(edges[i+1], 1),
+                  "pointer-events": "none"});
+      }
+    }, GetSVG()->GetID(), edges.data(), edges.size(), trace.GetWidth());
+  }
+
+  /// Shade each cell of the drawn deme by the fitness with it knocked out (relative to base fitness).
+  void DrawCellLandscape(const CellLandscape & landscape) {
+    emp::vector<double> rel_fitness(landscape.cell_fitness.size());
+    for (size_t i = 0; i < rel_fitness.size(); ++i) rel_fitness[i] = landscape.GetRelativeFitness(landscape.cell_fitness[i]);
+    EM_ASM_ARGS({
+      landscapeDeme(HEAPF64.subarray($0 >> 3, ($0 >> 3) + $1));
+    }, rel_fitness.data(), rel_fitness.size());
+  }
+
+  void DrawCells(size_t deme_width, size_t deme_height) {
     D3::Selection * svg = GetSVG();
+    svg->SelectAll(".deme-msg-edge").Remove();
     svg->SelectAll("g").Remove(); // Clean up old deme elements.
     svg->SelectAll("g").Data(deme_data)
                        .EnterAppend("g")
@@ -735,7 +661,7 @@ public:
             })
             .attr({"dy": function(d) { return (-1 * (d.shift + 2)) + "px"; }});
 
-    }, svg->GetID(), deme->GetWidth(), deme->GetHeight());
+    }, svg->GetID(), deme_width, deme_height);
 
   }
 
@@ -746,6 +672,54 @@ public:
 
 namespace web = emp::web;
 
+#ifdef LSVIS_WORKER
+/// Hands evaluation requests (see deme/EvalRequest.h) off to a web worker (see EventDrivenGP-Roles-LSVis-worker.cc)
+/// so that the page stays responsive while they run. Worker responses are passed, line by line, to the
+/// request's line handler as they stream in; its done handler (if any) is called after the last line.
+class EvalWorker {
+public:
+  using line_fun_t = std::function<void(const std::string &)>;
+  using done_fun_t = std::function<void()>;
+
+protected:
+  struct Job {
+    line_fun_t on_line;
+    done_fun_t on_done;
+    Job(const line_fun_t & _on_line, const done_fun_t & _on_done) : on_line(_on_line), on_done(_on_done) { ; }
+  };
+
+  worker_handle worker;
+
+  static void OnResponse(char * data, int size, void * arg) {
+    emp::Ptr<Job> job(static_cast<Job*>(arg));
+    std::istringstream resp(std::string(data, (size_t)size));
+    std::string line;
+    bool done = false;
+    while (std::getline(resp, line)) {
+      if (line == "done") done = true;
+      else job->on_line(line);
+    }
+    if (!done) return;
+    if (job->on_done) job->on_done();
+    job.Delete();
+  }
+
+public:
+  EvalWorker(const std::string & url) : worker(emscripten_create_worker(url.c_str())) { ; }
+  ~EvalWorker() { emscripten_destroy_worker(worker); }
+
+  /// Call worker function fun_name (lsvis_worker_evaluate or lsvis_worker_landscape) on req.
+  void Call(const std::string & fun_name, const EvalRequest & req, const line_fun_t & on_line,
+            const done_fun_t & on_done=nullptr) {
+    std::stringstream req_str;
+    req.Write(req_str);
+    std::string data = req_str.str();
+    emp::Ptr<Job> job = emp::NewPtr<Job>(on_line, on_done);
+    emscripten_call_worker(worker, fun_name.c_str(), &data[0], (int)data.size(), OnResponse, job.Raw());
+  }
+};
+#endif
+
 class Application {
 private:
   emp::Ptr<emp::Random> random;
@@ -757,6 +731,15 @@ private:
   size_t deme_height;
   size_t deme_size;
   size_t deme_eval_time;
+  size_t inbox_capacity;
+  InboxPolicy inbox_policy;
+  TopologyType topology_type;
+  double topology_param;          // Rewire probability (small world) or degree (random regular).
+  size_t cell_ls_samples;         // Random k-cell knockout samples per cell landscape.
+  size_t cell_ls_k;
+  HardwareProfile hw_profile;
+  SeedSampling seed_sampling;     // Seeds for fitness estimates (Estimate).
+  ProgramOptLevel opt_level;      // How landscapes/estimates optimize programs (the run itself never does).
   size_t cur_time;
 
   // Interface-specific objects.
@@ -773,8 +756,25 @@ private:
   // Simulation/evaluation objects.
   emp::Ptr<Deme> eval_deme;
   emp::Ptr<Agent> eval_agent;
+  emp::Ptr<DemeProfiler> eval_profiler;
+  emp::Ptr<DemeTraceRecorder> eval_recorder;
+  DemeTrace replay_trace;
   emp::Ptr<Deme> landscape_deme;
   emp::Ptr<Agent> landscape_agent;
+  emp::Ptr<AgentPool> agent_pool;           // Owns eval_agent and landscape_agent.
+  emp::Ptr<ProgramOptimizer> program_optimizer;
+  OptimizeReport opt_report;                // Optimizing the current program (as of the last run).
+  emp::Ptr<emp::Random> landscape_random;   // Landscape deme's own (cell landscapes reseed it).
+  CellLandscape cell_landscape;
+  FitnessEstimate fitness_estimate;
+  int landscape_seed;                       // Mutational landscapes evaluate every mutant with this seed.
+  LandscapeCache landscape_cache;
+  LandscapeStore landscape_store;           // Landscapes worked out so far (the worker keeps its own).
+  LandscapeScheduler landscape_scheduler;   // Knockout landscape in progress (see StartLandscape).
+  emp::Ptr<program_t> landscape_prog;       // Program it's landscaping.
+  size_t landscape_run_gen;                 // Program vis landscape generation it's for.
+  StoredLandscape landscape_result;         // Its results so far (stored once complete).
+  SubstitutionMatrix mutation_matrix;
   emp::Ptr<event_lib_t> event_lib;
   emp::Ptr<inst_lib_t> inst_lib;
 
@@ -784,20 +784,11 @@ private:
     std::cout << "Successfully loaded program!" << std::endl;
   };
 
-  std::function<double(Deme*)> fit_fun =
-    [this](Deme * deme) {
-      if (deme == nullptr) { return 0.0; }
-      std::unordered_set<double> valid_uids;
-      double valid_id_cnt = 0;
-      for (size_t i = 0; i < deme->grid.size(); ++i) {
-        const double role_id = deme->grid[i]->GetTrait(TRAIT_ID__ROLE_ID);
-        if (role_id > 0 && role_id <= deme_size) {
-          ++valid_id_cnt; // Increment valid id cnt.
-          valid_uids.insert(role_id); // Add to set.
-        }
-      }
-      return (valid_id_cnt >= deme->grid.size()) ? (valid_id_cnt + (double)valid_uids.size()) : (valid_id_cnt);
-    };
+  std::function<double(Deme*)> fit_fun = [](Deme * deme) { return RoleIDFitness(deme); };
+
+#ifdef LSVIS_WORKER
+  emp::Ptr<EvalWorker> eval_worker;
+#endif
 
 public:
   Application()
@@ -810,8 +801,25 @@ public:
       anim([this]() { Application::Animate(anim); } ),
       eval_deme(),
       eval_agent(),
+      eval_profiler(),
+      eval_recorder(),
+      replay_trace(),
       landscape_deme(),
       landscape_agent(),
+      agent_pool(),
+      program_optimizer(),
+      opt_report(),
+      landscape_random(),
+      cell_landscape(),
+      fitness_estimate(),
+      landscape_seed(),
+      landscape_cache(),
+      landscape_store(),
+      landscape_scheduler(),
+      landscape_prog(),
+      landscape_run_gen(0),
+      landscape_result(),
+      mutation_matrix(),
       event_lib(),
       inst_lib()
   {
@@ -822,6 +830,15 @@ public:
     deme_height = DIST_SYS_HEIGHT;
     deme_size = deme_width * deme_height;
     deme_eval_time = EVAL_TIME;
+    inbox_capacity = DEFAULT_INBOX_CAPACITY;
+    inbox_policy = InboxPolicy::DROP_OLDEST;
+    topology_type = TopologyType::DEFAULT;
+    topology_param = 0.0;
+    cell_ls_samples = 20;
+    cell_ls_k = 2;
+    hw_profile = HardwareProfile::Default();
+    seed_sampling = SeedSampling(4, 64, 0.5);
+    opt_level = ProgramOptLevel::TIMING;
     cur_time = 0;
 
     // Create random number generator.
@@ -829,15 +846,29 @@ public:
     // Confiigure instruction set/event library.
     event_lib = emp::NewPtr<event_lib_t>(*emp::EventDrivenGP::DefaultEventLib());
     inst_lib = emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib());
-    inst_lib->AddInst("GetRoleID", Inst_GetRoleID, 1, "Local memory[Arg1] = Trait[RoleID]");
-    inst_lib->AddInst("SetRoleID", Inst_SetRoleID, 1, "Trait[RoleID] = Local memory[Arg1]");
-    inst_lib->AddInst("GetXLoc", Inst_GetXLoc, 1, "Local memory[Arg1] = Trait[XLoc]");
-    inst_lib->AddInst("GetYLoc", Inst_GetYLoc, 1, "Local memory[Arg1] = Trait[YLoc]");
-
-    // Configure evaluation deme.
-    eval_deme = emp::NewPtr<Deme>(random, deme_width, deme_height, event_lib, inst_lib);
+    AddRoleInstructions(*inst_lib);
+    agent_pool = emp::NewPtr<AgentPool>(inst_lib);
+    program_optimizer = emp::NewPtr<ProgramOptimizer>(*inst_lib);
+
+    // Configure evaluation deme (profiled; it only runs one update per frame).
+    eval_profiler = emp::NewPtr<DemeProfiler>(*inst_lib);
+    eval_deme = emp::NewPtr<Deme>(random, deme_width, deme_height, event_lib, eval_profiler->GetInstLib(), hw_profile);
+    eval_deme->SetProfiler(eval_profiler);
+    eval_recorder = emp::NewPtr<DemeTraceRecorder>();
+    eval_deme->SetTraceRecorder(eval_recorder);
+    eval_deme->SetInboxCapacity(inbox_capacity, inbox_policy);
+    program_vis.SetProfiler(eval_profiler);
     // Need a separate deme for landscaping.
-    landscape_deme = emp::NewPtr<Deme>(random, deme_width, deme_height, event_lib, inst_lib);
+    landscape_random = emp::NewPtr<emp::Random>(random->GetInt(1, 1000000));
+    landscape_seed = random->GetInt(1, 1000000);
+    landscape_deme = emp::NewPtr<Deme>(landscape_random, deme_width, deme_height, event_lib, inst_lib, hw_profile);
+    landscape_deme->SetInboxCapacity(inbox_capacity, inbox_policy);
+    landscape_deme->SetOptLevel(opt_level);
+    // Both demes (and landscape workers) share one topology.
+    Topology topology = BuildTopology(topology_type, deme_width, deme_height, *random, topology_param);
+    if (!topology.GetSize()) topology = Topology::Default(deme_width, deme_height); // Bad parameter.
+    eval_deme->SetTopology(topology);
+    landscape_deme->SetTopology(topology);
 
     // Add program visualization to page.
     program_vis_doc << program_vis;
@@ -847,15 +878,40 @@ public:
     emp::JSWrap([this]() { this->RunCurProgram(); }, "run_program");
     emp::JSWrap([this]() { this->DoReset(); }, "reset_application");
     emp::JSWrap([this]() { this->DoLandscape(); }, "landscape_program");
+    emp::JSWrap([this]() { this->DoCellLandscape(); }, "landscape_cells");
+    emp::JSWrap([this]() { this->DoMutationLandscape(); }, "landscape_mutations");
+    emp::JSWrap([this]() { this->DoEstimateFitness(); }, "estimate_fitness");
+    emp::JSWrap([this]() { this->DoExportMutations(); }, "export_mutations");
+    emp::JSWrap([this]() { this->DoExportProfile(true); }, "export_profile_json");
+    emp::JSWrap([this]() { this->DoExportProfile(false); }, "export_profile_csv");
     emp::JSWrap(read_prog_from_str, "read_prog_from_str");
+    emp::JSWrap([this]() { this->DoExportTrace(); }, "export_trace");
+    emp::JSWrap([this]() { this->DoReplayRun(); }, "replay_run");
+    emp::JSWrap([this](size_t gen) { this->LandscapeStep(gen); }, "landscape_step");
+    emp::JSWrap([this](std::string hex) { this->DoLoadTrace(hex); }, "load_trace_hex");
+    emp::JSWrap([this](int update) { this->deme_vis.DrawTrace(this->replay_trace, (size_t)std::max(update, 0)); }, "scrub_trace");
 
     vis_dash  << "<div class='row'>"
                 << "<div class='col'>"
                   << "<div class='btn-group' role='group'>"
                     << "<button id='run_program_button' onclick='emp.run_program()' class='btn btn-primary'>Run</button>"
                     << "<button id='landscape_button' onclick='emp.landscape_program()' class='btn btn-primary'>Landscape</button>"
+                    << "<button id='landscape_cells_button' onclick='emp.landscape_cells()' class='btn btn-primary'>Cell Landscape</button>"
+                    << "<button id='landscape_mutations_button' onclick='emp.landscape_mutations()' class='btn btn-primary'>Mutations</button>"
+                    << "<button id='estimate_fitness_button' onclick='emp.estimate_fitness()' class='btn btn-primary'>Estimate</button>"
                     << "<button id='reset_button' onclick='emp.reset_application()' class='btn btn-primary'>Reset</button>"
                   << "</div>"
+                  << "<div class='btn-group' role='group'>"
+                    << "<button id='export_profile_json_button' onclick='emp.export_profile_json()' class='btn btn-secondary'>Profile (JSON)</button>"
+                    << "<button id='export_profile_csv_button' onclick='emp.export_profile_csv()' class='btn btn-secondary'>Profile (CSV)</button>"
+                    << "<button id='export_mutations_button' onclick='emp.export_mutations()' class='btn btn-secondary'>Mutations (Matrix)</button>"
+                  << "</div>"
+                  << "<div class='btn-group' role='group'>"
+                    << "<button id='export_trace_button' onclick='emp.export_trace()' class='btn btn-secondary'>Save Trace</button>"
+                    << "<button id='replay_run_button' onclick='emp.replay_run()' class='btn btn-secondary'>Replay Run</button>"
+                    << "<label class='btn btn-secondary'>Open Trace <input type='file' accept='.trace' onchange='readTraceFile(this.files[0])' hidden></label>"
+                  << "</div>"
+                  << "<input id='trace_scrubber' type='range' min='0' max='0' value='0' oninput='emp.scrub_trace(parseInt(this.value))'>"
                 << "</div>"
               << "</div>"
               << "<div class='row justify-content-center pad-top-row'>"
@@ -865,6 +921,30 @@ public:
                 << "<div class='col'>"
                   << "<h3>Fitness: <span class=\"badge badge-default\">" << web::Live([this]() { return this->fit_fun(eval_deme); }) << "</span></h3>"
                 << "</div>"
+                << "<div class='col'>"
+                  << "<h3>Estimate: <span class=\"badge badge-default\">"
+                    << web::Live([this]() { return this->fitness_estimate.mean; }) << " &plusmn; "
+                    << web::Live([this]() { return this->fitness_estimate.half_width; }) << " ("
+                    << web::Live([this]() { return this->fitness_estimate.seeds; }) << " seeds)</span></h3>"
+                << "</div>"
+                << "<div class='col'>"
+                  << "<h3>Dropped/Coalesced: <span class=\"badge badge-default\">"
+                    << web::Live([this]() { return this->eval_deme->GetDroppedCount(); }) << "/"
+                    << web::Live([this]() { return this->eval_deme->GetCoalescedCount(); }) << "</span></h3>"
+                << "</div>"
+                << "<div class='col'>"
+                  << "<h3>Work/Pass: <span class=\"badge badge-default\">"
+                    << web::Live([this]() { return this->opt_report.work_before; }) << " &rarr; "
+                    << web::Live([this]() { return this->opt_report.work_after; }) << "</span></h3>"
+                << "</div>"
+                << "<div class='col'>"
+                  << "<h3>Bytes/Cell: <span class=\"badge badge-default\">"
+                    << web::Live([this]() { return (size_t)this->eval_deme->GetFootprint().GetBytesPerCell(); }) << "</span></h3>"
+                << "</div>"
+                << "<div class='col'>"
+                  << "<h3>" << cell_ls_k << "-Cell KO: <span class=\"badge badge-default\">"
+                    << web::Live([this]() { return this->cell_landscape.GetRelativeFitness(this->cell_landscape.GetMeanSampleFitness()); }) << "</span></h3>"
+                << "</div>"
               << "</div>";
     // Some interface setup.
     // EM_ASM({
@@ -922,20 +1002,13 @@ public:
     prog2.PushInst("SetRoleID", 0);
     DoAddProgram("Test2", prog2);
 
-    program_vis.SetEvalProgramFun([this](emp::Ptr<program_t> prog_ptr) {
-      // 1) Load program into deme.
-      if (landscape_agent) landscape_agent.Delete();
-      landscape_agent = emp::NewPtr<Agent>(*prog_ptr);
-      this->landscape_deme->LoadAgent(landscape_agent);
-      //  - Configure landscape deme knockouts:
-      this->landscape_deme->knockouts = this->eval_deme->knockouts;
-      // 2) Run deme.
-      for (size_t ls_time = 0; ls_time < EVAL_TIME; ++ls_time) {
-        this->landscape_deme->SingleAdvance();
-      }
-      // 3) Evaluate deme fitness.
-      return this->fit_fun(this->landscape_deme);
-    });
+#ifdef LSVIS_WORKER
+    // Landscape on a worker so that the page doesn't lock up.
+    eval_worker = emp::NewPtr<EvalWorker>("js/EventDrivenGP-Roles-LSVis-worker.js");
+#endif
+    program_vis.SetLandscapeProgramFun([this](emp::Ptr<program_t> prog_ptr, size_t gen) { StartLandscape(*prog_ptr, gen); });
+    // Knocking deme cells out (or back in) changes what a landscape in progress is landscaping.
+    deme_vis.SetKnockoutFun([this]() { program_vis.CancelLandscape(); });
     // Start the visualization.
     program_vis.Start("Test");
     program_vis.On("resize", [this]() { std::cout << "On program vis resize!" << std::endl; });
@@ -952,6 +1025,8 @@ public:
 
     eval_deme->knockouts.clear();
     eval_deme->Reset();
+    eval_profiler->Clear();
+    program_vis.DrawProfile();
     deme_vis.DrawDeme(eval_deme);
 
     vis_dash.Redraw();
@@ -960,6 +1035,7 @@ public:
   void DoFinishEval() {
     std::cout << "Finish eval" << std::endl;
     anim.Stop();
+    program_vis.DrawProfile();
     // eval_deme->Print();
   }
 
@@ -971,6 +1047,7 @@ public:
     }
     eval_deme->SingleAdvance();
     ++cur_time;
+    program_vis.DrawProfile();
     vis_dash.Redraw();
     deme_vis.DrawDeme(eval_deme);
   }
@@ -985,21 +1062,314 @@ public:
       std::cout << "Warning! Empty program!" << std::endl;
       return;
     }
+    program_optimizer->Optimize(*cur_prog, opt_level, &opt_report);
     // Configure eval agent.
-    if (eval_agent) eval_agent.Delete();
-    eval_agent = emp::NewPtr<Agent>(*cur_prog);
+    if (eval_agent) agent_pool->Release(eval_agent);
+    eval_agent = agent_pool->Acquire(*cur_prog);
     cur_time = 0;
-    // Load eval agent into deme.
+    // Load eval agent into deme (profiling this run only).
+    eval_profiler->Clear();
     eval_deme->LoadAgent(eval_agent);
     // Evaluate deme.
     anim.Start();
   }
 
+  /// Point landscape_agent at (a pooled agent holding) prog.
+  emp::Ptr<Agent> SetLandscapeAgent(const program_t & prog) {
+    if (landscape_agent) agent_pool->Release(landscape_agent);
+    landscape_agent = agent_pool->Acquire(prog);
+    return landscape_agent;
+  }
+
   void DoLandscape() {
     std::cout << "Landscape cur program (and deme, etc)!" << std::endl;
     program_vis.Landscape();
   }
 
+  /// Start a knockout landscape of prog for program vis landscape generation gen. Positions are evaluated
+  /// a chunk at a time (see LandscapeScheduler): the base program, then what's on screen, then the rest by
+  /// how often it ran in the last run; results are drawn after each chunk. Changing the program or any
+  /// knockouts moves program vis on to a new generation, which cancels the rest. Landscapes use a fixed
+  /// seed, so programs landscaped before come straight from the store.
+  void StartLandscape(const program_t & prog, size_t gen) {
+    landscape_scheduler.Cancel();
+    if (landscape_prog) landscape_prog.Delete();
+    landscape_prog = emp::NewPtr<program_t>(prog);
+    landscape_run_gen = gen;
+    landscape_result = StoredLandscape(LandscapeCache::Hash(prog), RequestContextHash(MakeEvalRequest(prog)),
+                                       LandscapeKind::KNOCKOUT, landscape_seed);
+    StoredLandscape stored;
+    if (landscape_store.Find(landscape_result.prog_hash, landscape_result.context_hash, LandscapeKind::KNOCKOUT,
+                             landscape_seed, stored)) {
+      for (size_t i = 0; i < stored.GetSize(); ++i) program_vis.AddLandscapeVal(gen, stored.fIDs[i], stored.iIDs[i], stored.fitness[i]);
+      return;
+    }
+    landscape_scheduler.Start(prog, [this](int fID, int iID) {
+      return (double)eval_profiler->GetPositionCount((size_t)fID, (size_t)iID);
+    });
+    LandscapeStep(gen);
+  }
+
+  /// Evaluate the next chunk of the landscape in progress (if it's still wanted).
+  void LandscapeStep(size_t gen) {
+    if (gen != landscape_run_gen || gen != program_vis.GetLandscapeGen()) { landscape_scheduler.Cancel(); return; }
+    landscape_scheduler.Prioritize(program_vis.GetVisiblePositions());
+    const emp::vector<std::pair<int, int>> chunk = landscape_scheduler.NextChunk();
+    if (chunk.empty()) return;
+    auto add_result = [this, gen](int fID, int iID, double fitness) {
+      if (program_vis.AddLandscapeVal(gen, fID, iID, fitness)) landscape_result.Add(fID, iID, 0, fitness);
+    };
+#ifdef LSVIS_WORKER
+    EvalRequest req = MakeEvalRequest(*landscape_prog);
+    req.seed = landscape_seed;
+    req.positions = chunk;
+    eval_worker->Call("lsvis_worker_landscape", req, [add_result](const std::string & line) {
+      std::istringstream resp(line);
+      std::string kind;
+      int fID, iID;
+      double fitness;
+      resp >> kind;
+      if (kind != "ls") { std::cout << "Landscape worker: " << line << std::endl; return; }
+      resp >> fID >> iID >> fitness;
+      add_result(fID, iID, fitness);
+    }, [this, gen, chunk]() { FinishLandscapeChunk(gen, chunk.size()); });
+#else
+    emp::Random ls_random(landscape_seed);
+    landscape_deme->knockouts = eval_deme->knockouts;
+    KnockoutLandscape(*landscape_prog, {landscape_deme}, [this](Deme & deme, const program_t & prog) {
+      return EvaluateAgent(deme, SetLandscapeAgent(prog), deme_eval_time);
+    }, ls_random, add_result, nullptr, chunk);
+    FinishLandscapeChunk(gen, chunk.size());
+#endif
+  }
+
+  void FinishLandscapeChunk(size_t gen, size_t chunk_size) {
+    if (gen != program_vis.GetLandscapeGen()) return;
+    landscape_scheduler.Done(chunk_size);
+    program_vis.DrawLandscape();
+    if (landscape_scheduler.IsDone()) { landscape_store.Append(landscape_result); return; }
+    // Give the page a chance to draw (and the user a chance to change things) before the next chunk.
+    EM_ASM_ARGS({ setTimeout(function() { emp.landscape_step($0); }, 0); }, gen);
+  }
+
+  /// Estimate the current program's fitness over seeds (as seed_sampling says), updating the estimate
+  /// (mean, 95% confidence interval, seeds used) as it goes.
+  void DoEstimateFitness() {
+    std::cout << "Estimate fitness!" << std::endl;
+    if (anim.GetActive()) anim.Stop();
+    program_vis.BuildCurProgram();
+    emp::Ptr<program_t> cur_prog = program_vis.GetCurProgram();
+    if (cur_prog->GetSize() == 0) {
+      std::cout << "Warning! Empty program!" << std::endl;
+      return;
+    }
+    fitness_estimate = FitnessEstimate();
+#ifdef LSVIS_WORKER
+    EvalRequest req = MakeEvalRequest(*cur_prog);
+    req.sampling = seed_sampling;
+    eval_worker->Call("lsvis_worker_evaluate", req, [this](const std::string & line) {
+      std::istringstream resp(line);
+      std::string kind;
+      resp >> kind;
+      if (kind != "estimate") return;
+      resp >> fitness_estimate.mean >> fitness_estimate.half_width >> fitness_estimate.seeds;
+      vis_dash.Redraw();
+    });
+#else
+    SetLandscapeAgent(*cur_prog);
+    fitness_estimate = EstimateFitness({landscape_deme}, [this](Deme & deme) {
+      return EvaluateAgent(deme, landscape_agent, deme_eval_time);
+    }, random->GetInt(1, 1000000), seed_sampling);
+    vis_dash.Redraw();
+#endif
+  }
+
+  /// Request to evaluate prog the way the app would (deme settings, knockouts, etc.).
+  EvalRequest MakeEvalRequest(const program_t & prog) {
+    EvalRequest req;
+    req.seed = random->GetInt(1000000);
+    req.width = deme_width;
+    req.height = deme_height;
+    req.eval_time = deme_eval_time;
+    req.knockouts = eval_deme->knockouts;
+    req.inbox_capacity = inbox_capacity;
+    req.inbox_policy = inbox_policy;
+    req.topology = eval_deme->GetTopology();
+    req.cell_samples = cell_ls_samples;
+    req.cell_sample_k = cell_ls_k;
+    req.hw_profile = hw_profile;
+    req.opt_level = opt_level;
+    std::stringstream prog_str;
+    WriteProgram(prog, prog_str);
+    req.program = prog_str.str();
+    return req;
+  }
+
+  /// Evaluate every single-point mutation of the current program (see SubstitutionLandscape), showing the
+  /// mean/min/max effect of mutating each position.
+  void DoMutationLandscape() {
+    std::cout << "Mutational landscape!" << std::endl;
+    if (anim.GetActive()) anim.Stop();
+    program_vis.BuildCurProgram();
+    emp::Ptr<program_t> cur_prog = program_vis.GetCurProgram();
+    if (cur_prog->GetSize() == 0) {
+      std::cout << "Warning! Empty program!" << std::endl;
+      return;
+    }
+    EvalRequest req = MakeEvalRequest(*cur_prog);
+    req.seed = landscape_seed;
+    const size_t gen = program_vis.GetLandscapeGen();
+#ifdef LSVIS_WORKER
+    eval_worker->Call("lsvis_worker_mutation_landscape", req, [this, gen](const std::string & line) {
+      std::istringstream resp(line);
+      std::string kind, hex;
+      resp >> kind >> hex;
+      if (kind != "matrix") { std::cout << "Mutational landscape worker: " << line << std::endl; return; }
+      std::string bytes;
+      if (!HexToBytes(hex, bytes)) { std::cout << "Mutational landscape worker: bad matrix" << std::endl; return; }
+      std::istringstream matrix_in(bytes);
+      if (!mutation_matrix.Read(matrix_in)) return;
+      if (program_vis.SetMutationLandscape(gen, mutation_matrix)) program_vis.DrawMutationLandscape();
+    });
+#else
+    const uint64_t prog_hash = LandscapeCache::Hash(*cur_prog);
+    const uint64_t context_hash = RequestContextHash(req);
+    StoredLandscape stored;
+    if (landscape_store.Find(prog_hash, context_hash, LandscapeKind::SUBSTITUTION, landscape_seed, stored)) {
+      mutation_matrix = LoadMatrix(stored, *cur_prog);
+    } else {
+      req.program = "";
+      std::stringstream context;
+      req.Write(context);
+      landscape_cache.SetContext(context.str());
+      mutation_matrix = SubstitutionLandscape(*cur_prog, {landscape_deme}, [this](Deme & deme, const program_t & prog) {
+        return EvaluateAgent(deme, SetLandscapeAgent(prog), deme_eval_time);
+      }, landscape_seed, landscape_cache);
+      std::cout << "Mutants cached: " << landscape_cache.GetSize() << " (hits: " << landscape_cache.GetHits() << ")" << std::endl;
+      landscape_store.Append(StoreMatrix(mutation_matrix, prog_hash, context_hash, landscape_seed));
+    }
+    if (program_vis.SetMutationLandscape(gen, mutation_matrix)) program_vis.DrawMutationLandscape();
+#endif
+  }
+
+  /// Download the last mutational landscape (see SubstitutionMatrix for the format).
+  void DoExportMutations() {
+    std::stringstream matrix_out;
+    mutation_matrix.Write(matrix_out);
+    const std::string bytes = matrix_out.str();
+    EM_ASM_ARGS({
+      downloadBytes(HEAPU8.slice($0, $0 + $1), "mutations.lssm");
+    }, bytes.data(), bytes.size());
+  }
+
+  /// Decode hex (two digits a byte, as lib.js sends binary files) into bytes; false (bytes left empty) if it isn't hex.
+  static bool HexToBytes(const std::string & hex, std::string & bytes) {
+    auto digit = [](char c) {
+      if (c >= '0' && c <= '9') return c - '0';
+      if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+      if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+      return -1;
+    };
+    bytes.clear();
+    if (hex.size() % 2) return false;
+    bytes.resize(hex.size() / 2);
+    for (size_t i = 0; i < bytes.size(); ++i) {
+      const int hi = digit(hex[2 * i]);
+      const int lo = digit(hex[2 * i + 1]);
+      if (hi < 0 || lo < 0) { bytes.clear(); return false; }
+      bytes[i] = (char)(hi * 16 + lo);
+    }
+    return true;
+  }
+
+  /// Landscape the deme: knock out each cell (and random sets of cell_ls_k cells), shading the deme by
+  /// how much each cell matters to the current program's fitness.
+  void DoCellLandscape() {
+    std::cout << "Landscape deme cells!" << std::endl;
+    if (anim.GetActive()) anim.Stop();
+    program_vis.BuildCurProgram();
+    emp::Ptr<program_t> cur_prog = program_vis.GetCurProgram();
+    if (cur_prog->GetSize() == 0) {
+      std::cout << "Warning! Empty program!" << std::endl;
+      return;
+    }
+    deme_vis.DrawDeme(eval_deme);
+    cell_landscape = CellLandscape(deme_size);
+#ifdef LSVIS_WORKER
+    eval_worker->Call("lsvis_worker_cell_landscape", MakeEvalRequest(*cur_prog), [this](const std::string & line) {
+      std::istringstream resp(line);
+      std::string kind;
+      double fitness;
+      resp >> kind;
+      if (kind == "cell") {
+        int id;
+        resp >> id >> fitness;
+        if (id < 0) cell_landscape.base_fitness = fitness;
+        else if ((size_t)id < cell_landscape.cell_fitness.size()) cell_landscape.cell_fitness[(size_t)id] = fitness;
+      } else if (kind == "sample") {
+        resp >> fitness;
+        cell_landscape.samples.emplace_back();
+        size_t id;
+        while (resp >> id) cell_landscape.samples.back().emplace_back(id);
+        cell_landscape.sample_fitness.emplace_back(fitness);
+      } else {
+        std::cout << "Cell landscape worker: " << line << std::endl;
+        return;
+      }
+      deme_vis.DrawCellLandscape(cell_landscape);
+      vis_dash.Redraw();
+    });
+#else
+    SetLandscapeAgent(*cur_prog);
+    cell_landscape = CellKnockoutLandscape({landscape_deme}, eval_deme->knockouts, [this](Deme & deme) {
+      return EvaluateAgent(deme, landscape_agent, deme_eval_time);
+    }, *random, cell_ls_samples, cell_ls_k);
+    deme_vis.DrawCellLandscape(cell_landscape);
+    vis_dash.Redraw();
+#endif
+  }
+
+  /// Download trace of the last run (open it again with 'Open Trace').
+  void DoExportTrace() {
+    const auto & bytes = eval_recorder->GetBytes();
+    EM_ASM_ARGS({
+      downloadBytes(HEAPU8.slice($0, $0 + $1), "deme.trace");
+    }, bytes.data(), bytes.size());
+  }
+
+  /// Scrub through the last run.
+  void DoReplayRun() {
+    const auto & bytes = eval_recorder->GetBytes();
+    if (!replay_trace.Read(bytes.data(), bytes.size())) { std::cout << "Nothing to replay yet!" << std::endl; return; }
+    StartReplay();
+  }
+
+  /// Load a trace file (hex-encoded by readTraceFile in lib.js) for scrubbing.
+  void DoLoadTrace(const std::string & hex) {
+    std::string bytes;
+    if (!HexToBytes(hex, bytes) || !replay_trace.Read((const uint8_t *)bytes.data(), bytes.size())) {
+      std::cout << "Not a deme trace!" << std::endl;
+      return;
+    }
+    StartReplay();
+  }
+
+  void StartReplay() {
+    if (anim.GetActive()) anim.Stop();
+    EM_ASM_ARGS({ $("#trace_scrubber").attr({"max": $0}).val(0); }, replay_trace.GetNumUpdates());
+    deme_vis.DrawTrace(replay_trace, 0);
+  }
+
+  /// Download profile of the last run.
+  void DoExportProfile(bool json) {
+    std::stringstream profile;
+    if (json) eval_profiler->WriteJSON(profile);
+    else eval_profiler->WriteCSV(profile);
+    EM_ASM_ARGS({
+      downloadText(Pointer_stringify($0), Pointer_stringify($1), Pointer_stringify($2));
+    }, profile.str().c_str(), json ? "profile.json" : "profile.csv", json ? "application/json" : "text/csv");
+  }
+
   void DoAddProgram(const std::string & _name, const program_t & _program) {
     program_vis.AddProgram(_name, _program);
     // Update dropdown menu.
@@ -1009,68 +1379,11 @@ public:
     }, _name.c_str());
   }
 
-  /// Here's a horrible, inefficient, and unforgiving load program function that definitely does not fail gracefully.
   void LoadProgram(std::string prog_name, std::istream & input) {
-    program_t prog(inst_lib);
-    std::string cur_line;
-    emp::vector<std::string> line_components;
-
-    while (!input.eof()) {
-      std::getline(input, cur_line);
-      emp::left_justify(cur_line); // Clear out leading whitespace.
-
-      if (cur_line == "") continue; // Skip empty lines.
-
-      //std::string command = emp::string_pop_word(cur_line);
-      emp::slice(cur_line, line_components, '-');
-      if (line_components[0] == "Fn") {
-        line_components.resize(0);
-        emp::slice(cur_line, line_components, ' ');
-        std::string aff_str = line_components[1];
-        // Extract function affinity.
-        affinity_t fun_aff;
-        for (size_t i = 0; i < aff_str.size(); ++i) {
-          if (i >= fun_aff.GetSize()) break;
-          if (aff_str[i] == '1') fun_aff.Set(fun_aff.GetSize() - i - 1, true);
-        }
-        // Push a new function onto the program.
-        prog.PushFunction(fun_t(fun_aff));
-      } else {
-        line_components.resize(0);
-        emp::slice(cur_line, line_components, ' ');
-        std::string inst_name = line_components[0];
-        size_t inst_id = inst_lib->GetID(inst_name);
-        bool has_affinity = inst_lib->HasProperty(inst_id, "affinity");
-        int arg = 1;
-        affinity_t inst_aff;
-        if (has_affinity) {
-          std::string aff_str = line_components[1];
-          ++arg;
-          for (size_t i = 0; i < aff_str.size(); ++i) {
-            if (i >= inst_aff.GetSize()) break;
-            if (aff_str[i] == '1') inst_aff.Set(inst_aff.GetSize() - i - 1, true);
-          }
-        }
-        int arg0 = 0;
-        int arg1 = 0;
-        int arg2 = 0;
-        if (arg < line_components.size()) {
-          arg0 = std::stoi(line_components[arg]); ++arg;
-        }
-        if (arg < line_components.size()) {
-          arg1 = std::stoi(line_components[arg]); ++arg;
-        }
-        if (arg < line_components.size()) {
-          arg2 = std::stoi(line_components[arg]); ++arg;
-        }
-        prog.PushInst(inst_id, arg0, arg1, arg2, inst_aff);
-      }
-
-    }
+    program_t prog = ::LoadProgram(input, inst_lib);
     std::cout << "Look, mah! Here's the program I made: " << std::endl;
     prog.PrintProgram();
     DoAddProgram(prog_name, prog);
-    //return prog;
   }
 
 };
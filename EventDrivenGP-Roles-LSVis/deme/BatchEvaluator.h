@@ -0,0 +1,309 @@
+/*
+  deme/BatchEvaluator.h
+*/
+
+#ifndef LSVIS_BATCH_EVALUATOR_H
+#define LSVIS_BATCH_EVALUATOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_set>
+#include "base/Ptr.h"
+#include "base/vector.h"
+#include "tools/Random.h"
+
+#include "Deme.h"
+
+/// Evaluates many programs at once, stepping a deme's worth of cells for each (a lane per program) in
+/// lock-step. Lane state is kept as structure of arrays (register r of every cell of every lane is
+/// contiguous), and each update decodes an instruction once for every run of lanes that share it.
+///
+/// Only straight-line role programs batch (see CanBatch): the main function (function 0, the only one a
+/// cell runs unless something calls, forks or messages) uses only register and role-task instructions with
+/// arguments in [0, CPU_SIZE). Such programs never branch, call, message or use randomness, so every cell
+/// runs its main function one instruction per update, independently of the others and of the deme's seed.
+/// What the hardware does once a main function runs off its end is up to the hardware, so Configure
+/// calibrates it against probe programs on a real deme of the configured size (again whenever the size
+/// changes); if no known behavior matches, nothing batches. Results are still only as good as the
+/// calibration, so callers should check some against a deme (see RunProgramJobs in Landscape.h).
+class BatchEvaluator {
+public:
+  enum class BatchOp : uint8_t {
+    UNSUPPORTED, NOP, INC, DEC, NOT, ADD, SUB, MULT, TEST_EQU, TEST_NEQU, TEST_LESS,
+    SET_MEM, COPY_MEM, SWAP_MEM, GET_ROLE_ID, SET_ROLE_ID, GET_X_LOC, GET_Y_LOC
+  };
+
+  /// What a cell does after the last instruction of its main function.
+  struct MainEnd {
+    bool restarts;      // Otherwise, the cell idles from then on.
+    size_t gap;         // Updates between running the last instruction and restarting.
+    bool keeps_memory;  // Restarted main function keeps its local memory.
+  };
+
+  static constexpr size_t MAX_BATCH_ELEMENTS = 1 << 16;  // Lanes * cells per pass (bounds lane state).
+
+protected:
+  emp::vector<BatchOp> ops;           // By instruction id.
+  size_t width;
+  size_t height;
+  size_t eval_time;
+  emp::vector<uint8_t> alive;         // By cell (0 => knocked out).
+  emp::vector<double> x_loc;
+  emp::vector<double> y_loc;
+  size_t calibrated_width;            // Deme size calibrated for (0 x 0 => not calibrated).
+  size_t calibrated_height;
+  bool enabled;
+  MainEnd main_end;
+  size_t batched_cnt;
+
+  // Lane state: element lane * cells + cell of each array.
+  size_t num_elements;
+  emp::vector<double> regs;           // CPU_SIZE arrays, back to back.
+  emp::vector<double> role_ids;
+
+  static BatchOp GetOp(const std::string & name) {
+    if (name == "Nop") return BatchOp::NOP;
+    if (name == "Inc") return BatchOp::INC;
+    if (name == "Dec") return BatchOp::DEC;
+    if (name == "Not") return BatchOp::NOT;
+    if (name == "Add") return BatchOp::ADD;
+    if (name == "Sub") return BatchOp::SUB;
+    if (name == "Mult") return BatchOp::MULT;
+    if (name == "TestEqu") return BatchOp::TEST_EQU;
+    if (name == "TestNEqu") return BatchOp::TEST_NEQU;
+    if (name == "TestLess") return BatchOp::TEST_LESS;
+    if (name == "SetMem") return BatchOp::SET_MEM;
+    if (name == "CopyMem") return BatchOp::COPY_MEM;
+    if (name == "SwapMem") return BatchOp::SWAP_MEM;
+    if (name == "GetRoleID") return BatchOp::GET_ROLE_ID;
+    if (name == "SetRoleID") return BatchOp::SET_ROLE_ID;
+    if (name == "GetXLoc") return BatchOp::GET_X_LOC;
+    if (name == "GetYLoc") return BatchOp::GET_Y_LOC;
+    return BatchOp::UNSUPPORTED;
+  }
+
+  /// Instruction a lane with main function inst_seq runs at update t (nullptr if none); restarting is set
+  /// if the main function starts over at t.
+  const inst_t * GetInst(const emp::vector<inst_t> & inst_seq, size_t t, bool & restarting) const {
+    restarting = false;
+    if (t < inst_seq.size()) return &inst_seq[t];
+    if (!main_end.restarts) return nullptr;
+    const size_t period = inst_seq.size() + main_end.gap;
+    const size_t pos = t % period;
+    restarting = (pos == 0);
+    return pos < inst_seq.size() ? &inst_seq[pos] : nullptr;
+  }
+
+  /// Run inst on lanes [lane_begin, lane_end).
+  void Apply(const inst_t & inst, size_t lane_begin, size_t lane_end) {
+    const size_t num_cells = alive.size();
+    const size_t begin = lane_begin * num_cells;
+    const size_t end = lane_end * num_cells;
+    double * arg0 = &regs[(size_t)inst.args[0] * num_elements];
+    double * arg1 = &regs[(size_t)inst.args[1] * num_elements];
+    double * arg2 = &regs[(size_t)inst.args[2] * num_elements];
+    double * roles = role_ids.data();
+    switch (ops[inst.id]) {
+      case BatchOp::NOP: break;
+      case BatchOp::INC: for (size_t i = begin; i < end; ++i) arg0[i] += 1.0; break;
+      case BatchOp::DEC: for (size_t i = begin; i < end; ++i) arg0[i] -= 1.0; break;
+      case BatchOp::NOT: for (size_t i = begin; i < end; ++i) arg0[i] = (arg0[i] == 0.0); break;
+      case BatchOp::ADD: for (size_t i = begin; i < end; ++i) arg2[i] = arg0[i] + arg1[i]; break;
+      case BatchOp::SUB: for (size_t i = begin; i < end; ++i) arg2[i] = arg0[i] - arg1[i]; break;
+      case BatchOp::MULT: for (size_t i = begin; i < end; ++i) arg2[i] = arg0[i] * arg1[i]; break;
+      case BatchOp::TEST_EQU: for (size_t i = begin; i < end; ++i) arg2[i] = (arg0[i] == arg1[i]); break;
+      case BatchOp::TEST_NEQU: for (size_t i = begin; i < end; ++i) arg2[i] = (arg0[i] != arg1[i]); break;
+      case BatchOp::TEST_LESS: for (size_t i = begin; i < end; ++i) arg2[i] = (arg0[i] < arg1[i]); break;
+      case BatchOp::SET_MEM: std::fill(arg0 + begin, arg0 + end, (double)inst.args[1]); break;
+      case BatchOp::COPY_MEM: for (size_t i = begin; i < end; ++i) arg1[i] = arg0[i]; break;
+      case BatchOp::SWAP_MEM: for (size_t i = begin; i < end; ++i) std::swap(arg0[i], arg1[i]); break;
+      case BatchOp::GET_ROLE_ID: for (size_t i = begin; i < end; ++i) arg0[i] = roles[i]; break;
+      case BatchOp::SET_ROLE_ID:
+        for (size_t lane = lane_begin; lane < lane_end; ++lane) {
+          double * lane_arg0 = arg0 + lane * num_cells;
+          double * lane_roles = roles + lane * num_cells;
+          for (size_t c = 0; c < num_cells; ++c) if (alive[c]) lane_roles[c] = (double)(int)lane_arg0[c];
+        }
+        break;
+      case BatchOp::GET_X_LOC:
+      case BatchOp::GET_Y_LOC: {
+        const double * loc = (ops[inst.id] == BatchOp::GET_X_LOC) ? x_loc.data() : y_loc.data();
+        for (size_t lane = lane_begin; lane < lane_end; ++lane) std::copy(loc, loc + num_cells, arg0 + lane * num_cells);
+        break;
+      }
+      case BatchOp::UNSUPPORTED: emp_assert(false); break;
+    }
+  }
+
+  /// Run mains (main function of each lane) for eval_time updates, leaving role IDs in role_ids.
+  void Run(const emp::vector<const emp::vector<inst_t> *> & mains) {
+    const size_t num_cells = alive.size();
+    const size_t num_lanes = mains.size();
+    num_elements = num_lanes * num_cells;
+    regs.assign(CPU_SIZE * num_elements, 0.0);
+    role_ids.assign(num_elements, 0.0);
+    emp::vector<const inst_t *> lane_insts(num_lanes);
+    for (size_t t = 0; t < eval_time; ++t) {
+      for (size_t lane = 0; lane < num_lanes; ++lane) {
+        bool restarting = false;
+        lane_insts[lane] = GetInst(*mains[lane], t, restarting);
+        if (restarting && !main_end.keeps_memory) {
+          for (size_t r = 0; r < CPU_SIZE; ++r) {
+            double * reg = &regs[r * num_elements + lane * num_cells];
+            std::fill(reg, reg + num_cells, 0.0);
+          }
+        }
+      }
+      // Lanes running the same instruction go together.
+      for (size_t lane = 0; lane < num_lanes; ) {
+        const inst_t * inst = lane_insts[lane];
+        size_t span_end = lane + 1;
+        while (span_end < num_lanes && SameInst(inst, lane_insts[span_end])) ++span_end;
+        if (inst) Apply(*inst, lane, span_end);
+        lane = span_end;
+      }
+    }
+  }
+
+  static bool SameInst(const inst_t * a, const inst_t * b) {
+    if (a == b) return true;
+    if (!a || !b) return false;
+    return a->id == b->id && a->args == b->args;
+  }
+
+  /// Role-ID fitness of lane's deme (see RoleIDFitness).
+  double GetLaneFitness(size_t lane) const {
+    const size_t num_cells = alive.size();
+    emp::vector<uint8_t> seen(num_cells + 1, 0);
+    size_t valid_cnt = 0;
+    size_t unique_cnt = 0;
+    for (size_t c = 0; c < num_cells; ++c) {
+      const double id = role_ids[lane * num_cells + c];
+      if (id <= 0 || id > (double)num_cells) continue;
+      ++valid_cnt;
+      if (!seen[(size_t)id]++) ++unique_cnt;
+    }
+    if (valid_cnt < num_cells) return (double)valid_cnt;
+    return (double)(valid_cnt + unique_cnt);
+  }
+
+  /// Work out what main functions do when they end by running probe programs on a deme like deme (size,
+  /// knockouts, hardware) and checking which MainEnd reproduces the role IDs they set after each update.
+  void Calibrate(Deme & deme) {
+    calibrated_width = width;
+    calibrated_height = height;
+    enabled = false;
+    const size_t probe_time = 12;
+    emp::vector<program_t> probes;
+    for (bool get_role_id : {false, true}) {
+      probes.emplace_back(deme.inst_lib);
+      probes.back().PushFunction(fun_t());
+      if (get_role_id) probes.back().PushInst("GetRoleID", 0);
+      probes.back().PushInst("Inc", 0);
+      probes.back().PushInst("SetRoleID", 0);
+    }
+    // Role IDs after each update, for each probe, on real hardware.
+    emp::Random probe_rnd(1);
+    Deme probe_deme(&probe_rnd, width, height, deme.event_lib, deme.inst_lib, deme.GetHardwareProfile());
+    probe_deme.knockouts = deme.knockouts;
+    emp::vector<emp::vector<emp::vector<double>>> expected(probes.size());
+    for (size_t p = 0; p < probes.size(); ++p) {
+      Agent agent(probes[p]);
+      probe_deme.LoadAgent(&agent);
+      for (size_t t = 0; t < probe_time; ++t) {
+        probe_deme.SingleAdvance();
+        expected[p].emplace_back(probe_deme.traits.role_id);
+      }
+    }
+    // Try every behavior we know how to batch.
+    emp::vector<MainEnd> candidates = {{false, 0, false}};
+    for (size_t gap = 0; gap <= 2; ++gap) {
+      for (bool keeps_memory : {false, true}) candidates.push_back(MainEnd{true, gap, keeps_memory});
+    }
+    const size_t saved_time = eval_time;
+    for (const MainEnd & candidate : candidates) {
+      main_end = candidate;
+      bool match = true;
+      for (size_t p = 0; p < probes.size() && match; ++p) {
+        for (size_t t = 0; t < probe_time && match; ++t) {
+          eval_time = t + 1;
+          Run({&probes[p][0].inst_seq});
+          match = (role_ids == expected[p][t]);
+        }
+      }
+      if (match) { enabled = true; break; }
+    }
+    eval_time = saved_time;
+  }
+
+public:
+  BatchEvaluator(const inst_lib_t & inst_lib)
+    : ops(inst_lib.GetSize()), width(0), height(0), eval_time(0), alive(), x_loc(), y_loc(),
+      calibrated_width(0), calibrated_height(0), enabled(false), main_end{false, 0, false}, batched_cnt(0),
+      num_elements(0), regs(), role_ids() {
+    for (size_t id = 0; id < inst_lib.GetSize(); ++id) ops[id] = GetOp(inst_lib.GetName(id));
+  }
+
+  /// Evaluate like deme (dimensions, knockouts) does for eval_time updates. Calibrates on first use of
+  /// each deme size.
+  void Configure(Deme & deme, size_t _eval_time) {
+    width = deme.GetWidth();
+    height = deme.GetHeight();
+    eval_time = _eval_time;
+    alive.assign(width * height, 1);
+    for (size_t id : deme.knockouts) if (id < alive.size()) alive[id] = 0;
+    x_loc = deme.traits.x_loc;
+    y_loc = deme.traits.y_loc;
+    if (width != calibrated_width || height != calibrated_height) Calibrate(deme);
+  }
+
+  /// Configured to evaluate like deme (dimensions, knockouts)?
+  bool IsConfiguredFor(const Deme & deme) const {
+    if (deme.GetWidth() != width || deme.GetHeight() != height) return false;
+    for (size_t id = 0; id < alive.size(); ++id) if (alive[id] != !deme.knockouts.count(id)) return false;
+    return true;
+  }
+
+  bool IsEnabled() const { return enabled; }
+  void Disable() { enabled = false; }
+  const MainEnd & GetMainEnd() const { return main_end; }
+  size_t GetBatchedCount() const { return batched_cnt; }
+
+  /// IDs of the instructions a batched main function can use.
+  emp::vector<size_t> GetBatchInsts() const {
+    emp::vector<size_t> inst_ids;
+    for (size_t id = 0; id < ops.size(); ++id) if (ops[id] != BatchOp::UNSUPPORTED) inst_ids.emplace_back(id);
+    return inst_ids;
+  }
+
+  /// Can prog be evaluated here?
+  bool CanBatch(const program_t & prog) const {
+    if (!enabled || prog.GetSize() == 0 || prog[0].GetSize() == 0) return false;
+    for (const inst_t & inst : prog[0].inst_seq) {
+      if (inst.id >= ops.size() || ops[inst.id] == BatchOp::UNSUPPORTED) return false;
+      for (int arg : inst.args) if (arg < 0 || (size_t)arg >= CPU_SIZE) return false;
+    }
+    return true;
+  }
+
+  /// Role-ID fitness of each of progs (which must all CanBatch), as EvaluateAgent would find it.
+  emp::vector<double> Evaluate(const emp::vector<emp::Ptr<const program_t>> & progs) {
+    emp::vector<double> fitness(progs.size(), 0.0);
+    const size_t num_cells = std::max((size_t)1, alive.size());
+    const size_t max_lanes = std::max((size_t)1, MAX_BATCH_ELEMENTS / num_cells);
+    for (size_t first = 0; first < progs.size(); first += max_lanes) {
+      const size_t num_lanes = std::min(max_lanes, progs.size() - first);
+      emp::vector<const emp::vector<inst_t> *> mains(num_lanes);
+      for (size_t lane = 0; lane < num_lanes; ++lane) {
+        emp_assert(CanBatch(*progs[first + lane]));
+        mains[lane] = &(*progs[first + lane])[0].inst_seq;
+      }
+      Run(mains);
+      for (size_t lane = 0; lane < num_lanes; ++lane) fitness[first + lane] = GetLaneFitness(lane);
+    }
+    batched_cnt += progs.size();
+    return fitness;
+  }
+};
+
+#endif
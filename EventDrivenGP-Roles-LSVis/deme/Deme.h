@@ -0,0 +1,395 @@
+/*
+  deme/Deme.h
+*/
+
+#ifndef LSVIS_DEME_H
+#define LSVIS_DEME_H
+
+#include <iostream>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+#include "base/Ptr.h"
+#include "base/vector.h"
+#include "hardware/EventDrivenGP.h"
+#include "hardware/InstLib.h"
+#include "hardware/EventLib.h"
+#include "tools/Random.h"
+#include "tools/math.h"
+
+#include "DemeProfiler.h"
+#include "DemeTrace.h"
+#include "DemeTraits.h"
+#include "EventInbox.h"
+#include "HardwareProfile.h"
+#include "ProgramOptimizer.h"
+#include "Topology.h"
+
+using event_lib_t = typename emp::EventDrivenGP::event_lib_t;
+using event_t = typename emp::EventDrivenGP::event_t;
+using inst_lib_t = typename::emp::EventDrivenGP::inst_lib_t;
+using inst_t = typename::emp::EventDrivenGP::inst_t;
+using affinity_t = typename::emp::EventDrivenGP::affinity_t;
+using program_t = emp::EventDrivenGP::Program;
+using fun_t = emp::EventDrivenGP::Function;
+using state_t = emp::EventDrivenGP::State;
+
+constexpr size_t EVAL_TIME = 50;
+constexpr size_t DIST_SYS_WIDTH = 5;
+constexpr size_t DIST_SYS_HEIGHT = 5;
+constexpr size_t DIST_SYS_SIZE = DIST_SYS_WIDTH * DIST_SYS_HEIGHT;
+
+constexpr size_t TRAIT_ID__ROLE_ID = 0;
+constexpr size_t TRAIT_ID__X_LOC = 1;
+constexpr size_t TRAIT_ID__Y_LOC = 2;
+
+constexpr size_t CPU_SIZE = emp::EventDrivenGP::CPU_SIZE;
+constexpr size_t MAX_INST_ARGS = emp::EventDrivenGP::MAX_INST_ARGS;
+
+constexpr int DEFAULT_RANDOM_SEED = -1;
+constexpr size_t DEFAULT_INBOX_CAPACITY = 0; // Unbounded.
+
+// This will be the target of evolution (what the world manages/etc.)
+struct Agent {
+  size_t valid_uid_cnt;
+  size_t valid_id_cnt;
+  program_t program;
+
+  Agent(emp::Ptr<inst_lib_t> _ilib)
+  : valid_uid_cnt(0), valid_id_cnt(0), program(_ilib) { ; }
+
+  Agent(const program_t & _program)
+  : valid_uid_cnt(0), valid_id_cnt(0), program(_program) { ; }
+
+};
+
+/// Same functions (affinities and instructions) in the same order?
+inline bool SameProgram(const program_t & a, const program_t & b) {
+  if (a.GetSize() != b.GetSize()) return false;
+  for (size_t fID = 0; fID < a.GetSize(); ++fID) {
+    const fun_t & fun_a = a[fID];
+    const fun_t & fun_b = b[fID];
+    if (!(fun_a.affinity == fun_b.affinity) || fun_a.GetSize() != fun_b.GetSize()) return false;
+    for (size_t iID = 0; iID < fun_a.GetSize(); ++iID) {
+      const inst_t & inst_a = fun_a.inst_seq[iID];
+      const inst_t & inst_b = fun_b.inst_seq[iID];
+      if (inst_a.id != inst_b.id || inst_a.args != inst_b.args || !(inst_a.affinity == inst_b.affinity)) return false;
+    }
+  }
+  return true;
+}
+
+// Deme structure for holding distributed system. TOPOLOGY_T decides who messages whom: Topology (any
+// graph, chosen at runtime) or FixedTorus<W, H> (default torus with compile-time dimensions).
+template<typename TOPOLOGY_T>
+struct Deme_t {
+  using topology_t = TOPOLOGY_T;
+  using hardware_t = emp::EventDrivenGP;
+  using memory_t = typename emp::EventDrivenGP::memory_t;
+  using grid_t = emp::vector<emp::Ptr<hardware_t>>;
+  using pos_t = std::pair<size_t, size_t>;
+
+  grid_t grid;
+  size_t width;
+  size_t height;
+  emp::Ptr<emp::Random> rnd;
+  emp::Ptr<event_lib_t> event_lib;
+  emp::Ptr<inst_lib_t> inst_lib;
+
+  emp::Ptr<Agent> agent_ptr;
+  bool agent_loaded;
+
+  std::unordered_set<size_t> knockouts;
+
+  DemeTraits traits;                // Role ID/location of each cell (what role-task instructions use).
+  DemeTraits clean_traits;          // Image of traits before anything runs (what Reset restores).
+  bool dirty;                       // Have cells run (or been loaded) since the last reset?
+  program_t grid_program;           // Program every cell's hardware holds (if grid_program_set), as loaded.
+  bool grid_program_set;
+  ProgramOptLevel opt_level;        // How LoadAgent optimizes programs (see ProgramOptimizer.h).
+  emp::Ptr<ProgramOptimizer> optimizer;   // Built on first use.
+  OptimizeReport opt_report;        // What optimizing the program cells hold did.
+
+  emp::Ptr<DemeProfiler> profiler;  // Optional; build deme on profiler->GetInstLib() to count instructions.
+  emp::Ptr<DemeTraceRecorder> trace_recorder; // Optional; records each run from LoadAgent on.
+
+  topology_t topology;              // Who messages whom (Topology::Default unless set otherwise).
+
+  emp::vector<EventInbox> inboxes;  // Messages waiting on each cell (handled right before the cell next processes).
+  InboxPolicy inbox_policy;
+
+  HardwareProfile hw_profile;
+  size_t default_max_cores;         // Hardware's own bounds (what a profile's 0 stands for).
+  size_t default_max_call_depth;
+
+  Deme_t(emp::Ptr<emp::Random> _rnd, size_t _w, size_t _h, emp::Ptr<event_lib_t> _elib, emp::Ptr<inst_lib_t> _ilib,
+         const HardwareProfile & _hw_profile=HardwareProfile::Default())
+    : grid(_w * _h), width(_w), height(_h), rnd(_rnd), event_lib(emp::NewPtr<event_lib_t>(*_elib)), inst_lib(_ilib), agent_ptr(nullptr), agent_loaded(false), knockouts(), traits(_w * _h), clean_traits(),
+      dirty(false), grid_program(_ilib), grid_program_set(false),
+      opt_level(ProgramOptLevel::NONE), optimizer(nullptr), opt_report(), profiler(nullptr), trace_recorder(nullptr),
+      topology(topology_t::Default(_w, _h)), inboxes(_w * _h), inbox_policy(InboxPolicy::DROP_OLDEST),
+      hw_profile(_hw_profile), default_max_cores(0), default_max_call_depth(0) {
+    // Register dispatch function (on our own copy of the event library; demes that share a library
+    // would otherwise receive each other's messages).
+    event_lib->RegisterDispatchFun("Message", [this](hardware_t & hw_src, const event_t & event){ this->DispatchMessage(hw_src, event); });
+    // Fill out the grid with hardware.
+    for (size_t i = 0; i < width * height; ++i) {
+      grid[i].New(inst_lib, event_lib, rnd);
+      pos_t pos = GetPos(i);
+      traits.x_loc[i] = pos.first;
+      traits.y_loc[i] = pos.second;
+    }
+    clean_traits = traits;
+    if (grid.size()) {
+      default_max_cores = grid[0]->GetMaxCores();
+      default_max_call_depth = grid[0]->GetMaxCallDepth();
+    }
+    ApplyHardwareProfile();
+  }
+
+  ~Deme_t() {
+    Reset();
+    for (size_t i = 0; i < grid.size(); ++i) {
+      grid[i].Delete();
+    }
+    grid.resize(0);
+    if (optimizer) optimizer.Delete();
+    event_lib.Delete();
+  }
+
+  /// Back to the state before anything ran. Cells keep their program (LoadAgent reuses it if it can).
+  void Reset() {
+    agent_ptr = nullptr;
+    agent_loaded = false;
+    if (!dirty) return;
+    for (size_t i = 0; i < grid.size(); ++i) {
+      grid[i]->ResetHardware();
+      if (hw_profile.hw_traits) grid[i]->SetTrait(TRAIT_ID__ROLE_ID, 0);
+      inboxes[i].Clear();
+    }
+    traits = clean_traits;  // Same sizes, so a straight copy of each array.
+    dirty = false;
+  }
+
+  /// Bound every cell's hardware as hw_profile says.
+  void ApplyHardwareProfile() {
+    for (size_t i = 0; i < grid.size(); ++i) {
+      grid[i]->SetMaxCores(hw_profile.max_cores ? hw_profile.max_cores : default_max_cores);
+      grid[i]->SetMaxCallDepth(hw_profile.max_call_depth ? hw_profile.max_call_depth : default_max_call_depth);
+      if (!hw_profile.hw_traits) continue;
+      pos_t pos = GetPos(i);
+      grid[i]->SetTrait(TRAIT_ID__ROLE_ID, traits.role_id[i]);
+      grid[i]->SetTrait(TRAIT_ID__X_LOC, pos.first);
+      grid[i]->SetTrait(TRAIT_ID__Y_LOC, pos.second);
+    }
+  }
+
+  void LoadAgent(emp::Ptr<Agent> _agent_ptr) {
+    Reset();
+    agent_ptr = _agent_ptr;
+    dirty = true;
+    if (grid_program_set && SameProgram(agent_ptr->program, grid_program)) {
+      // Every cell already holds this program (and Reset cleared the rest).
+    } else if (agent_ptr->program.inst_lib.Raw() == inst_lib.Raw()) {
+      opt_report = OptimizeReport();
+      if (opt_level == ProgramOptLevel::NONE) {
+        for (size_t i = 0; i < grid.size(); ++i) grid[i]->SetProgram(agent_ptr->program);
+      } else {
+        const program_t opt_prog = optimizer->Optimize(agent_ptr->program, opt_level, &opt_report);
+        for (size_t i = 0; i < grid.size(); ++i) grid[i]->SetProgram(opt_prog);
+      }
+    } else {
+      opt_report = OptimizeReport();
+      // Program was built against another copy of our instruction library (e.g., we're profiled and
+      // it isn't); give the hardware a version built against ours.
+      program_t prog(inst_lib);
+      for (size_t fID = 0; fID < agent_ptr->program.GetSize(); ++fID) prog.PushFunction(agent_ptr->program[fID]);
+      for (size_t i = 0; i < grid.size(); ++i) grid[i]->SetProgram(prog);
+    }
+    grid_program = agent_ptr->program;
+    grid_program_set = true;
+    for (size_t i = 0; i < grid.size(); ++i) grid[i]->SpawnCore(0, memory_t(), true);
+    if (profiler) profiler->OnLoad(grid.size(), agent_ptr->program);
+    if (trace_recorder) trace_recorder->Start(width, height, traits.role_id, GetCoreCounts());
+    agent_loaded = true;
+  }
+
+  /// Attach (or, with nullptr, detach) a profiler. Instruction counts are only collected if the deme
+  /// was built on the profiler's instruction library.
+  void SetProfiler(emp::Ptr<DemeProfiler> _profiler) { profiler = _profiler; }
+
+  /// Attach (or, with nullptr, detach) a trace recorder; it starts a new trace whenever an agent is loaded.
+  void SetTraceRecorder(emp::Ptr<DemeTraceRecorder> _recorder) { trace_recorder = _recorder; }
+
+  /// Give every cell hardware as described by profile (see HardwareProfile.h). Resets the deme.
+  void SetHardwareProfile(const HardwareProfile & profile) {
+    hw_profile = profile;
+    ApplyHardwareProfile();
+    Reset();
+  }
+
+  const HardwareProfile & GetHardwareProfile() const { return hw_profile; }
+
+  /// Optimize programs as they're loaded (see ProgramOptimizer.h). Programs built on another instruction
+  /// library (e.g., when we're profiled) are never optimized, so profiles line up with the programs given.
+  void SetOptLevel(ProgramOptLevel level) {
+    if (level == opt_level) return;
+    opt_level = level;
+    grid_program_set = false;
+    if (opt_level != ProgramOptLevel::NONE && !optimizer) optimizer = emp::NewPtr<ProgramOptimizer>(*inst_lib);
+  }
+
+  ProgramOptLevel GetOptLevel() const { return opt_level; }
+
+  /// What optimizing the last program loaded did (nothing if it wasn't optimized).
+  const OptimizeReport & GetOptReport() const { return opt_report; }
+
+  /// Estimated memory held by the deme's cells right now (see DemeFootprint).
+  DemeFootprint GetFootprint() {
+    auto map_bytes = [](const memory_t & mem) {
+      return mem.bucket_count() * sizeof(void *) + mem.size() * (sizeof(typename memory_t::value_type) + 2 * sizeof(void *));
+    };
+    DemeFootprint footprint;
+    footprint.num_cells = grid.size();
+    for (size_t i = 0; i < grid.size(); ++i) {
+      footprint.hardware_bytes += sizeof(hardware_t) + (hw_profile.hw_traits ? 3 * sizeof(double) : 0);
+      auto & cores = grid[i]->GetCores();
+      footprint.stack_bytes += cores.capacity() * sizeof(cores[0]);
+      for (const auto & stack : cores) {
+        footprint.stack_bytes += stack.capacity() * sizeof(state_t);
+        for (const state_t & state : stack)
+          footprint.memory_bytes += map_bytes(state.local_mem) + map_bytes(state.input_mem) + map_bytes(state.output_mem);
+      }
+      footprint.inbox_bytes += sizeof(EventInbox) + inboxes[i].GetBufferBytes();
+    }
+    footprint.trait_bytes = (traits.role_id.capacity() + traits.x_loc.capacity() + traits.y_loc.capacity()) * sizeof(double)
+                            + traits.role_id_cnts.capacity() * sizeof(size_t);
+    return footprint;
+  }
+
+  /// Number of active cores on each cell.
+  emp::vector<size_t> GetCoreCounts() const {
+    emp::vector<size_t> core_cnts(grid.size());
+    for (size_t i = 0; i < grid.size(); ++i) core_cnts[i] = grid[i]->GetActiveCores().size();
+    return core_cnts;
+  }
+
+  /// Use _topology (which must have a cell for each of ours) for message dispatch.
+  void SetTopology(const topology_t & _topology) {
+    emp_assert(_topology.GetSize() == grid.size());
+    topology = _topology;
+  }
+
+  const topology_t & GetTopology() const { return topology; }
+
+  /// Bound every cell's inbox to capacity messages (0 => unbounded) using policy when one is full.
+  /// Keeps message-storm programs (e.g., BroadcastMsg loops) cheap to evaluate.
+  void SetInboxCapacity(size_t capacity, InboxPolicy policy=InboxPolicy::DROP_OLDEST) {
+    inbox_policy = policy;
+    for (auto & inbox : inboxes) inbox.SetCapacity(capacity);
+  }
+
+  /// Messages dropped from full inboxes since the last reset.
+  size_t GetDroppedCount() const {
+    size_t total = 0;
+    for (const auto & inbox : inboxes) total += inbox.GetDroppedCount();
+    return total;
+  }
+
+  /// Messages coalesced into identical waiting messages since the last reset.
+  size_t GetCoalescedCount() const {
+    size_t total = 0;
+    for (const auto & inbox : inboxes) total += inbox.GetCoalescedCount();
+    return total;
+  }
+
+  size_t GetWidth() const { return width; }
+  size_t GetHeight() const { return height; }
+
+  pos_t GetPos(size_t id) { return pos_t(id % width, id / width); }
+  size_t GetID(size_t x, size_t y) { return (y * width) + x; }
+
+  void Print(std::ostream & os=std::cout) {
+    os << "=============DEME=============\n";
+    for (size_t i = 0; i < grid.size(); ++i) {
+      os << "--- Agent @ (" << GetPos(i).first << ", " << GetPos(i).second << ") ---\n";
+      grid[i]->PrintState(os); os << "\n";
+    }
+  }
+
+  void DispatchMessage(hardware_t & hw_src, const event_t & event) {
+    const size_t src_id = GetCellID(hw_src);
+    // All recipients share one copy of the event.
+    const EventInbox::event_ptr_t shared_event = std::make_shared<const event_t>(event);
+    auto deliver = [this, src_id, &shared_event](size_t dest_id) {
+      const bool delivered = inboxes[dest_id].Push(shared_event, inbox_policy);
+      if (profiler) profiler->OnMessage(src_id, dest_id, delivered, inboxes[dest_id].GetSize());
+      if (trace_recorder) trace_recorder->OnMessage(src_id, dest_id);
+    };
+    if (event.HasProperty("send")) {
+      // Send to random neighbor.
+      deliver(GetRandomNeighbor(src_id));
+    } else {
+      // Treat as broadcast, send to all neighbors.
+      topology.ForEachNeighbor(src_id, deliver);
+    }
+  }
+
+  size_t GetRandomNeighbor(size_t id) { return topology.GetRandomNeighbor(id, *rnd); }
+
+  /// Cell id of one of our cells' hardware.
+  size_t GetCellID(hardware_t & hw) {
+    const ActiveCell & active_cell = GetActiveCell();
+    if (active_cell.traits == &traits && grid[active_cell.id].Raw() == &hw) return active_cell.id;
+    if (hw_profile.hw_traits) return GetID((size_t)hw.GetTrait(TRAIT_ID__X_LOC), (size_t)hw.GetTrait(TRAIT_ID__Y_LOC));
+    // Not processing, and the hardware doesn't know where it is; look for it.
+    for (size_t i = 0; i < grid.size(); ++i) if (grid[i].Raw() == &hw) return i;
+    emp_assert(false);
+    return 0;
+  }
+
+  void Advance(size_t t=1) { for (size_t i = 0; i < t; ++i) SingleAdvance(); }
+
+  void SingleAdvance() {
+    emp_assert(agent_loaded);
+    if (profiler) {
+      ProfiledSingleAdvance();
+    } else {
+      const size_t num_cells = topology.GetSize(); // Compile-time constant for fixed topologies.
+      for (size_t i = 0; i < num_cells; ++i) {
+        if (!knockouts.count(i)) ProcessCell(i);
+      }
+    }
+    if (trace_recorder) trace_recorder->OnUpdate(traits.role_id, GetCoreCounts());
+  }
+
+  /// Handle messages waiting on cell id, then advance its hardware one step.
+  void ProcessCell(size_t id) {
+    hardware_t & hw = *grid[id];
+    ActiveCell & active_cell = GetActiveCell();
+    const ActiveCell prev_active_cell = active_cell;
+    active_cell.traits = &traits;
+    active_cell.id = id;
+    inboxes[id].Drain([&hw](const event_t & event) { hw.HandleEvent(event); });
+    hw.SingleProcess();
+    active_cell = prev_active_cell;
+  }
+
+  void ProfiledSingleAdvance() {
+    profiler->OnTickBegin();
+    for (size_t i = 0; i < grid.size(); ++i) {
+      if (knockouts.count(i)) continue;
+      ProcessCell(i);
+    }
+    profiler->OnTickEnd();
+  }
+};
+
+/// Runtime-sized deme (dimensions and topology configurable).
+using Deme = Deme_t<Topology>;
+
+/// W x H deme on the default torus with neighbor lookup resolved at compile time.
+template<size_t W, size_t H>
+using FixedDeme = Deme_t<FixedTorus<W, H>>;
+
+#endif
@@ -0,0 +1,122 @@
+/*
+  deme/DemePool.h
+*/
+
+#ifndef LSVIS_DEME_POOL_H
+#define LSVIS_DEME_POOL_H
+
+#include <algorithm>
+#include <mutex>
+#include "base/Ptr.h"
+#include "base/vector.h"
+#include "tools/Random.h"
+
+#include "Deme.h"
+#include "HardwareProfile.h"
+
+/// Agents to evaluate programs with, reused instead of allocated per evaluation: Acquire copies a program
+/// into a free agent (reusing its buffers), Release hands the agent back. Safe to share between threads.
+class AgentPool {
+protected:
+  emp::Ptr<inst_lib_t> inst_lib;
+  emp::vector<emp::Ptr<Agent>> agents;        // Every agent we own.
+  emp::vector<emp::Ptr<Agent>> free_agents;
+  std::mutex pool_mutex;
+
+public:
+  AgentPool(emp::Ptr<inst_lib_t> _inst_lib) : inst_lib(_inst_lib), agents(), free_agents(), pool_mutex() { ; }
+  AgentPool(const AgentPool &) = delete;
+  AgentPool & operator=(const AgentPool &) = delete;
+
+  ~AgentPool() {
+    for (auto agent : agents) agent.Delete();
+  }
+
+  size_t GetSize() const { return agents.size(); }
+
+  emp::Ptr<Agent> Acquire(const program_t & prog) {
+    emp::Ptr<Agent> agent;
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      if (free_agents.size()) {
+        agent = free_agents.back();
+        free_agents.pop_back();
+      } else {
+        agent = emp::NewPtr<Agent>(inst_lib);
+        agents.emplace_back(agent);
+      }
+    }
+    agent->program = prog;
+    agent->valid_uid_cnt = 0;
+    agent->valid_id_cnt = 0;
+    return agent;
+  }
+
+  void Release(emp::Ptr<Agent> agent) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    free_agents.emplace_back(agent);
+  }
+};
+
+/// Demes kept around for reuse rather than rebuilt whenever the dimensions asked for change. A deme is
+/// tied to its random number generator (every cell's hardware holds it), so demes are kept by generator
+/// and dimensions; Acquire gives back an idle one that matches (switched to the asked-for hardware
+/// profile) or builds one. At most max_idle idle demes are kept (the least recently released go first).
+class DemePool {
+protected:
+  emp::Ptr<event_lib_t> event_lib;
+  emp::Ptr<inst_lib_t> inst_lib;
+  size_t max_idle;
+  emp::vector<emp::Ptr<Deme>> idle_demes;     // Least recently released first.
+  std::mutex pool_mutex;
+
+public:
+  DemePool(emp::Ptr<event_lib_t> _event_lib, emp::Ptr<inst_lib_t> _inst_lib, size_t _max_idle=8)
+    : event_lib(_event_lib), inst_lib(_inst_lib), max_idle(_max_idle), idle_demes(), pool_mutex() { ; }
+  DemePool(const DemePool &) = delete;
+  DemePool & operator=(const DemePool &) = delete;
+
+  ~DemePool() { Clear(); }
+
+  size_t GetIdleCount() const { return idle_demes.size(); }
+
+  /// Delete every idle deme.
+  void Clear() {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (auto deme : idle_demes) deme.Delete();
+    idle_demes.clear();
+  }
+
+  /// A reset width x height deme using rnd, with the given hardware profile. Knockouts, topology and inbox
+  /// settings are whatever the deme had when released (set them before use).
+  emp::Ptr<Deme> Acquire(emp::Ptr<emp::Random> rnd, size_t width, size_t height,
+                         const HardwareProfile & hw_profile=HardwareProfile::Default()) {
+    emp::Ptr<Deme> deme;
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      for (size_t i = idle_demes.size(); i-- > 0; ) {
+        emp::Ptr<Deme> idle = idle_demes[i];
+        if (idle->rnd.Raw() != rnd.Raw() || idle->GetWidth() != width || idle->GetHeight() != height) continue;
+        deme = idle;
+        idle_demes.erase(idle_demes.begin() + (int)i);
+        break;
+      }
+    }
+    if (!deme) return emp::NewPtr<Deme>(rnd, width, height, event_lib, inst_lib, hw_profile);
+    if (deme->GetHardwareProfile() != hw_profile) deme->SetHardwareProfile(hw_profile);
+    deme->Reset();
+    return deme;
+  }
+
+  void Release(emp::Ptr<Deme> deme) {
+    deme->Reset();
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    idle_demes.emplace_back(deme);
+    if (idle_demes.size() > max_idle) {
+      idle_demes.front().Delete();
+      idle_demes.erase(idle_demes.begin());
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,185 @@
+/*
+  deme/DemeProfiler.h
+*/
+
+#ifndef LSVIS_DEME_PROFILER_H
+#define LSVIS_DEME_PROFILER_H
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "base/Ptr.h"
+#include "base/vector.h"
+#include "hardware/EventDrivenGP.h"
+#include "hardware/InstLib.h"
+
+/// Execution profile of deme runs: instruction executions (per opcode and per program position), messages
+/// sent/received per cell, per-cell event queue high-water marks, and wall time per deme update.
+///
+/// Instruction counts come from a profiled copy of the instruction library (GetInstLib()) whose instructions
+/// bump a counter and then call the original. Only demes built on that library (and given this profiler via
+/// Deme::SetProfiler) pay anything for profiling; everyone else keeps using the original library untouched.
+class DemeProfiler {
+public:
+  using hardware_t = emp::EventDrivenGP;
+  using inst_lib_t = typename hardware_t::inst_lib_t;
+  using inst_t = typename hardware_t::inst_t;
+  using program_t = typename hardware_t::Program;
+  using clock_t = std::chrono::steady_clock;
+
+protected:
+  emp::Ptr<inst_lib_t> inst_lib;                    // Profiled copy of the instruction library.
+
+  emp::vector<size_t> opcode_cnts;                  // Executions by instruction ID.
+  emp::vector<emp::vector<size_t>> position_cnts;   // Executions by [function][instruction position].
+  emp::vector<size_t> msgs_sent;                    // Messages sent by cell.
+  emp::vector<size_t> msgs_received;                // Messages queued for cell (not dropped/coalesced).
+  emp::vector<size_t> queue_high_water;             // Max events ever waiting on a cell.
+  emp::vector<double> tick_times;                   // Wall time (ms) of each profiled deme update.
+
+  clock_t::time_point tick_start;
+
+  void CountInst(hardware_t & hw, const inst_t & inst) {
+    ++opcode_cnts[inst.id];
+    const size_t fID = hw.GetCurState()->GetFP();
+    if (fID >= position_cnts.size()) return;
+    // inst refers into the hardware's program; its offset in the function is its position.
+    const auto & inst_seq = hw.GetProgram()[fID].inst_seq;
+    const size_t iID = (size_t)(&inst - inst_seq.data());
+    if (iID < position_cnts[fID].size()) ++position_cnts[fID][iID];
+  }
+
+public:
+  DemeProfiler(const inst_lib_t & base_lib)
+    : inst_lib(emp::NewPtr<inst_lib_t>()), opcode_cnts(base_lib.GetSize(), 0), position_cnts(),
+      msgs_sent(), msgs_received(), queue_high_water(), tick_times(), tick_start()
+  {
+    // Wrap every instruction in base_lib.
+    for (size_t id = 0; id < base_lib.GetSize(); ++id) {
+      auto base_fun = base_lib.GetFunction(id);
+      inst_lib->AddInst(base_lib.GetName(id),
+                        [this, base_fun](hardware_t & hw, const inst_t & inst) {
+                          this->CountInst(hw, inst);
+                          base_fun(hw, inst);
+                        },
+                        base_lib.GetNumArgs(id), base_lib.GetDesc(id),
+                        base_lib.GetScopeType(id), base_lib.GetScopeArg(id),
+                        base_lib.GetProperties(id));
+    }
+  }
+
+  ~DemeProfiler() { inst_lib.Delete(); }
+
+  DemeProfiler(const DemeProfiler &) = delete;
+  DemeProfiler & operator=(const DemeProfiler &) = delete;
+
+  /// Instruction library to build profiled demes with.
+  emp::Ptr<inst_lib_t> GetInstLib() { return inst_lib; }
+
+  const emp::vector<size_t> & GetOpcodeCounts() const { return opcode_cnts; }
+  const emp::vector<emp::vector<size_t>> & GetPositionCounts() const { return position_cnts; }
+  const emp::vector<size_t> & GetMsgsSent() const { return msgs_sent; }
+  const emp::vector<size_t> & GetMsgsReceived() const { return msgs_received; }
+  const emp::vector<size_t> & GetQueueHighWater() const { return queue_high_water; }
+  const emp::vector<double> & GetTickTimes() const { return tick_times; }
+
+  size_t GetPositionCount(size_t fID, size_t iID) const {
+    if (fID >= position_cnts.size() || iID >= position_cnts[fID].size()) return 0;
+    return position_cnts[fID][iID];
+  }
+
+  size_t GetMaxPositionCount() const {
+    size_t max_cnt = 0;
+    for (const auto & fun_cnts : position_cnts)
+      for (size_t cnt : fun_cnts) max_cnt = std::max(max_cnt, cnt);
+    return max_cnt;
+  }
+
+  size_t GetTotalInstCount() const {
+    size_t total = 0;
+    for (size_t cnt : opcode_cnts) total += cnt;
+    return total;
+  }
+
+  /// Forget everything profiled so far.
+  void Clear() {
+    std::fill(opcode_cnts.begin(), opcode_cnts.end(), 0);
+    position_cnts.clear();
+    msgs_sent.clear();
+    msgs_received.clear();
+    queue_high_water.clear();
+    tick_times.clear();
+  }
+
+  // -- Deme hooks --
+  /// Called when a deme of num_cells cells loads prog.
+  void OnLoad(size_t num_cells, const program_t & prog) {
+    if (position_cnts.size() < prog.GetSize()) position_cnts.resize(prog.GetSize());
+    for (size_t fID = 0; fID < prog.GetSize(); ++fID) {
+      if (position_cnts[fID].size() < prog[fID].GetSize()) position_cnts[fID].resize(prog[fID].GetSize(), 0);
+    }
+    if (msgs_sent.size() < num_cells) {
+      msgs_sent.resize(num_cells, 0);
+      msgs_received.resize(num_cells, 0);
+      queue_high_water.resize(num_cells, 0);
+    }
+  }
+
+  /// Message from src_id to dest_id, queued there unless dropped or coalesced (delivered false); dest_id's
+  /// inbox now holds depth messages.
+  void OnMessage(size_t src_id, size_t dest_id, bool delivered, size_t depth) {
+    ++msgs_sent[src_id];
+    if (!delivered) return;
+    ++msgs_received[dest_id];
+    if (depth > queue_high_water[dest_id]) queue_high_water[dest_id] = depth;
+  }
+
+  void OnTickBegin() { tick_start = clock_t::now(); }
+  void OnTickEnd() {
+    tick_times.emplace_back(std::chrono::duration<double, std::milli>(clock_t::now() - tick_start).count());
+  }
+
+  // -- Export --
+  /// Long-format CSV: metric,key0,key1,value
+  void WriteCSV(std::ostream & os) const {
+    os << "metric,key0,key1,value\n";
+    for (size_t id = 0; id < opcode_cnts.size(); ++id)
+      os << "opcode," << inst_lib->GetName(id) << ",," << opcode_cnts[id] << "\n";
+    for (size_t fID = 0; fID < position_cnts.size(); ++fID)
+      for (size_t iID = 0; iID < position_cnts[fID].size(); ++iID)
+        os << "position," << fID << "," << iID << "," << position_cnts[fID][iID] << "\n";
+    for (size_t i = 0; i < msgs_sent.size(); ++i) {
+      os << "msgs_sent," << i << ",," << msgs_sent[i] << "\n";
+      os << "msgs_received," << i << ",," << msgs_received[i] << "\n";
+      os << "queue_high_water," << i << ",," << queue_high_water[i] << "\n";
+    }
+    for (size_t t = 0; t < tick_times.size(); ++t)
+      os << "tick_ms," << t << ",," << tick_times[t] << "\n";
+  }
+
+  void WriteJSON(std::ostream & os) const {
+    auto write_list = [&os](const auto & vals) {
+      os << "[";
+      for (size_t i = 0; i < vals.size(); ++i) { if (i) os << ","; os << vals[i]; }
+      os << "]";
+    };
+    os << "{\"opcodes\":{";
+    for (size_t id = 0; id < opcode_cnts.size(); ++id) {
+      if (id) os << ",";
+      os << "\"" << inst_lib->GetName(id) << "\":" << opcode_cnts[id];
+    }
+    os << "},\"positions\":[";
+    for (size_t fID = 0; fID < position_cnts.size(); ++fID) {
+      if (fID) os << ",";
+      write_list(position_cnts[fID]);
+    }
+    os << "],\"msgs_sent\":"; write_list(msgs_sent);
+    os << ",\"msgs_received\":"; write_list(msgs_received);
+    os << ",\"queue_high_water\":"; write_list(queue_high_water);
+    os << ",\"tick_ms\":"; write_list(tick_times);
+    os << "}";
+  }
+};
+
+#endif
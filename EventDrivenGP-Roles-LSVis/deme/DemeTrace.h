@@ -0,0 +1,251 @@
+/*
+  deme/DemeTrace.h
+*/
+
+#ifndef LSVIS_DEME_TRACE_H
+#define LSVIS_DEME_TRACE_H
+
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include "base/vector.h"
+#include "tools/assert.h"
+
+/// Deme run traces: what changed in a deme on each update, so a run can be looked at again (at any
+/// update) without re-simulating it.
+///
+/// Binary format. Integers are LEB128 varints; signed values are zigzag encoded first.
+///   "LSTR" <version> <width> <height>
+///   One frame for the deme as loaded, then one per update:
+///     <# role ID changes>   { <cell id - previous cell id in list> <new role ID (signed)> } ...
+///     <# messages>          { <src - previous src in list (signed)> <dest - src (signed)> } ...
+///     <# core count changes> { <cell id - previous cell id in list> <new active core count> } ...
+/// Core spawns show up as core count increases.
+namespace trace_io {
+  constexpr uint64_t VERSION = 1;
+
+  inline void WriteUInt(emp::vector<uint8_t> & out, uint64_t val) {
+    while (val >= 0x80) {
+      out.emplace_back((uint8_t)(val | 0x80));
+      val >>= 7;
+    }
+    out.emplace_back((uint8_t)val);
+  }
+
+  inline void WriteInt(emp::vector<uint8_t> & out, int64_t val) {
+    WriteUInt(out, ((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+  }
+
+  inline bool ReadUInt(const uint8_t *& pos, const uint8_t * end, uint64_t & val) {
+    val = 0;
+    for (size_t shift = 0; pos < end && shift < 64; shift += 7) {
+      const uint8_t byte = *pos++;
+      val |= (uint64_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return true;
+    }
+    return false;
+  }
+
+  inline bool ReadInt(const uint8_t *& pos, const uint8_t * end, int64_t & val) {
+    uint64_t raw;
+    if (!ReadUInt(pos, end, raw)) return false;
+    val = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+    return true;
+  }
+}
+
+/// Records a deme's run as it happens (see Deme::SetTraceRecorder).
+class DemeTraceRecorder {
+protected:
+  emp::vector<uint8_t> bytes;
+  emp::vector<int> prev_role_ids;
+  emp::vector<size_t> prev_core_cnts;
+  emp::vector<std::pair<size_t, size_t>> update_msgs;   // Messages sent during the current update.
+  size_t num_updates;
+
+  void WriteFrame(const emp::vector<double> & role_ids, const emp::vector<size_t> & core_cnts) {
+    emp::vector<size_t> changed;
+    // Role IDs
+    for (size_t i = 0; i < role_ids.size(); ++i) if ((int)role_ids[i] != prev_role_ids[i]) changed.emplace_back(i);
+    trace_io::WriteUInt(bytes, changed.size());
+    size_t prev_id = 0;
+    for (size_t id : changed) {
+      prev_role_ids[id] = (int)role_ids[id];
+      trace_io::WriteUInt(bytes, id - prev_id);
+      trace_io::WriteInt(bytes, prev_role_ids[id]);
+      prev_id = id;
+    }
+    // Messages
+    trace_io::WriteUInt(bytes, update_msgs.size());
+    size_t prev_src = 0;
+    for (const auto & msg : update_msgs) {
+      trace_io::WriteInt(bytes, (int64_t)msg.first - (int64_t)prev_src);
+      trace_io::WriteInt(bytes, (int64_t)msg.second - (int64_t)msg.first);
+      prev_src = msg.first;
+    }
+    update_msgs.clear();
+    // Core counts
+    changed.clear();
+    for (size_t i = 0; i < core_cnts.size(); ++i) if (core_cnts[i] != prev_core_cnts[i]) changed.emplace_back(i);
+    trace_io::WriteUInt(bytes, changed.size());
+    prev_id = 0;
+    for (size_t id : changed) {
+      prev_core_cnts[id] = core_cnts[id];
+      trace_io::WriteUInt(bytes, id - prev_id);
+      trace_io::WriteUInt(bytes, core_cnts[id]);
+      prev_id = id;
+    }
+  }
+
+public:
+  DemeTraceRecorder() : bytes(), prev_role_ids(), prev_core_cnts(), update_msgs(), num_updates(0) { ; }
+
+  /// Start a new trace (dropping the last) from a freshly loaded deme.
+  void Start(size_t width, size_t height, const emp::vector<double> & role_ids, const emp::vector<size_t> & core_cnts) {
+    bytes.clear();
+    for (char c : std::string("LSTR")) bytes.emplace_back((uint8_t)c);
+    trace_io::WriteUInt(bytes, trace_io::VERSION);
+    trace_io::WriteUInt(bytes, width);
+    trace_io::WriteUInt(bytes, height);
+    prev_role_ids.assign(width * height, 0);
+    prev_core_cnts.assign(width * height, 0);
+    update_msgs.clear();
+    num_updates = 0;
+    WriteFrame(role_ids, core_cnts);
+  }
+
+  void OnMessage(size_t src_id, size_t dest_id) { update_msgs.emplace_back(src_id, dest_id); }
+
+  /// Called at the end of each deme update.
+  void OnUpdate(const emp::vector<double> & role_ids, const emp::vector<size_t> & core_cnts) {
+    WriteFrame(role_ids, core_cnts);
+    ++num_updates;
+  }
+
+  size_t GetNumUpdates() const { return num_updates; }
+  const emp::vector<uint8_t> & GetBytes() const { return bytes; }
+
+  void Write(std::ostream & os) const { os.write((const char *)bytes.data(), (std::streamsize)bytes.size()); }
+};
+
+/// A decoded trace. Deme state at any update comes from the nearest keyframe at or before it plus at
+/// most KEYFRAME_INTERVAL - 1 frames of changes.
+class DemeTrace {
+public:
+  static constexpr size_t KEYFRAME_INTERVAL = 64;
+  static constexpr size_t MAX_CELLS = 1 << 16;            // Traces of bigger demes are rejected...
+  static constexpr size_t MAX_KEYFRAME_CELLS = 1 << 24;   // ...as are those whose keyframes would hold more cells.
+
+protected:
+  struct Frame {
+    emp::vector<std::pair<size_t, int>> role_changes;
+    emp::vector<std::pair<size_t, size_t>> msgs;
+    emp::vector<std::pair<size_t, size_t>> core_changes;
+  };
+
+  size_t width;
+  size_t height;
+  emp::vector<Frame> frames;                        // frames[0]: deme as loaded; frames[t]: update t.
+  emp::vector<emp::vector<int>> role_keyframes;     // State after frame k * KEYFRAME_INTERVAL.
+  emp::vector<emp::vector<size_t>> core_keyframes;
+
+  void Apply(const Frame & frame, emp::vector<int> & role_ids, emp::vector<size_t> & core_cnts) const {
+    for (const auto & change : frame.role_changes) role_ids[change.first] = change.second;
+    for (const auto & change : frame.core_changes) core_cnts[change.first] = change.second;
+  }
+
+public:
+  DemeTrace() : width(0), height(0), frames(), role_keyframes(), core_keyframes() { ; }
+
+  size_t GetWidth() const { return width; }
+  size_t GetHeight() const { return height; }
+  size_t GetNumUpdates() const { return frames.size() ? frames.size() - 1 : 0; }
+  bool IsEmpty() const { return frames.size() == 0; }
+
+  /// Returns false (leaving an empty trace) if data isn't a valid trace (or is too big; see MAX_CELLS).
+  bool Read(const uint8_t * data, size_t size) {
+    const uint8_t * pos = data;
+    const uint8_t * end = data + size;
+    width = height = 0;
+    frames.clear();
+    role_keyframes.clear();
+    core_keyframes.clear();
+    uint64_t version, w, h;
+    if (size < 4 || pos[0] != 'L' || pos[1] != 'S' || pos[2] != 'T' || pos[3] != 'R') return false;
+    pos += 4;
+    if (!trace_io::ReadUInt(pos, end, version) || version != trace_io::VERSION) return false;
+    if (!trace_io::ReadUInt(pos, end, w) || !trace_io::ReadUInt(pos, end, h)) return false;
+    // Both at most MAX_CELLS, so w * h can't overflow.
+    if (w == 0 || h == 0 || w > MAX_CELLS || h > MAX_CELLS || w * h > MAX_CELLS) return false;
+    const size_t num_cells = (size_t)(w * h);
+    emp::vector<int> role_ids(num_cells, 0);
+    emp::vector<size_t> core_cnts(num_cells, 0);
+    bool ok = true;
+    while (ok && pos < end) {
+      Frame frame;
+      uint64_t cnt, id_delta, val;
+      int64_t sval, dest_delta;
+      size_t id = 0;
+      ok = trace_io::ReadUInt(pos, end, cnt);
+      for (uint64_t i = 0; ok && i < cnt; ++i) {
+        ok = trace_io::ReadUInt(pos, end, id_delta) && trace_io::ReadInt(pos, end, sval) && id_delta < num_cells && (id += id_delta) < num_cells;
+        if (ok) frame.role_changes.emplace_back(id, (int)sval);
+      }
+      int64_t src = 0;
+      ok = ok && trace_io::ReadUInt(pos, end, cnt);
+      for (uint64_t i = 0; ok && i < cnt; ++i) {
+        ok = trace_io::ReadInt(pos, end, sval) && trace_io::ReadInt(pos, end, dest_delta);
+        // Bound the deltas first so the sums below can't overflow.
+        ok = ok && sval <= (int64_t)num_cells && sval >= -(int64_t)num_cells;
+        ok = ok && dest_delta <= (int64_t)num_cells && dest_delta >= -(int64_t)num_cells;
+        if (ok) src += sval;
+        ok = ok && src >= 0 && src + dest_delta >= 0 && (size_t)src < num_cells && (size_t)(src + dest_delta) < num_cells;
+        if (ok) frame.msgs.emplace_back((size_t)src, (size_t)(src + dest_delta));
+      }
+      id = 0;
+      ok = ok && trace_io::ReadUInt(pos, end, cnt);
+      for (uint64_t i = 0; ok && i < cnt; ++i) {
+        ok = trace_io::ReadUInt(pos, end, id_delta) && trace_io::ReadUInt(pos, end, val) && id_delta < num_cells && (id += id_delta) < num_cells;
+        if (ok) frame.core_changes.emplace_back(id, (size_t)val);
+      }
+      if (!ok) break;
+      Apply(frame, role_ids, core_cnts);
+      if (frames.size() % KEYFRAME_INTERVAL == 0) {
+        if ((role_keyframes.size() + 1) * num_cells > MAX_KEYFRAME_CELLS) { ok = false; break; }
+        role_keyframes.emplace_back(role_ids);
+        core_keyframes.emplace_back(core_cnts);
+      }
+      frames.emplace_back(std::move(frame));
+    }
+    if (!ok || frames.empty()) {
+      frames.clear();
+      role_keyframes.clear();
+      core_keyframes.clear();
+      return false;
+    }
+    width = (size_t)w;
+    height = (size_t)h;
+    return true;
+  }
+
+  bool Read(std::istream & is) {
+    emp::vector<uint8_t> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    return Read(data.data(), data.size());
+  }
+
+  /// Role IDs and active core counts of every cell after the given update (0 => as loaded).
+  void GetState(size_t update, emp::vector<int> & role_ids, emp::vector<size_t> & core_cnts) const {
+    emp_assert(update < frames.size());
+    const size_t key = update / KEYFRAME_INTERVAL;
+    role_ids = role_keyframes[key];
+    core_cnts = core_keyframes[key];
+    for (size_t t = key * KEYFRAME_INTERVAL + 1; t <= update; ++t) Apply(frames[t], role_ids, core_cnts);
+  }
+
+  /// Messages (src, dest) sent during the given update.
+  const emp::vector<std::pair<size_t, size_t>> & GetMessages(size_t update) const { return frames[update].msgs; }
+};
+
+#endif
@@ -0,0 +1,69 @@
+/*
+  deme/DemeTraits.h
+*/
+
+#ifndef LSVIS_DEME_TRAITS_H
+#define LSVIS_DEME_TRAITS_H
+
+#include <algorithm>
+#include "base/Ptr.h"
+#include "base/vector.h"
+
+/// Role-task traits of every cell in a deme, one contiguous array per trait (indexed by cell id).
+/// Role IDs should only be changed through SetRoleID/ClearRoleIDs, which keep count of valid IDs
+/// (in [1, number of cells]) and how many cells hold each one as they change.
+struct DemeTraits {
+  emp::vector<double> role_id;
+  emp::vector<double> x_loc;
+  emp::vector<double> y_loc;
+
+  emp::vector<size_t> role_id_cnts;   // Number of cells holding each valid ID (indexed by ID).
+  size_t valid_id_cnt;                // Cells with a valid ID.
+  size_t unique_id_cnt;               // Distinct valid IDs held.
+
+  DemeTraits(size_t num_cells=0)
+    : role_id(num_cells, 0), x_loc(num_cells, 0), y_loc(num_cells, 0),
+      role_id_cnts(num_cells + 1, 0), valid_id_cnt(0), unique_id_cnt(0) { ; }
+
+  size_t GetSize() const { return role_id.size(); }
+  size_t GetValidIDCount() const { return valid_id_cnt; }
+  size_t GetUniqueIDCount() const { return unique_id_cnt; }
+
+  bool IsValidID(double id) const { return id > 0 && id <= (double)GetSize(); }
+
+  void SetRoleID(size_t cell_id, int id) {
+    const double old_id = role_id[cell_id];
+    if (old_id == id) return;
+    if (IsValidID(old_id)) {
+      --valid_id_cnt;
+      if (--role_id_cnts[(size_t)old_id] == 0) --unique_id_cnt;
+    }
+    if (IsValidID(id)) {
+      ++valid_id_cnt;
+      if (role_id_cnts[(size_t)id]++ == 0) ++unique_id_cnt;
+    }
+    role_id[cell_id] = id;
+  }
+
+  /// Every cell back to role ID 0.
+  void ClearRoleIDs() {
+    std::fill(role_id.begin(), role_id.end(), 0);
+    std::fill(role_id_cnts.begin(), role_id_cnts.end(), 0);
+    valid_id_cnt = 0;
+    unique_id_cnt = 0;
+  }
+};
+
+/// The cell whose hardware is currently running, set by its deme while the cell processes, so that
+/// instructions can get at the cell's traits directly. traits is null outside of deme processing.
+struct ActiveCell {
+  emp::Ptr<DemeTraits> traits = nullptr;
+  size_t id = 0;
+};
+
+inline ActiveCell & GetActiveCell() {
+  thread_local ActiveCell active_cell;
+  return active_cell;
+}
+
+#endif
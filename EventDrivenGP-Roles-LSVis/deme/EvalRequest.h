@@ -0,0 +1,162 @@
+/*
+  deme/EvalRequest.h
+*/
+
+#ifndef LSVIS_EVAL_REQUEST_H
+#define LSVIS_EVAL_REQUEST_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <utility>
+
+#include "Deme.h"
+#include "FitnessEstimate.h"
+
+/// Everything needed to evaluate a program away from the application that built it
+/// (e.g., in a web worker).
+/// Text format:
+///   seed <int>
+///   size <width> <height>
+///   time <eval time>
+///   knockouts [<cell id> ...]
+///   inbox <capacity> <policy>      (optional; see EventInbox.h)
+///   topology <num cells>           (optional, followed by a line per cell, see Topology::Write; default is Topology::Default)
+///   cell_samples <count> <k>       (optional; random k-cell knockout samples for cell landscapes)
+///   hardware <max cores> <max call depth> <hardware traits 0|1>   (optional; see HardwareProfile.h)
+///   seeds <min> <max> <max CI half width>   (optional; average fitness over seeds, see FitnessEstimate.h)
+///   optimize <none|timing|fast>    (optional; optimize programs before running them, see ProgramOptimizer.h)
+///   positions [<fID> <iID> ...]    (optional; landscape only these program positions, in this order; -1 -1 is the base program)
+///   program
+///   <program in .gp format (see ProgramIO.h)>
+/// Requests past the MAX_* limits below are rejected as malformed (they come from outside the process).
+struct EvalRequest {
+  static constexpr size_t MAX_CELLS = 1 << 16;          // width * height, and topology cells.
+  static constexpr size_t MAX_EVAL_TIME = 100000;
+  static constexpr size_t MAX_INBOX_CAPACITY = 1 << 16;
+  static constexpr size_t MAX_SEEDS = 1024;
+  static constexpr size_t MAX_CELL_SAMPLES = 100000;
+  static constexpr size_t MAX_SAMPLED_CELLS = 1 << 22;  // cell_samples * cells knocked out per sample.
+  static constexpr size_t MAX_CORES = 1024;             // Hardware profile limits.
+  static constexpr size_t MAX_CALL_DEPTH = 1024;
+
+  int seed;
+  size_t width;
+  size_t height;
+  size_t eval_time;
+  std::unordered_set<size_t> knockouts;
+  size_t inbox_capacity;
+  InboxPolicy inbox_policy;
+  Topology topology;              // Empty => default.
+  size_t cell_samples;
+  size_t cell_sample_k;
+  HardwareProfile hw_profile;
+  SeedSampling sampling;
+  ProgramOptLevel opt_level;
+  emp::vector<std::pair<int, int>> positions;   // Empty => every position.
+  std::string program;
+
+  EvalRequest()
+    : seed(DEFAULT_RANDOM_SEED), width(DIST_SYS_WIDTH), height(DIST_SYS_HEIGHT),
+      eval_time(EVAL_TIME), knockouts(),
+      inbox_capacity(DEFAULT_INBOX_CAPACITY), inbox_policy(InboxPolicy::DROP_OLDEST), topology(),
+      cell_samples(0), cell_sample_k(2), hw_profile(HardwareProfile::Default()), sampling(),
+      opt_level(ProgramOptLevel::NONE), positions(), program() { ; }
+
+  void Write(std::ostream & os) const {
+    os << "seed " << seed << "\n";
+    os << "size " << width << " " << height << "\n";
+    os << "time " << eval_time << "\n";
+    os << "knockouts";
+    for (size_t id : knockouts) os << " " << id;
+    os << "\n";
+    os << "inbox " << inbox_capacity << " " << InboxPolicyName(inbox_policy) << "\n";
+    if (topology.GetSize()) topology.Write(os);
+    if (cell_samples) os << "cell_samples " << cell_samples << " " << cell_sample_k << "\n";
+    if (hw_profile != HardwareProfile::Default()) {
+      os << "hardware " << hw_profile.max_cores << " " << hw_profile.max_call_depth << " " << hw_profile.hw_traits << "\n";
+    }
+    if (!sampling.IsSingleSeed()) {
+      os << "seeds " << sampling.min_seeds << " " << sampling.max_seeds << " " << sampling.max_half_width << "\n";
+    }
+    if (opt_level != ProgramOptLevel::NONE) os << "optimize " << ProgramOptLevelName(opt_level) << "\n";
+    if (positions.size()) {
+      os << "positions";
+      for (const auto & pos : positions) os << " " << pos.first << " " << pos.second;
+      os << "\n";
+    }
+    os << "program\n" << program;
+  }
+
+  /// Returns false if the request is malformed.
+  bool Read(std::istream & is) {
+    std::string line;
+    knockouts.clear();
+    topology = Topology();
+    cell_samples = 0;
+    hw_profile = HardwareProfile::Default();
+    sampling = SeedSampling();
+    opt_level = ProgramOptLevel::NONE;
+    positions.clear();
+    while (std::getline(is, line)) {
+      std::istringstream fields(line);
+      std::string key;
+      fields >> key;
+      if (key == "seed") fields >> seed;
+      else if (key == "size") fields >> width >> height;
+      else if (key == "time") fields >> eval_time;
+      else if (key == "knockouts") {
+        size_t id;
+        while (fields >> id) knockouts.insert(id);
+      } else if (key == "inbox") {
+        std::string policy;
+        fields >> inbox_capacity >> policy;
+        if (!ParseInboxPolicy(policy, inbox_policy)) return false;
+      } else if (key == "topology") {
+        size_t num_cells = 0;
+        fields >> num_cells;
+        if (num_cells > MAX_CELLS) return false;
+        topology = ReadTopology(is, num_cells);
+      } else if (key == "cell_samples") {
+        fields >> cell_samples >> cell_sample_k;
+      } else if (key == "hardware") {
+        fields >> hw_profile.max_cores >> hw_profile.max_call_depth >> hw_profile.hw_traits;
+      } else if (key == "seeds") {
+        size_t min_seeds = 1, max_seeds = 1;
+        double max_half_width = 0.0;
+        fields >> min_seeds >> max_seeds >> max_half_width;
+        if (min_seeds > MAX_SEEDS || max_seeds > MAX_SEEDS) return false;
+        sampling = SeedSampling(min_seeds, max_seeds, max_half_width);
+      } else if (key == "optimize") {
+        std::string level;
+        fields >> level;
+        if (!ParseProgramOptLevel(level, opt_level)) return false;
+      } else if (key == "positions") {
+        int fID, iID;
+        while (fields >> fID >> iID) positions.emplace_back(fID, iID);
+      } else if (key == "program") {
+        std::stringstream rest;
+        rest << is.rdbuf();
+        program = rest.str();
+        return IsValid();
+      } else if (key != "") return false;
+    }
+    return false;
+  }
+
+  /// Within limits (and the topology, if any, fits)?
+  bool IsValid() const {
+    // 64-bit products: size_t is 32 bits in the web builds.
+    if (!width || !height || width > MAX_CELLS || height > MAX_CELLS || (uint64_t)width * height > MAX_CELLS) return false;
+    if (eval_time > MAX_EVAL_TIME || inbox_capacity > MAX_INBOX_CAPACITY || cell_samples > MAX_CELL_SAMPLES) return false;
+    if ((uint64_t)cell_samples * std::min(cell_sample_k, width * height) > MAX_SAMPLED_CELLS) return false;
+    if (hw_profile.max_cores > MAX_CORES || hw_profile.max_call_depth > MAX_CALL_DEPTH) return false;
+    if (sampling.max_seeds > MAX_SEEDS) return false;
+    return !topology.GetSize() || topology.GetSize() == width * height;
+  }
+};
+
+#endif
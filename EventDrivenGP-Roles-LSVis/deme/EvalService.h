@@ -0,0 +1,388 @@
+/*
+  deme/EvalService.h
+*/
+
+#ifndef LSVIS_EVAL_SERVICE_H
+#define LSVIS_EVAL_SERVICE_H
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include "base/Ptr.h"
+#include "base/vector.h"
+#include "tools/Random.h"
+
+#include "Deme.h"
+#include "RoleTask.h"
+#include "ProgramIO.h"
+#include "Landscape.h"
+#include "SubstitutionLandscape.h"
+#include "EvalRequest.h"
+#include "FitnessEstimate.h"
+#include "BatchEvaluator.h"
+#include "DemePool.h"
+#include "LandscapeStore.h"
+
+/// Answers evaluation requests (EvalRequest text, see EvalRequest.h) for whoever hosts it: the web worker
+/// (EventDrivenGP-Roles-LSVis-worker.cc) or the native evaluation server (EventDrivenGP-Roles-LSVis-server.cc).
+/// Landscapes and batches are spread over the service's demes (one thread each where threads are available).
+/// With a request's seeds line, fitness is averaged over seeds (see FitnessEstimate.h): evaluate streams an
+/// estimate line after each round of seeds, batch results carry their interval, and landscapes use the mean.
+/// Programs simple enough for the batch interpreter (see BatchEvaluator.h) in landscapes and batches are
+/// evaluated there, all at once, instead of on the demes (unless the request optimizes programs for speed,
+/// which changes their timing; see ProgramOptimizer.h).
+/// With a store (SetStore), knockout and mutational landscapes already in it are answered from it, and new
+/// ones are added to it (see LandscapeStore.h). Landscapes asked for a piece at a time (the request's
+/// positions line) are added once the pieces cover the whole program.
+///
+/// Requests:
+///   evaluate            -- run the program
+///   landscape           -- single instruction (Nop) knockout landscape
+///   cell_landscape      -- cell knockout landscape (see the request's cell_samples)
+///   mutation_landscape  -- full single-point mutational landscape
+///   batch               -- run several programs (the request's program section holds them, separated by
+///                          lines of BATCH_SEPARATOR)
+/// Responses are newline-separated text, handed out in one or more chunks:
+///   fitness <fitness>                 -- evaluation result
+///   curve <fitness> ...               -- evaluation's fitness after each update
+///   optimized <work before> <work after> <instructions before> <instructions after>
+///                                     -- what optimizing the program did (with an optimize line; work is
+///                                        non-Nop instructions per pass through the program)
+///   estimate <mean> <half width> <seeds>   -- fitness estimate over seeds so far (95% CI is mean +/- half width)
+///   ls <fID> <iID> <fitness>          -- landscape result ((-1, -1) is the base program)
+///   cell <id> <fitness>               -- cell landscape result (-1 is the deme with no extra knockouts)
+///   sample <fitness> <id> ...         -- cell landscape result for a random sample of knocked out cells
+///   matrix <hex>                      -- mutational landscape (SubstitutionMatrix, hex-encoded)
+///   batch <index> <fitness> [<half width> <seeds>]   -- batch result (index of the program in the request;
+///                                                       with seeds, fitness is the mean)
+///   error <message>
+///   done                              -- final line of every response
+class EvalService {
+public:
+  /// Gets response chunks; final is set on the last one.
+  using respond_fun_t = std::function<void(const std::string &, bool)>;
+
+  static constexpr const char * BATCH_SEPARATOR = "===";
+
+protected:
+  /// Collects response lines (from any thread), handing them off in chunks at most every chunk_ms.
+  class ChunkedResponse {
+  protected:
+    const respond_fun_t & respond;
+    double chunk_ms;
+    std::stringstream chunk;
+    std::chrono::steady_clock::time_point last_flush;
+    std::mutex chunk_mutex;
+
+  public:
+    ChunkedResponse(const respond_fun_t & _respond, double _chunk_ms)
+      : respond(_respond), chunk_ms(_chunk_ms), chunk(), last_flush(std::chrono::steady_clock::now()), chunk_mutex() { ; }
+
+    void AddLine(const std::string & line) {
+      std::lock_guard<std::mutex> lock(chunk_mutex);
+      chunk << line << "\n";
+      const auto now = std::chrono::steady_clock::now();
+      if (std::chrono::duration<double, std::milli>(now - last_flush).count() >= chunk_ms) {
+        respond(chunk.str(), false);
+        chunk.str("");
+        last_flush = now;
+      }
+    }
+
+    void Finish() {
+      std::lock_guard<std::mutex> lock(chunk_mutex);
+      chunk << "done\n";
+      respond(chunk.str(), true);
+    }
+  };
+
+  size_t num_demes;
+  double chunk_ms;
+  emp::Ptr<event_lib_t> event_lib;
+  emp::Ptr<inst_lib_t> inst_lib;
+  emp::vector<emp::Ptr<emp::Random>> randoms;   // One per deme.
+  emp::vector<emp::Ptr<Deme>> demes;
+  size_t eval_time;
+  SeedSampling sampling;
+  LandscapeCache landscape_cache;               // Mutants evaluated under the last request's settings.
+  emp::Ptr<BatchEvaluator> batch;
+  ProgramOptLevel opt_level;
+  emp::Ptr<DemePool> deme_pool;                 // Demes for dimensions we've switched away from.
+  emp::Ptr<AgentPool> agent_pool;
+  emp::Ptr<LandscapeStore> store;               // Not ours; may be null.
+  StoredLandscape partial_landscape;            // Pieces of the knockout landscape being asked for a piece at a time.
+  std::set<std::pair<int, int>> partial_positions;
+
+  /// Parse the request in data and (re)configure the demes to match it.
+  /// Returns false (after responding with an error) on a bad request.
+  bool Configure(const std::string & data, EvalRequest & req, const respond_fun_t & respond) {
+    std::istringstream in(data);
+    if (!req.Read(in)) { respond("error bad request\ndone\n", true); return false; }
+    // Only switch demes if their dimensions changed.
+    if (demes.size() && (demes[0]->GetWidth() != req.width || demes[0]->GetHeight() != req.height)) {
+      for (auto deme : demes) deme_pool->Release(deme);
+      demes.clear();
+    }
+    if (demes.empty()) {
+      for (size_t i = 0; i < num_demes; ++i) demes.emplace_back(deme_pool->Acquire(randoms[i], req.width, req.height, req.hw_profile));
+    }
+    const Topology topology = req.topology.GetSize() ? req.topology : Topology::Default(req.width, req.height);
+    for (size_t i = 0; i < num_demes; ++i) {
+      randoms[i]->ResetSeed(req.seed);
+      if (demes[i]->GetHardwareProfile() != req.hw_profile) demes[i]->SetHardwareProfile(req.hw_profile);
+      demes[i]->knockouts = req.knockouts;
+      demes[i]->SetInboxCapacity(req.inbox_capacity, req.inbox_policy);
+      demes[i]->SetTopology(topology);
+      demes[i]->SetOptLevel(req.opt_level);
+    }
+    eval_time = req.eval_time;
+    sampling = req.sampling;
+    opt_level = req.opt_level;
+    batch->Configure(*demes[0], eval_time);
+    return true;
+  }
+
+  bool ReadProgram(const std::string & prog_str, program_t & prog, const respond_fun_t & respond) {
+    std::istringstream prog_in(prog_str);
+    prog = LoadProgram(prog_in, inst_lib);
+    if (prog.GetSize() == 0) { respond("error empty program\ndone\n", true); return false; }
+    return true;
+  }
+
+  double EvalProgram(Deme & deme, const program_t & prog, emp::Ptr<emp::vector<double>> fitness_curve=nullptr) {
+    emp::Ptr<Agent> agent = agent_pool->Acquire(prog);
+    const double fitness = EvaluateAgent(deme, agent, eval_time, fitness_curve);
+    agent_pool->Release(agent);
+    return fitness;
+  }
+
+  /// Add a piece of a knockout landscape toward the whole (storing it once it's complete). Pieces of a
+  /// different landscape than the one in progress start over.
+  void AddPartialLandscape(const StoredLandscape & piece, const program_t & prog) {
+    if (piece.prog_hash != partial_landscape.prog_hash || piece.context_hash != partial_landscape.context_hash ||
+        piece.seed != partial_landscape.seed || partial_positions.empty()) {
+      partial_landscape = StoredLandscape(piece.prog_hash, piece.context_hash, piece.kind, piece.seed);
+      partial_positions.clear();
+    }
+    for (size_t i = 0; i < piece.GetSize(); ++i) {
+      if (!partial_positions.insert(std::make_pair((int)piece.fIDs[i], (int)piece.iIDs[i])).second) continue;
+      partial_landscape.Add(piece.fIDs[i], piece.iIDs[i], piece.variants[i], piece.fitness[i]);
+    }
+    size_t num_positions = 1;
+    for (size_t fID = 0; fID < prog.GetSize(); ++fID) num_positions += prog[fID].GetSize();
+    if (partial_positions.size() < num_positions) return;
+    store->Append(partial_landscape);
+    partial_positions.clear();
+  }
+
+  /// Batch interpreter, if it can stand in for the demes (it runs programs as given).
+  emp::Ptr<BatchEvaluator> GetBatch() { return opt_level == ProgramOptLevel::FAST ? nullptr : batch; }
+
+  /// Fitness of prog on deme under the request's seed sampling.
+  double SampleProgram(Deme & deme, const program_t & prog) {
+    return SampledFitness(deme, [this, &prog](Deme & seed_deme) { return EvalProgram(seed_deme, prog); }, sampling);
+  }
+
+public:
+  EvalService(size_t _num_demes=1, double _chunk_ms=100.0)
+    : num_demes(std::max((size_t)1, _num_demes)), chunk_ms(_chunk_ms),
+      event_lib(emp::NewPtr<event_lib_t>(*emp::EventDrivenGP::DefaultEventLib())),
+      inst_lib(emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib())),
+      randoms(), demes(), eval_time(EVAL_TIME), sampling(), landscape_cache(), batch(nullptr), opt_level(ProgramOptLevel::NONE),
+      deme_pool(nullptr), agent_pool(nullptr), store(nullptr), partial_landscape(), partial_positions() {
+    AddRoleInstructions(*inst_lib);
+    batch = emp::NewPtr<BatchEvaluator>(*inst_lib);
+    deme_pool = emp::NewPtr<DemePool>(event_lib, inst_lib, 2 * num_demes);
+    agent_pool = emp::NewPtr<AgentPool>(inst_lib);
+    for (size_t i = 0; i < num_demes; ++i) randoms.emplace_back(emp::NewPtr<emp::Random>(DEFAULT_RANDOM_SEED));
+  }
+
+  ~EvalService() {
+    for (auto deme : demes) deme.Delete();
+    deme_pool.Delete();
+    for (auto random : randoms) random.Delete();
+    batch.Delete();
+    agent_pool.Delete();
+    inst_lib.Delete();
+    event_lib.Delete();
+  }
+
+  size_t GetNumDemes() const { return num_demes; }
+
+  /// Reuse (and keep) landscapes in _store (null for none).
+  void SetStore(emp::Ptr<LandscapeStore> _store) { store = _store; }
+
+  /// Answer request data of the given kind (see above). Returns false if kind isn't a request we know.
+  bool Handle(const std::string & kind, const std::string & data, const respond_fun_t & respond) {
+    if (kind == "evaluate") HandleEvaluate(data, respond);
+    else if (kind == "landscape") HandleLandscape(data, respond);
+    else if (kind == "cell_landscape") HandleCellLandscape(data, respond);
+    else if (kind == "mutation_landscape") HandleMutationLandscape(data, respond);
+    else if (kind == "batch") HandleBatch(data, respond);
+    else return false;
+    return true;
+  }
+
+  void HandleEvaluate(const std::string & data, const respond_fun_t & respond) {
+    EvalRequest req;
+    program_t prog(inst_lib);
+    if (!Configure(data, req, respond) || !ReadProgram(req.program, prog, respond)) return;
+    ChunkedResponse resp(respond, chunk_ms);
+    std::stringstream fitness_line;
+    std::stringstream curve_line;
+    emp::vector<double> fitness_curve;
+    fitness_line << "fitness " << EvalProgram(*demes[0], prog, &fitness_curve);
+    resp.AddLine(fitness_line.str());
+    curve_line << "curve";
+    for (double fitness : fitness_curve) curve_line << " " << fitness;
+    resp.AddLine(curve_line.str());
+    if (opt_level != ProgramOptLevel::NONE) {
+      const OptimizeReport & report = demes[0]->GetOptReport();
+      std::stringstream opt_line;
+      opt_line << "optimized " << report.work_before << " " << report.work_after << " "
+               << report.inst_cnt_before << " " << report.inst_cnt_after;
+      resp.AddLine(opt_line.str());
+    }
+    if (!sampling.IsSingleSeed()) {
+      EstimateFitness(demes, [this, &prog](Deme & deme) { return EvalProgram(deme, prog); }, req.seed, sampling,
+                      [&resp](const FitnessEstimate & estimate) {
+        std::stringstream line;
+        line << "estimate " << estimate.mean << " " << estimate.half_width << " " << estimate.seeds;
+        resp.AddLine(line.str());
+        return true;
+      });
+    }
+    resp.Finish();
+  }
+
+  void HandleLandscape(const std::string & data, const respond_fun_t & respond) {
+    EvalRequest req;
+    program_t prog(inst_lib);
+    if (!Configure(data, req, respond) || !ReadProgram(req.program, prog, respond)) return;
+    emp::Random req_random(req.seed);
+    // Stream results back in chunks so the caller can update as we go.
+    ChunkedResponse resp(respond, chunk_ms);
+    auto add_result = [&resp](int fID, int iID, double fitness) {
+      std::stringstream line;
+      line << "ls " << fID << " " << iID << " " << fitness;
+      resp.AddLine(line.str());
+    };
+    StoredLandscape stored(LandscapeCache::Hash(prog), RequestContextHash(req), LandscapeKind::KNOCKOUT, req.seed);
+    if (store && store->Find(stored.prog_hash, stored.context_hash, stored.kind, stored.seed, stored)) {
+      const std::set<std::pair<int, int>> wanted(req.positions.begin(), req.positions.end());
+      for (size_t i = 0; i < stored.GetSize(); ++i) {
+        if (wanted.size() && !wanted.count(std::make_pair((int)stored.fIDs[i], (int)stored.iIDs[i]))) continue;
+        add_result(stored.fIDs[i], stored.iIDs[i], stored.fitness[i]);
+      }
+      resp.Finish();
+      return;
+    }
+    KnockoutLandscape(prog, demes, [this](Deme & deme, const program_t & ko_prog) { return SampleProgram(deme, ko_prog); },
+                      req_random, [&](int fID, int iID, double fitness) {
+      add_result(fID, iID, fitness);
+      stored.Add(fID, iID, 0, fitness);
+    }, GetBatch(), req.positions);
+    if (store && req.positions.empty()) store->Append(stored);
+    else if (store) AddPartialLandscape(stored, prog);
+    resp.Finish();
+  }
+
+  void HandleCellLandscape(const std::string & data, const respond_fun_t & respond) {
+    EvalRequest req;
+    program_t prog(inst_lib);
+    if (!Configure(data, req, respond) || !ReadProgram(req.program, prog, respond)) return;
+    emp::Random req_random(req.seed);
+    const CellLandscape landscape = CellKnockoutLandscape(demes, req.knockouts, [this, &prog](Deme & deme) {
+      return SampleProgram(deme, prog);
+    }, req_random, req.cell_samples, req.cell_sample_k);
+    std::stringstream resp;
+    resp << "cell -1 " << landscape.base_fitness << "\n";
+    for (size_t i = 0; i < landscape.cell_fitness.size(); ++i) resp << "cell " << i << " " << landscape.cell_fitness[i] << "\n";
+    for (size_t s = 0; s < landscape.samples.size(); ++s) {
+      resp << "sample " << landscape.sample_fitness[s];
+      for (size_t id : landscape.samples[s]) resp << " " << id;
+      resp << "\n";
+    }
+    resp << "done\n";
+    respond(resp.str(), true);
+  }
+
+  void HandleMutationLandscape(const std::string & data, const respond_fun_t & respond) {
+    EvalRequest req;
+    program_t prog(inst_lib);
+    if (!Configure(data, req, respond) || !ReadProgram(req.program, prog, respond)) return;
+    // Cached results are good for as long as everything but the program stays the same.
+    std::stringstream context;
+    EvalRequest context_req(req);
+    context_req.program = "";
+    context_req.Write(context);
+    landscape_cache.SetContext(context.str());
+    const uint64_t prog_hash = LandscapeCache::Hash(prog);
+    const uint64_t context_hash = RequestContextHash(req);
+    StoredLandscape stored;
+    SubstitutionMatrix matrix;
+    if (store && store->Find(prog_hash, context_hash, LandscapeKind::SUBSTITUTION, req.seed, stored)) {
+      matrix = LoadMatrix(stored, prog);
+    } else {
+      matrix = SubstitutionLandscape(prog, demes, [this](Deme & deme, const program_t & mut_prog) {
+        return SampleProgram(deme, mut_prog);
+      }, req.seed, landscape_cache, GetBatch());
+      if (store) store->Append(StoreMatrix(matrix, prog_hash, context_hash, req.seed));
+    }
+    std::stringstream matrix_out;
+    matrix.Write(matrix_out);
+    std::stringstream resp;
+    resp << "matrix " << std::hex << std::setfill('0');
+    for (unsigned char byte : matrix_out.str()) resp << std::setw(2) << (int)byte;
+    resp << "\ndone\n";
+    respond(resp.str(), true);
+  }
+
+  /// Every program is run with the request's seed (or, with seed sampling, seeds drawn from it).
+  void HandleBatch(const std::string & data, const respond_fun_t & respond) {
+    EvalRequest req;
+    if (!Configure(data, req, respond)) return;
+    emp::vector<program_t> progs;
+    std::istringstream progs_in(req.program);
+    std::string line;
+    std::stringstream prog_str;
+    while (true) {
+      const bool more = (bool)std::getline(progs_in, line);
+      if (more && line != BATCH_SEPARATOR) { prog_str << line << "\n"; continue; }
+      progs.emplace_back(inst_lib);
+      if (!ReadProgram(prog_str.str(), progs.back(), respond)) return;
+      prog_str.str("");
+      if (!more) break;
+    }
+    ChunkedResponse resp(respond, chunk_ms);
+    emp::vector<FitnessEstimate> estimates(progs.size());   // Of programs run on demes, with seed sampling.
+    RunProgramJobs(demes, progs.size(), [&progs](size_t i) { return progs[i]; }, [&](Deme & deme, size_t i) {
+      if (sampling.IsSingleSeed()) {
+        deme.rnd->ResetSeed(req.seed);
+        return EvalProgram(deme, progs[i]);
+      }
+      estimates[i] = EstimateFitness({emp::Ptr<Deme>(&deme)}, [this, &progs, i](Deme & seed_deme) {
+        return EvalProgram(seed_deme, progs[i]);
+      }, req.seed, sampling);
+      return estimates[i].mean;
+    }, GetBatch(), [&](size_t i, double fitness) {
+      std::stringstream result;
+      result << "batch " << i << " " << fitness;
+      if (!sampling.IsSingleSeed()) {
+        // Batched programs don't depend on the seed: every seed would have given fitness.
+        const FitnessEstimate estimate = estimates[i].seeds ? estimates[i] : sampling.ConstantEstimate(fitness);
+        result << " " << estimate.half_width << " " << estimate.seeds;
+      }
+      resp.AddLine(result.str());
+    });
+    resp.Finish();
+  }
+};
+
+#endif
@@ -0,0 +1,139 @@
+/*
+  deme/EventInbox.h
+*/
+
+#ifndef LSVIS_EVENT_INBOX_H
+#define LSVIS_EVENT_INBOX_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include "base/vector.h"
+#include "hardware/EventDrivenGP.h"
+
+/// What a full (bounded) inbox does with another message.
+enum class InboxPolicy {
+  DROP_OLDEST,  // Make room by dropping the oldest waiting message.
+  DROP_NEWEST,  // Drop the incoming message.
+  COALESCE      // Drop the incoming message if an identical one is already waiting; otherwise drop oldest.
+};
+
+inline std::string InboxPolicyName(InboxPolicy policy) {
+  switch (policy) {
+    case InboxPolicy::DROP_OLDEST: return "drop_oldest";
+    case InboxPolicy::DROP_NEWEST: return "drop_newest";
+    case InboxPolicy::COALESCE: return "coalesce";
+  }
+  return "";
+}
+
+/// Returns false (leaving policy alone) if name isn't a policy.
+inline bool ParseInboxPolicy(const std::string & name, InboxPolicy & policy) {
+  if (name == "drop_oldest") policy = InboxPolicy::DROP_OLDEST;
+  else if (name == "drop_newest") policy = InboxPolicy::DROP_NEWEST;
+  else if (name == "coalesce") policy = InboxPolicy::COALESCE;
+  else return false;
+  return true;
+}
+
+/// Messages waiting on a deme cell, kept in a ring buffer. With a capacity of 0 the inbox is unbounded
+/// (it grows as needed and never drops); otherwise it holds at most capacity messages.
+/// Messages are held by shared, immutable reference so a broadcast stores its event once no matter how
+/// many inboxes it lands in.
+class EventInbox {
+public:
+  using event_t = typename emp::EventDrivenGP::event_t;
+  using event_ptr_t = std::shared_ptr<const event_t>;
+
+protected:
+  emp::vector<event_ptr_t> buffer;
+  size_t head;        // Position of oldest message in buffer.
+  size_t count;       // Number of waiting messages.
+  size_t capacity;    // 0 => unbounded.
+
+  size_t dropped_cnt;
+  size_t coalesced_cnt;
+
+  size_t Slot(size_t i) const { return (head + i) % buffer.size(); }
+
+  static bool SameEvent(const event_ptr_t & a_ptr, const event_ptr_t & b_ptr) {
+    if (a_ptr == b_ptr) return true;
+    const event_t & a = *a_ptr;
+    const event_t & b = *b_ptr;
+    return a.id == b.id && a.affinity == b.affinity && a.msg == b.msg && a.properties == b.properties;
+  }
+
+  // Unbounded inboxes double their buffer (unrolling the ring) when full.
+  void Grow() {
+    emp::vector<event_ptr_t> new_buffer(buffer.size() ? 2 * buffer.size() : 8);
+    for (size_t i = 0; i < count; ++i) new_buffer[i] = std::move(buffer[Slot(i)]);
+    buffer.swap(new_buffer);
+    head = 0;
+  }
+
+public:
+  EventInbox(size_t _capacity=0)
+    : buffer(_capacity), head(0), count(0), capacity(_capacity), dropped_cnt(0), coalesced_cnt(0) { ; }
+
+  size_t GetSize() const { return count; }
+  size_t GetCapacity() const { return capacity; }
+  size_t GetDroppedCount() const { return dropped_cnt; }
+  size_t GetCoalescedCount() const { return coalesced_cnt; }
+  bool IsBounded() const { return capacity > 0; }
+
+  /// Bytes held by the inbox's buffer (not counting the messages it shares).
+  size_t GetBufferBytes() const { return buffer.capacity() * sizeof(event_ptr_t); }
+
+  /// Change capacity (0 => unbounded). Clears waiting messages.
+  void SetCapacity(size_t _capacity) {
+    capacity = _capacity;
+    buffer.clear();
+    buffer.resize(capacity);
+    head = 0;
+    count = 0;
+  }
+
+  /// Forget waiting messages and counters.
+  void Clear() {
+    for (size_t i = 0; i < count; ++i) buffer[Slot(i)].reset();
+    head = 0;
+    count = 0;
+    dropped_cnt = 0;
+    coalesced_cnt = 0;
+  }
+
+  /// Offer a message to the inbox. Returns whether it was queued.
+  bool Push(const event_ptr_t & event, InboxPolicy policy) {
+    if (policy == InboxPolicy::COALESCE) {
+      for (size_t i = 0; i < count; ++i) {
+        if (SameEvent(buffer[Slot(i)], event)) { ++coalesced_cnt; return false; }
+      }
+    }
+    if (!IsBounded()) {
+      if (count == buffer.size()) Grow();
+    } else if (count == capacity) {
+      ++dropped_cnt;
+      if (policy == InboxPolicy::DROP_NEWEST) return false;
+      // Drop oldest.
+      head = (head + 1) % buffer.size();
+      --count;
+    }
+    buffer[Slot(count)] = event;
+    ++count;
+    return true;
+  }
+
+  /// Hand waiting messages to fun (oldest first) until the inbox is empty.
+  template<typename FUN>
+  void Drain(FUN fun) {
+    while (count) {
+      // Take the message out before handing it over; fun may push more.
+      event_ptr_t event(std::move(buffer[head]));
+      head = (head + 1) % buffer.size();
+      --count;
+      fun(*event);
+    }
+  }
+};
+
+#endif
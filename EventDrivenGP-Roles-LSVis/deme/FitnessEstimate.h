@@ -0,0 +1,138 @@
+/*
+  deme/FitnessEstimate.h
+*/
+
+#ifndef LSVIS_FITNESS_ESTIMATE_H
+#define LSVIS_FITNESS_ESTIMATE_H
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include "base/Ptr.h"
+#include "base/vector.h"
+#include "tools/Random.h"
+
+#include "Deme.h"
+#include "Landscape.h"
+
+/// Running mean/variance (Welford's algorithm).
+class RunningStats {
+protected:
+  size_t count;
+  double mean;
+  double m2;      // Sum of squared differences from the mean.
+
+public:
+  RunningStats() : count(0), mean(0.0), m2(0.0) { ; }
+
+  void Add(double val) {
+    ++count;
+    const double delta = val - mean;
+    mean += delta / (double)count;
+    m2 += delta * (val - mean);
+  }
+
+  size_t GetCount() const { return count; }
+  double GetMean() const { return mean; }
+  double GetVariance() const { return count > 1 ? m2 / (double)(count - 1) : 0.0; }  // Sample variance.
+};
+
+/// Two-sided 95% critical value of Student's t distribution with df degrees of freedom.
+inline double TCritical95(size_t df) {
+  static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+  if (df == 0) return INFINITY;
+  if (df <= 30) return table[df - 1];
+  if (df <= 60) return 2.000;
+  if (df <= 120) return 1.980;
+  return 1.960;
+}
+
+/// Mean fitness over a number of seeds, with a 95% confidence interval of mean +/- half_width.
+struct FitnessEstimate {
+  double mean;
+  double half_width;
+  size_t seeds;
+
+  FitnessEstimate(double _mean=0.0, double _half_width=INFINITY, size_t _seeds=0)
+    : mean(_mean), half_width(_half_width), seeds(_seeds) { ; }
+
+  static FitnessEstimate FromStats(const RunningStats & stats) {
+    const size_t n = stats.GetCount();
+    if (n < 2) return FitnessEstimate(stats.GetMean(), INFINITY, n);
+    return FitnessEstimate(stats.GetMean(), TCritical95(n - 1) * std::sqrt(stats.GetVariance() / (double)n), n);
+  }
+
+  double GetLow() const { return mean - half_width; }
+  double GetHigh() const { return mean + half_width; }
+};
+
+/// How many seeds to evaluate with: at least min_seeds, then more until the 95% confidence interval's
+/// half width is at most max_half_width, up to max_seeds. The default is a single seed.
+struct SeedSampling {
+  size_t min_seeds;
+  size_t max_seeds;
+  double max_half_width;
+
+  SeedSampling(size_t _min_seeds=1, size_t _max_seeds=1, double _max_half_width=0.0)
+    : min_seeds(std::max((size_t)1, _min_seeds)), max_seeds(std::max(min_seeds, _max_seeds)),
+      max_half_width(_max_half_width) { ; }
+
+  bool IsSingleSeed() const { return max_seeds <= 1; }
+
+  bool IsDone(const FitnessEstimate & estimate) const {
+    if (estimate.seeds < min_seeds) return false;
+    return estimate.seeds >= max_seeds || estimate.half_width <= max_half_width;
+  }
+
+  /// Estimate we'd stop with if every seed gave fitness.
+  FitnessEstimate ConstantEstimate(double fitness) const {
+    RunningStats stats;
+    FitnessEstimate estimate;
+    while (!IsDone(estimate)) {
+      stats.Add(fitness);
+      estimate = FitnessEstimate::FromStats(stats);
+    }
+    return estimate;
+  }
+};
+
+/// Estimate fitness (eval_deme runs the deme and returns its fitness) over seeds drawn from base_seed, as
+/// sampling says. Seeds are evaluated a round at a time, one per deme in parallel (see RunDemeJobs), but
+/// results are taken in seed order and the stopping rule is checked after each one, so the estimate
+/// doesn't depend on the number of demes (extra seeds from the last round are discarded).
+/// on_round (optional) gets the estimate so far after each round; returning false stops early.
+inline FitnessEstimate EstimateFitness(const emp::vector<emp::Ptr<Deme>> & demes,
+                                       const std::function<double(Deme &)> & eval_deme,
+                                       int base_seed, const SeedSampling & sampling,
+                                       const std::function<bool(const FitnessEstimate &)> & on_round=nullptr) {
+  emp::Random seed_rnd(base_seed);
+  RunningStats stats;
+  FitnessEstimate estimate;
+  while (!sampling.IsDone(estimate)) {
+    const size_t round_size = std::min(demes.size(), sampling.max_seeds - estimate.seeds);
+    emp::vector<int> seeds(round_size);
+    for (int & seed : seeds) seed = seed_rnd.GetInt(1, 1000000);
+    emp::vector<double> fitness(round_size, 0.0);
+    RunDemeJobs(demes, round_size, [&](Deme & deme, size_t j) {
+      deme.rnd->ResetSeed(seeds[j]);
+      fitness[j] = eval_deme(deme);
+    });
+    for (size_t j = 0; j < round_size && !sampling.IsDone(estimate); ++j) {
+      stats.Add(fitness[j]);
+      estimate = FitnessEstimate::FromStats(stats);
+    }
+    if (on_round && !on_round(estimate)) break;
+  }
+  return estimate;
+}
+
+/// Fitness of eval_deme on deme as sampling says: a single run from the deme's current seed, or the
+/// mean estimate over seeds drawn from it.
+inline double SampledFitness(Deme & deme, const std::function<double(Deme &)> & eval_deme, const SeedSampling & sampling) {
+  if (sampling.IsSingleSeed()) return eval_deme(deme);
+  return EstimateFitness({emp::Ptr<Deme>(&deme)}, eval_deme, deme.rnd->GetInt(1, 1000000), sampling).mean;
+}
+
+#endif
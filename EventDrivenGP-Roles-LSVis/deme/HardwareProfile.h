@@ -0,0 +1,53 @@
+/*
+  deme/HardwareProfile.h
+*/
+
+#ifndef LSVIS_HARDWARE_PROFILE_H
+#define LSVIS_HARDWARE_PROFILE_H
+
+#include <string>
+
+/// How much hardware each deme cell gets. Every cell's hardware keeps a pool of call stacks (one per
+/// core, each state on a stack holding its own memory maps), so bounding cores and call depth bounds
+/// how much state a cell can build up. 0 for max_cores/max_call_depth => the hardware's own default.
+struct HardwareProfile {
+  size_t max_cores;
+  size_t max_call_depth;
+  bool hw_traits;         // Also keep role ID/location in each cell's hardware trait vector (only needed
+                          // to run a cell's hardware outside of its deme).
+
+  static HardwareProfile Default() { return HardwareProfile{0, 0, true}; }
+
+  /// For very large demes: a few cores, shallow call stacks, traits only in the deme's arrays.
+  /// Programs that need more cores (e.g., to handle bursts of messages) or deeper calls behave differently.
+  static HardwareProfile Compact() { return HardwareProfile{8, 16, false}; }
+
+  bool operator==(const HardwareProfile & other) const {
+    return max_cores == other.max_cores && max_call_depth == other.max_call_depth && hw_traits == other.hw_traits;
+  }
+  bool operator!=(const HardwareProfile & other) const { return !(*this == other); }
+};
+
+/// Returns false (leaving profile alone) if name isn't a named profile.
+inline bool ParseHardwareProfile(const std::string & name, HardwareProfile & profile) {
+  if (name == "default") profile = HardwareProfile::Default();
+  else if (name == "compact") profile = HardwareProfile::Compact();
+  else return false;
+  return true;
+}
+
+/// Estimated memory held by a deme's cells, in bytes. Heap use is estimated from container sizes
+/// (hash map nodes count as their entry plus two pointers); shared message events aren't counted.
+struct DemeFootprint {
+  size_t num_cells = 0;
+  size_t hardware_bytes = 0;  // Hardware objects and their trait vectors.
+  size_t stack_bytes = 0;     // Call stack pools.
+  size_t memory_bytes = 0;    // Memory maps of the states on the call stacks.
+  size_t inbox_bytes = 0;
+  size_t trait_bytes = 0;     // Deme trait arrays.
+
+  size_t GetTotal() const { return hardware_bytes + stack_bytes + memory_bytes + inbox_bytes + trait_bytes; }
+  double GetBytesPerCell() const { return num_cells ? (double)GetTotal() / (double)num_cells : 0.0; }
+};
+
+#endif
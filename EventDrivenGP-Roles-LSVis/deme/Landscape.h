@@ -0,0 +1,270 @@
+/*
+  deme/Landscape.h
+*/
+
+#ifndef LSVIS_LANDSCAPE_H
+#define LSVIS_LANDSCAPE_H
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include "base/Ptr.h"
+#include "base/vector.h"
+#include "tools/Random.h"
+
+#include "Deme.h"
+#include "BatchEvaluator.h"
+
+/// Build a copy of ref_program with the given functions/instructions knocked out (removed). Empty functions
+/// are dropped. pos_map gets a mapping from original (fID, iID) to position in the built program.
+inline program_t BuildKnockoutProgram(const program_t & ref_program,
+                                      const std::set<int> & func_knockouts,
+                                      const std::set<std::pair<int, int>> & inst_knockouts,
+                                      std::map<std::pair<int, int>, std::pair<int, int>> & pos_map) {
+  program_t built_program(ref_program.inst_lib);
+  for (size_t fID = 0; fID < ref_program.GetSize(); ++fID) {
+    if (func_knockouts.count(fID)) continue;
+    fun_t new_fun = fun_t(ref_program[fID].affinity);
+    for (size_t iID = 0; iID < ref_program[fID].GetSize(); ++iID) {
+      if (inst_knockouts.count(std::make_pair<int, int>(fID, iID))) continue;
+      pos_map.insert(std::make_pair(std::make_pair(fID, iID),
+                                    std::make_pair(built_program.GetSize(), new_fun.GetSize())
+                                    )); // Lets me recover original position given built program position.
+      new_fun.inst_seq.emplace_back(ref_program[fID].inst_seq[iID]);
+    }
+    // Add new function to program if not empty.
+    if (new_fun.GetSize()) built_program.PushFunction(new_fun);
+  }
+  return built_program;
+}
+
+/// Single instruction (Nop) knockout landscape of base_prog.
+/// Reports base fitness as (-1, -1) followed by each knockout's fitness as (fID, iID) to on_result,
+/// in program order.
+inline void KnockoutLandscape(const program_t & base_prog,
+                              const std::function<double(emp::Ptr<program_t>)> & eval_program,
+                              const std::function<void(int, int, double)> & on_result) {
+  program_t ko_prog(base_prog);
+  // Get baseline fitness.
+  on_result(-1, -1, eval_program(&ko_prog));
+  // Do single instruction knockouts.
+  const size_t nop_id = ko_prog.inst_lib->GetID("Nop");
+  for (size_t fID = 0; fID < base_prog.GetSize(); ++fID) {
+    for (size_t iID = 0; iID < base_prog[fID].GetSize(); ++iID) {
+      // Build program w/this location knocked out.
+      ko_prog.SetInst(fID, iID, nop_id);
+      // Evaluate program w/this location knocked out.
+      on_result((int)fID, (int)iID, eval_program(&ko_prog));
+      // Restore ko_prog.
+      ko_prog.SetInst(fID, iID, base_prog[fID].inst_seq[iID]);
+    }
+  }
+}
+
+/// Run job(deme, j) for j in [0, num_jobs), spreading jobs over demes (one thread per deme; jobs go to
+/// whichever deme is free next). Without threads (e.g., in browsers) every job runs on the first deme.
+inline void RunDemeJobs(const emp::vector<emp::Ptr<Deme>> & demes, size_t num_jobs,
+                        const std::function<void(Deme &, size_t)> & job) {
+  emp_assert(demes.size());
+  std::atomic<size_t> next_job(0);
+  auto run_jobs = [&](emp::Ptr<Deme> deme) {
+    for (size_t j = next_job++; j < num_jobs; j = next_job++) job(*deme, j);
+  };
+  emp::vector<std::thread> threads;
+#ifndef __EMSCRIPTEN__
+  for (size_t t = 1; t < std::min(demes.size(), num_jobs); ++t) threads.emplace_back(run_jobs, demes[t]);
+#endif
+  run_jobs(demes[0]);
+  for (auto & thread : threads) thread.join();
+}
+
+/// Evaluate num_jobs programs (get_program(j) builds job j's program): those batch can run go through it
+/// all at once (if batch isn't null and is configured for demes), the rest through eval_job(deme, j)
+/// spread over demes (see RunDemeJobs). batch must be configured to evaluate the way eval_job does.
+/// Batched results are checked against demes: one batched job of each main function length is also run
+/// on a deme (its result is the one reported). If any disagree, batch is disabled and the rest of its jobs
+/// run on demes too.
+/// on_result(j, fitness) may be called from several threads at once.
+inline void RunProgramJobs(const emp::vector<emp::Ptr<Deme>> & demes, size_t num_jobs,
+                           const std::function<program_t(size_t)> & get_program,
+                           const std::function<double(Deme &, size_t)> & eval_job,
+                           emp::Ptr<BatchEvaluator> batch,
+                           const std::function<void(size_t, double)> & on_result) {
+  emp::vector<size_t> deme_jobs;
+  if (batch && batch->IsEnabled() && batch->IsConfiguredFor(*demes[0])) {
+    emp::vector<size_t> batch_jobs;
+    emp::vector<program_t> batch_progs;
+    for (size_t j = 0; j < num_jobs; ++j) {
+      program_t prog = get_program(j);
+      if (!batch->CanBatch(prog)) { deme_jobs.emplace_back(j); continue; }
+      batch_jobs.emplace_back(j);
+      batch_progs.emplace_back(std::move(prog));
+    }
+    if (batch_jobs.size()) {
+      emp::vector<emp::Ptr<const program_t>> prog_ptrs;
+      for (const program_t & prog : batch_progs) prog_ptrs.emplace_back(&prog);
+      const emp::vector<double> fitness = batch->Evaluate(prog_ptrs);
+      // Check the first batched job of each main function length on a deme.
+      emp::vector<size_t> checks;   // Indices into batch_jobs.
+      std::set<size_t> lengths;
+      for (size_t b = 0; b < batch_jobs.size(); ++b) {
+        if (lengths.insert(batch_progs[b][0].GetSize()).second) checks.emplace_back(b);
+      }
+      emp::vector<double> check_fitness(checks.size());
+      RunDemeJobs(demes, checks.size(), [&](Deme & deme, size_t c) { check_fitness[c] = eval_job(deme, batch_jobs[checks[c]]); });
+      bool agree = true;
+      for (size_t c = 0; c < checks.size(); ++c) agree = agree && (check_fitness[c] == fitness[checks[c]]);
+      if (agree) {
+        for (size_t b = 0; b < batch_jobs.size(); ++b) on_result(batch_jobs[b], fitness[b]);
+      } else {
+        batch->Disable();
+        emp::vector<uint8_t> checked(batch_jobs.size(), 0);
+        for (size_t c = 0; c < checks.size(); ++c) {
+          checked[checks[c]] = 1;
+          on_result(batch_jobs[checks[c]], check_fitness[c]);
+        }
+        for (size_t b = 0; b < batch_jobs.size(); ++b) if (!checked[b]) deme_jobs.emplace_back(batch_jobs[b]);
+        std::sort(deme_jobs.begin(), deme_jobs.end());
+      }
+    }
+  } else {
+    for (size_t j = 0; j < num_jobs; ++j) deme_jobs.emplace_back(j);
+  }
+  RunDemeJobs(demes, deme_jobs.size(), [&](Deme & deme, size_t d) { on_result(deme_jobs[d], eval_job(deme, deme_jobs[d])); });
+}
+
+/// KnockoutLandscape spread over demes (see RunDemeJobs). Every evaluation reseeds its deme's random number
+/// generator (from seeds drawn from rnd up front), so results don't depend on the number of demes.
+/// on_result is never called concurrently, but gets results as they finish rather than in program order.
+/// With batch, knockouts it can run are evaluated there (see RunProgramJobs).
+/// With positions, only those positions ((-1, -1) is the base program) are evaluated, in about that order
+/// (batched ones first); each gets the seed it would get in the full landscape, so a landscape evaluated
+/// a piece at a time (from rnd's same starting state each time) matches one evaluated all at once.
+inline void KnockoutLandscape(const program_t & base_prog,
+                              const emp::vector<emp::Ptr<Deme>> & demes,
+                              const std::function<double(Deme &, const program_t &)> & eval_program,
+                              emp::Random & rnd,
+                              const std::function<void(int, int, double)> & on_result,
+                              emp::Ptr<BatchEvaluator> batch=nullptr,
+                              const emp::vector<std::pair<int, int>> & positions={}) {
+  // Jobs: base program, then each position.
+  emp::vector<std::pair<int, int>> jobs(1, std::make_pair(-1, -1));
+  emp::vector<size_t> fun_jobs;   // First job of each function.
+  for (size_t fID = 0; fID < base_prog.GetSize(); ++fID) {
+    fun_jobs.emplace_back(jobs.size());
+    for (size_t iID = 0; iID < base_prog[fID].GetSize(); ++iID) jobs.emplace_back((int)fID, (int)iID);
+  }
+  emp::vector<int> seeds(jobs.size());
+  for (int & seed : seeds) seed = rnd.GetInt(1, 1000000);
+  emp::vector<size_t> run_jobs;
+  if (positions.empty()) {
+    for (size_t j = 0; j < jobs.size(); ++j) run_jobs.emplace_back(j);
+  } else {
+    for (const auto & pos : positions) {
+      if (pos.first < 0) run_jobs.emplace_back(0);
+      else if ((size_t)pos.first < base_prog.GetSize() && pos.second >= 0 && (size_t)pos.second < base_prog[pos.first].GetSize())
+        run_jobs.emplace_back(fun_jobs[pos.first] + (size_t)pos.second);
+    }
+  }
+  const size_t nop_id = base_prog.inst_lib->GetID("Nop");
+  auto get_program = [&](size_t r) {
+    const size_t j = run_jobs[r];
+    program_t ko_prog(base_prog);
+    if (jobs[j].first >= 0) ko_prog.SetInst((size_t)jobs[j].first, (size_t)jobs[j].second, nop_id);
+    return ko_prog;
+  };
+  std::mutex result_mutex;
+  RunProgramJobs(demes, run_jobs.size(), get_program, [&](Deme & deme, size_t r) {
+    deme.rnd->ResetSeed(seeds[run_jobs[r]]);
+    return eval_program(deme, get_program(r));
+  }, batch, [&](size_t r, double fitness) {
+    std::lock_guard<std::mutex> lock(result_mutex);
+    on_result(jobs[run_jobs[r]].first, jobs[run_jobs[r]].second, fitness);
+  });
+}
+
+/// Fitness relative to base fitness (1 => neutral; 2 if base fitness is 0 and fitness isn't), or -1 if
+/// either is negative (i.e., not known yet).
+inline double RelativeFitness(double fitness, double base_fitness) {
+  if (fitness < 0.0 || base_fitness < 0.0) return -1.0;
+  if (base_fitness == 0.0) return (fitness == 0.0) ? 1.0 : 2.0;
+  return fitness / base_fitness;
+}
+
+/// Cell knockout landscape of a deme (see CellKnockoutLandscape). Fitness values are -1 until known.
+struct CellLandscape {
+  double base_fitness;
+  emp::vector<double> cell_fitness;           // Fitness with each cell (also) knocked out, by cell id.
+  emp::vector<emp::vector<size_t>> samples;   // Cells knocked out in each random sample.
+  emp::vector<double> sample_fitness;
+
+  CellLandscape(size_t num_cells=0)
+    : base_fitness(-1.0), cell_fitness(num_cells, -1.0), samples(), sample_fitness() { ; }
+
+  double GetRelativeFitness(double fitness) const { return RelativeFitness(fitness, base_fitness); }
+
+  double GetMeanSampleFitness() const {
+    if (sample_fitness.empty()) return -1.0;
+    double total = 0.0;
+    for (double fitness : sample_fitness) total += fitness;
+    return total / (double)sample_fitness.size();
+  }
+};
+
+/// Cell knockout (spatial robustness) landscape: eval_deme's fitness with each deme cell knocked out on
+/// top of base_knockouts, then with num_samples random sets of sample_k (not already knocked out) cells
+/// knocked out.
+/// Evaluations are split over demes, one thread per deme, and each deme is reused for many evaluations;
+/// demes must be the same size and must not share a random number generator. Every evaluation reseeds its
+/// deme's generator (from seeds drawn from rnd up front), so results don't depend on the number of demes.
+/// Demes are left with base_knockouts.
+inline CellLandscape CellKnockoutLandscape(const emp::vector<emp::Ptr<Deme>> & demes,
+                                           const std::unordered_set<size_t> & base_knockouts,
+                                           const std::function<double(Deme &)> & eval_deme,
+                                           emp::Random & rnd, size_t num_samples=0, size_t sample_k=2) {
+  emp_assert(demes.size());
+  const size_t num_cells = demes[0]->grid.size();
+  CellLandscape landscape(num_cells);
+  emp::vector<size_t> live_cells;
+  for (size_t i = 0; i < num_cells; ++i) if (!base_knockouts.count(i)) live_cells.emplace_back(i);
+  // Jobs: base, each live cell, each sample.
+  emp::vector<emp::vector<size_t>> jobs(1);
+  for (size_t id : live_cells) jobs.emplace_back(1, id);
+  sample_k = std::min(sample_k, live_cells.size());
+  emp::vector<size_t> shuffled(live_cells);
+  for (size_t s = 0; s < num_samples; ++s) {
+    // Partial shuffle; the sample is the first sample_k cells.
+    for (size_t i = 0; i < sample_k; ++i) std::swap(shuffled[i], shuffled[i + rnd.GetUInt((uint32_t)(shuffled.size() - i))]);
+    emp::vector<size_t> sample(shuffled.begin(), shuffled.begin() + sample_k);
+    std::sort(sample.begin(), sample.end());
+    jobs.emplace_back(sample);
+  }
+  emp::vector<int> seeds(jobs.size());
+  for (int & seed : seeds) seed = rnd.GetInt(1, 1000000);
+
+  emp::vector<double> fitness(jobs.size(), 0.0);
+  RunDemeJobs(demes, jobs.size(), [&](Deme & deme, size_t j) {
+    deme.rnd->ResetSeed(seeds[j]);
+    deme.knockouts = base_knockouts;
+    deme.knockouts.insert(jobs[j].begin(), jobs[j].end());
+    fitness[j] = eval_deme(deme);
+  });
+  for (auto deme : demes) deme->knockouts = base_knockouts;
+
+  landscape.base_fitness = fitness[0];
+  for (size_t id : base_knockouts) if (id < num_cells) landscape.cell_fitness[id] = fitness[0];
+  for (size_t i = 0; i < live_cells.size(); ++i) landscape.cell_fitness[live_cells[i]] = fitness[1 + i];
+  for (size_t j = 1 + live_cells.size(); j < jobs.size(); ++j) {
+    landscape.samples.emplace_back(std::move(jobs[j]));
+    landscape.sample_fitness.emplace_back(fitness[j]);
+  }
+  return landscape;
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+  deme/LandscapeScheduler.h
+*/
+
+#ifndef LSVIS_LANDSCAPE_SCHEDULER_H
+#define LSVIS_LANDSCAPE_SCHEDULER_H
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <set>
+#include <utility>
+#include "base/vector.h"
+
+#include "Deme.h"
+
+/// Hands out the positions of a knockout landscape (see KnockoutLandscape) a chunk at a time, most wanted
+/// first, so that results can be shown as they come in and the rest dropped once they're no longer wanted.
+/// The base program ((-1, -1)) always comes first (everything else is shown relative to it), then positions
+/// asked for with Prioritize (e.g., those on screen), then the rest by predicted impact (e.g., how often each
+/// instruction ran), highest first, ties in program order.
+/// Chunks are sized to take about target_ms each (see Done).
+class LandscapeScheduler {
+public:
+  using pos_t = std::pair<int, int>;
+
+protected:
+  emp::vector<pos_t> order;         // Positions not handed out yet come from next on.
+  size_t next;
+  size_t num_done;
+  bool active;
+  double target_ms;
+  size_t chunk_size;
+  std::chrono::steady_clock::time_point chunk_start;
+
+public:
+  LandscapeScheduler(double _target_ms=50.0)
+    : order(), next(0), num_done(0), active(false), target_ms(_target_ms), chunk_size(1), chunk_start() { ; }
+
+  /// Schedule the landscape of prog; impact(fID, iID) predicts how much knocking out a position matters.
+  void Start(const program_t & prog, const std::function<double(int, int)> & impact) {
+    order.clear();
+    emp::vector<double> impacts;
+    for (size_t fID = 0; fID < prog.GetSize(); ++fID) {
+      for (size_t iID = 0; iID < prog[fID].GetSize(); ++iID) {
+        order.emplace_back((int)fID, (int)iID);
+        impacts.emplace_back(impact((int)fID, (int)iID));
+      }
+    }
+    emp::vector<size_t> ids(order.size());
+    for (size_t i = 0; i < ids.size(); ++i) ids[i] = i;
+    std::stable_sort(ids.begin(), ids.end(), [&impacts](size_t a, size_t b) { return impacts[a] > impacts[b]; });
+    emp::vector<pos_t> sorted(1, pos_t(-1, -1));
+    for (size_t id : ids) sorted.emplace_back(order[id]);
+    order = sorted;
+    next = 0;
+    num_done = 0;
+    active = true;
+    chunk_size = 1;
+  }
+
+  /// Stop handing out positions (what's been handed out is dropped by whoever is evaluating it).
+  void Cancel() { active = false; }
+
+  bool IsActive() const { return active; }
+  bool IsDone() const { return num_done == order.size(); }
+  size_t GetNumDone() const { return num_done; }
+  size_t GetNumPositions() const { return order.size(); }
+
+  /// Move positions (those not handed out yet) ahead of the rest, keeping their order; the base program
+  /// stays first.
+  void Prioritize(const emp::vector<pos_t> & positions) {
+    if (!active || next >= order.size()) return;
+    const std::set<pos_t> wanted(positions.begin(), positions.end());
+    const size_t start = (next == 0) ? 1 : next;
+    std::stable_partition(order.begin() + (int)std::min(start, order.size()), order.end(),
+                          [&wanted](const pos_t & pos) { return (bool)wanted.count(pos); });
+  }
+
+  /// Next chunk of positions to evaluate (empty if there's nothing left or we've been cancelled).
+  /// Call Done once it's evaluated.
+  emp::vector<pos_t> NextChunk() {
+    emp::vector<pos_t> chunk;
+    if (!active) return chunk;
+    const size_t end = std::min(order.size(), next + chunk_size);
+    chunk.insert(chunk.end(), order.begin() + (int)next, order.begin() + (int)end);
+    next = end;
+    chunk_start = std::chrono::steady_clock::now();
+    return chunk;
+  }
+
+  /// The last chunk (of size n) is done; size the next one to take about target_ms.
+  void Done(size_t n) {
+    num_done += n;
+    if (IsDone()) active = false;
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - chunk_start).count();
+    if (ms < target_ms / 2.0 && n == chunk_size) chunk_size *= 2;
+    else if (ms > target_ms && chunk_size > 1) chunk_size /= 2;
+  }
+};
+
+#endif
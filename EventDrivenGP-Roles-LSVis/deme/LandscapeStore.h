@@ -0,0 +1,436 @@
+/*
+  deme/LandscapeStore.h
+*/
+
+#ifndef LSVIS_LANDSCAPE_STORE_H
+#define LSVIS_LANDSCAPE_STORE_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include "base/Ptr.h"
+#include "base/vector.h"
+
+#include "Deme.h"
+#include "EvalRequest.h"
+#include "SubstitutionLandscape.h"
+
+/// What a stored landscape's results are.
+enum class LandscapeKind : uint8_t {
+  KNOCKOUT = 0,       // Single instruction (Nop) knockouts (see KnockoutLandscape); variant is always 0.
+  SUBSTITUTION = 1    // Single-point mutations (see SubstitutionLandscape); variant is the matrix column.
+};
+
+inline const char * LandscapeKindName(LandscapeKind kind) {
+  switch (kind) {
+    case LandscapeKind::KNOCKOUT: return "knockout";
+    case LandscapeKind::SUBSTITUTION: return "substitution";
+  }
+  return "unknown";
+}
+
+/// FNV-1a hash of str.
+inline uint64_t HashString(const std::string & str) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : str) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/// Identifies the evaluation setup of req (everything but its program, seed and positions): landscapes with the same
+/// context hash and seed are comparable, and landscapes that differ only in seed are replicates.
+inline uint64_t RequestContextHash(const EvalRequest & req) {
+  EvalRequest context_req(req);
+  context_req.seed = 0;
+  context_req.program = "";
+  context_req.positions.clear();
+  std::stringstream context;
+  context_req.Write(context);
+  return HashString(context.str());
+}
+
+/// One landscape of one program (by LandscapeCache::Hash) under one evaluation setup (by context hash) and
+/// seed. Row i is the fitness at position (fIDs[i], iIDs[i]) for variant variants[i]; (-1, -1) is the base program.
+struct StoredLandscape {
+  uint64_t prog_hash;
+  uint64_t context_hash;
+  LandscapeKind kind;
+  int32_t seed;
+  emp::vector<int32_t> fIDs;
+  emp::vector<int32_t> iIDs;
+  emp::vector<uint32_t> variants;
+  emp::vector<double> fitness;
+
+  StoredLandscape(uint64_t _prog_hash=0, uint64_t _context_hash=0, LandscapeKind _kind=LandscapeKind::KNOCKOUT, int32_t _seed=0)
+    : prog_hash(_prog_hash), context_hash(_context_hash), kind(_kind), seed(_seed), fIDs(), iIDs(), variants(), fitness() { ; }
+
+  size_t GetSize() const { return fitness.size(); }
+
+  void Add(int fID, int iID, uint32_t variant, double fit) {
+    fIDs.emplace_back((int32_t)fID);
+    iIDs.emplace_back((int32_t)iID);
+    variants.emplace_back(variant);
+    fitness.emplace_back(fit);
+  }
+};
+
+/// Rows of many stored landscapes (see LandscapeStore::LoadTable), one column per field.
+/// Landscape l's rows are [starts[l], starts[l+1]).
+struct LandscapeTable {
+  emp::vector<uint64_t> prog_hash;
+  emp::vector<uint64_t> context_hash;
+  emp::vector<LandscapeKind> kind;
+  emp::vector<int32_t> seed;
+  emp::vector<int32_t> fID;
+  emp::vector<int32_t> iID;
+  emp::vector<uint32_t> variant;
+  emp::vector<double> fitness;
+  emp::vector<size_t> starts;
+
+  LandscapeTable() { Clear(); }
+
+  size_t GetSize() const { return fitness.size(); }
+  size_t GetNumLandscapes() const { return starts.size() - 1; }
+
+  void Clear() {
+    prog_hash.clear(); context_hash.clear(); kind.clear(); seed.clear();
+    fID.clear(); iID.clear(); variant.clear(); fitness.clear();
+    starts.assign(1, 0);
+  }
+};
+
+/// Stored form of a mutational landscape (every mutation that exists, plus the base program).
+inline StoredLandscape StoreMatrix(const SubstitutionMatrix & matrix, uint64_t prog_hash, uint64_t context_hash, int seed) {
+  StoredLandscape landscape(prog_hash, context_hash, LandscapeKind::SUBSTITUTION, seed);
+  landscape.Add(-1, -1, 0, matrix.base_fitness);
+  for (size_t row = 0; row < matrix.GetNumRows(); ++row) {
+    for (size_t col = 0; col < matrix.GetNumCols(); ++col) {
+      const float val = matrix.Get(row, col);
+      if (std::isnan(val)) continue;
+      landscape.Add((int)matrix.positions[row].first, (int)matrix.positions[row].second, (uint32_t)col, val);
+    }
+  }
+  return landscape;
+}
+
+/// Rebuild the mutational landscape of prog from its stored form (see StoreMatrix).
+inline SubstitutionMatrix LoadMatrix(const StoredLandscape & landscape, const program_t & prog) {
+  SubstitutionMatrix matrix(prog.inst_lib->GetSize());
+  emp::vector<emp::vector<size_t>> rows(prog.GetSize());
+  for (size_t fID = 0; fID < prog.GetSize(); ++fID) {
+    for (size_t iID = 0; iID < prog[fID].GetSize(); ++iID) {
+      rows[fID].emplace_back(matrix.positions.size());
+      matrix.positions.emplace_back(fID, iID);
+    }
+  }
+  matrix.fitness.resize(matrix.GetNumRows() * matrix.GetNumCols(), std::numeric_limits<float>::quiet_NaN());
+  for (size_t i = 0; i < landscape.GetSize(); ++i) {
+    const int fID = landscape.fIDs[i];
+    const int iID = landscape.iIDs[i];
+    if (fID < 0) { matrix.base_fitness = landscape.fitness[i]; continue; }
+    if ((size_t)fID >= rows.size() || iID < 0 || (size_t)iID >= rows[fID].size()) continue;
+    if (landscape.variants[i] >= matrix.GetNumCols()) continue;
+    matrix.fitness[rows[fID][iID] * matrix.GetNumCols() + landscape.variants[i]] = (float)landscape.fitness[i];
+  }
+  return matrix;
+}
+
+/// Append-only store of landscape results, so that landscapes computed once can be looked up again (Find)
+/// and compared across programs and runs (LoadTable) without re-evaluating anything. Backed by a file (Open)
+/// or, by default, by memory. Appending a landscape that's already stored supersedes the old one for Find.
+/// Safe to share between threads.
+///
+/// Data file (host byte order): "LSLS" <uint32 version>, then one block per landscape, columns contiguous:
+///   "LSLB" <uint32 rows> <uint64 program hash> <uint64 context hash> <uint8 kind> <3 zero bytes> <int32 seed>
+///   <int32 fID>[rows] <int32 iID>[rows] <uint32 variant>[rows] <float64 fitness>[rows]
+/// Index file (<data file>.idx; rebuilt from the data file if it's missing or out of date):
+///   "LSIX" <uint32 version>, then per block: its header (as above) and <uint64 block offset>.
+/// A block cut short (e.g., by a crash mid-append) is ignored and overwritten by the next append.
+class LandscapeStore {
+public:
+  static constexpr uint32_t VERSION = 1;
+  static constexpr size_t FILE_HEADER_SIZE = 8;
+  static constexpr size_t BLOCK_HEADER_SIZE = 32;
+  static constexpr size_t ROW_SIZE = 2 * sizeof(int32_t) + sizeof(uint32_t) + sizeof(double);
+
+protected:
+  using key_t = std::tuple<uint64_t, uint64_t, uint8_t, int32_t>;    // Program hash, context hash, kind, seed.
+
+  struct BlockHeader {
+    uint32_t rows;
+    uint64_t prog_hash;
+    uint64_t context_hash;
+    uint8_t kind;
+    int32_t seed;
+
+    key_t GetKey() const { return key_t(prog_hash, context_hash, kind, seed); }
+    uint64_t GetBlockSize() const { return BLOCK_HEADER_SIZE + (uint64_t)rows * ROW_SIZE; }
+
+    void Write(char * buf) const {
+      std::memcpy(buf, "LSLB", 4);
+      std::memcpy(buf + 4, &rows, 4);
+      std::memcpy(buf + 8, &prog_hash, 8);
+      std::memcpy(buf + 16, &context_hash, 8);
+      std::memset(buf + 24, 0, 4);
+      buf[24] = (char)kind;
+      std::memcpy(buf + 28, &seed, 4);
+    }
+
+    bool Read(const char * buf) {
+      if (std::memcmp(buf, "LSLB", 4) != 0) return false;
+      std::memcpy(&rows, buf + 4, 4);
+      std::memcpy(&prog_hash, buf + 8, 8);
+      std::memcpy(&context_hash, buf + 16, 8);
+      kind = (uint8_t)buf[24];
+      std::memcpy(&seed, buf + 28, 4);
+      return true;
+    }
+  };
+
+  struct IndexEntry {
+    uint64_t offset;
+    uint32_t rows;
+  };
+
+  std::string path;                     // Empty => in memory.
+  emp::Ptr<std::fstream> file;          // Null => in memory.
+  std::stringstream memory;
+  std::map<key_t, IndexEntry> index;
+  size_t num_blocks;                    // Including superseded ones.
+  uint64_t data_end;                    // End of the last complete block.
+  std::mutex store_mutex;
+
+  std::string GetIndexPath() const { return path + ".idx"; }
+
+  std::iostream & Data() {
+    if (file) return *file;
+    return memory;
+  }
+
+  static void WriteFileHeader(std::ostream & os, const char * magic) {
+    const uint32_t version = VERSION;
+    os.write(magic, 4);
+    os.write((const char *)&version, sizeof(version));
+  }
+
+  static bool ReadFileHeader(std::istream & is, const char * magic) {
+    char buf[FILE_HEADER_SIZE];
+    uint32_t version;
+    if (!is.read(buf, FILE_HEADER_SIZE) || std::memcmp(buf, magic, 4) != 0) return false;
+    std::memcpy(&version, buf + 4, 4);
+    return version == VERSION;
+  }
+
+  void AddToIndex(const BlockHeader & header, uint64_t offset) {
+    index[header.GetKey()] = IndexEntry{offset, header.rows};
+    ++num_blocks;
+    data_end = offset + header.GetBlockSize();
+  }
+
+  /// Index blocks from data_end on (stopping at the first incomplete one). Returns those found.
+  emp::vector<std::pair<BlockHeader, uint64_t>> ScanBlocks(uint64_t file_size) {
+    emp::vector<std::pair<BlockHeader, uint64_t>> found;
+    char buf[BLOCK_HEADER_SIZE];
+    while (data_end + BLOCK_HEADER_SIZE <= file_size) {
+      BlockHeader header;
+      Data().clear();
+      Data().seekg((std::streamoff)data_end);
+      if (!Data().read(buf, BLOCK_HEADER_SIZE) || !header.Read(buf)) break;
+      if (data_end + header.GetBlockSize() > file_size) break;
+      found.emplace_back(header, data_end);
+      AddToIndex(header, data_end);
+    }
+    return found;
+  }
+
+  /// Load the index file, if it matches the data file (file_size bytes); false if it needs rebuilding.
+  bool ReadIndexFile(uint64_t file_size) {
+    std::ifstream idx(GetIndexPath(), std::ios::binary);
+    if (!idx || !ReadFileHeader(idx, "LSIX")) return false;
+    char buf[BLOCK_HEADER_SIZE + 8];
+    while (idx.read(buf, sizeof(buf))) {
+      BlockHeader header;
+      uint64_t offset;
+      std::memcpy(&offset, buf + BLOCK_HEADER_SIZE, 8);
+      if (!header.Read(buf) || offset != data_end || offset + header.GetBlockSize() > file_size) return false;
+      AddToIndex(header, offset);
+    }
+    return idx.gcount() == 0;
+  }
+
+  void WriteIndexEntries(const emp::vector<std::pair<BlockHeader, uint64_t>> & entries, bool rewrite) {
+    if (path.empty()) return;
+    std::ofstream idx(GetIndexPath(), std::ios::binary | (rewrite ? std::ios::trunc : std::ios::app));
+    if (rewrite) WriteFileHeader(idx, "LSIX");
+    char buf[BLOCK_HEADER_SIZE + 8];
+    for (const auto & entry : entries) {
+      entry.first.Write(buf);
+      std::memcpy(buf + BLOCK_HEADER_SIZE, &entry.second, 8);
+      idx.write(buf, sizeof(buf));
+    }
+  }
+
+  /// Start over with an empty in-memory store.
+  void Reset() {
+    if (file) file.Delete();
+    file = nullptr;
+    path = "";
+    memory.clear();
+    memory.str("");
+    WriteFileHeader(memory, "LSLS");
+    index.clear();
+    num_blocks = 0;
+    data_end = FILE_HEADER_SIZE;
+  }
+
+  /// Read a block's columns (in order) into landscape.
+  bool ReadColumns(uint64_t offset, uint32_t rows, StoredLandscape & landscape) {
+    landscape.fIDs.resize(rows);
+    landscape.iIDs.resize(rows);
+    landscape.variants.resize(rows);
+    landscape.fitness.resize(rows);
+    Data().clear();
+    Data().seekg((std::streamoff)(offset + BLOCK_HEADER_SIZE));
+    Data().read((char *)landscape.fIDs.data(), (std::streamsize)(rows * sizeof(int32_t)));
+    Data().read((char *)landscape.iIDs.data(), (std::streamsize)(rows * sizeof(int32_t)));
+    Data().read((char *)landscape.variants.data(), (std::streamsize)(rows * sizeof(uint32_t)));
+    Data().read((char *)landscape.fitness.data(), (std::streamsize)(rows * sizeof(double)));
+    return (bool)Data();
+  }
+
+public:
+  LandscapeStore()
+    : path(), file(nullptr), memory(std::ios::in | std::ios::out | std::ios::binary), index(), num_blocks(0),
+      data_end(FILE_HEADER_SIZE), store_mutex() { Reset(); }
+  LandscapeStore(const LandscapeStore &) = delete;
+  LandscapeStore & operator=(const LandscapeStore &) = delete;
+
+  ~LandscapeStore() { Reset(); }
+
+  /// Switch to the store in the file at _path (creating it if need be).
+  /// Returns false (leaving an empty in-memory store) if the file can't be opened or isn't a store.
+  bool Open(const std::string & _path) {
+    std::lock_guard<std::mutex> lock(store_mutex);
+    Reset();
+    { std::ofstream touch(_path, std::ios::binary | std::ios::app); }
+    file = emp::NewPtr<std::fstream>(_path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!*file) { Reset(); return false; }
+    path = _path;
+    file->seekg(0, std::ios::end);
+    const uint64_t file_size = (uint64_t)file->tellg();
+    file->seekg(0);
+    if (file_size == 0) {
+      file->seekp(0);
+      WriteFileHeader(*file, "LSLS");
+      file->flush();
+    } else if (!ReadFileHeader(*file, "LSLS")) {
+      Reset();
+      return false;
+    }
+    if (ReadIndexFile(file_size)) {
+      // Catch up on blocks appended after the index was last written.
+      WriteIndexEntries(ScanBlocks(file_size), false);
+    } else {
+      index.clear();
+      num_blocks = 0;
+      data_end = FILE_HEADER_SIZE;
+      WriteIndexEntries(ScanBlocks(file_size), true);
+    }
+    return true;
+  }
+
+  const std::string & GetPath() const { return path; }
+  size_t GetNumLandscapes() const { return index.size(); }     // Not counting superseded ones.
+  size_t GetNumBlocks() const { return num_blocks; }
+  uint64_t GetDataSize() const { return data_end; }
+
+  /// Look up a stored landscape. Returns false if there isn't one.
+  bool Find(uint64_t prog_hash, uint64_t context_hash, LandscapeKind kind, int seed, StoredLandscape & landscape) {
+    std::lock_guard<std::mutex> lock(store_mutex);
+    auto it = index.find(key_t(prog_hash, context_hash, (uint8_t)kind, (int32_t)seed));
+    if (it == index.end()) return false;
+    landscape = StoredLandscape(prog_hash, context_hash, kind, seed);
+    return ReadColumns(it->second.offset, it->second.rows, landscape);
+  }
+
+  /// Add landscape to the store (and flush it to disk, for file-backed stores).
+  bool Append(const StoredLandscape & landscape) {
+    std::lock_guard<std::mutex> lock(store_mutex);
+    BlockHeader header{(uint32_t)landscape.GetSize(), landscape.prog_hash, landscape.context_hash,
+                       (uint8_t)landscape.kind, landscape.seed};
+    char buf[BLOCK_HEADER_SIZE];
+    header.Write(buf);
+    const uint32_t rows = header.rows;
+    Data().clear();
+    Data().seekp((std::streamoff)data_end);
+    Data().write(buf, BLOCK_HEADER_SIZE);
+    Data().write((const char *)landscape.fIDs.data(), (std::streamsize)(rows * sizeof(int32_t)));
+    Data().write((const char *)landscape.iIDs.data(), (std::streamsize)(rows * sizeof(int32_t)));
+    Data().write((const char *)landscape.variants.data(), (std::streamsize)(rows * sizeof(uint32_t)));
+    Data().write((const char *)landscape.fitness.data(), (std::streamsize)(rows * sizeof(double)));
+    Data().flush();
+    if (!Data()) return false;
+    WriteIndexEntries({std::make_pair(header, data_end)}, false);
+    AddToIndex(header, data_end);
+    return true;
+  }
+
+  /// Every stored landscape (superseded ones included unless latest_only), read in one pass.
+  void LoadTable(LandscapeTable & table, bool latest_only=true) {
+    std::lock_guard<std::mutex> lock(store_mutex);
+    table.Clear();
+    std::string bytes(data_end - FILE_HEADER_SIZE, '\0');
+    Data().clear();
+    Data().seekg((std::streamoff)FILE_HEADER_SIZE);
+    if (!Data().read(&bytes[0], (std::streamsize)bytes.size())) return;
+    // Size the columns up front.
+    size_t total_rows = 0;
+    emp::vector<std::pair<BlockHeader, size_t>> blocks;       // Header and position in bytes.
+    for (size_t pos = 0; pos + BLOCK_HEADER_SIZE <= bytes.size(); ) {
+      BlockHeader header;
+      if (!header.Read(&bytes[pos])) break;
+      const uint64_t offset = FILE_HEADER_SIZE + pos;
+      auto it = index.find(header.GetKey());
+      if (!latest_only || (it != index.end() && it->second.offset == offset)) {
+        blocks.emplace_back(header, pos);
+        total_rows += header.rows;
+      }
+      pos += (size_t)header.GetBlockSize();
+    }
+    table.prog_hash.reserve(total_rows); table.context_hash.reserve(total_rows);
+    table.kind.reserve(total_rows); table.seed.reserve(total_rows);
+    table.fID.resize(total_rows); table.iID.resize(total_rows);
+    table.variant.resize(total_rows); table.fitness.resize(total_rows);
+    size_t row = 0;
+    for (const auto & block : blocks) {
+      const BlockHeader & header = block.first;
+      const char * col = &bytes[block.second + BLOCK_HEADER_SIZE];
+      const size_t rows = header.rows;
+      table.prog_hash.insert(table.prog_hash.end(), rows, header.prog_hash);
+      table.context_hash.insert(table.context_hash.end(), rows, header.context_hash);
+      table.kind.insert(table.kind.end(), rows, (LandscapeKind)header.kind);
+      table.seed.insert(table.seed.end(), rows, header.seed);
+      std::memcpy(table.fID.data() + row, col, rows * sizeof(int32_t));
+      col += rows * sizeof(int32_t);
+      std::memcpy(table.iID.data() + row, col, rows * sizeof(int32_t));
+      col += rows * sizeof(int32_t);
+      std::memcpy(table.variant.data() + row, col, rows * sizeof(uint32_t));
+      col += rows * sizeof(uint32_t);
+      std::memcpy(table.fitness.data() + row, col, rows * sizeof(double));
+      row += rows;
+      table.starts.emplace_back(row);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,95 @@
+/*
+  deme/ProgramIO.h
+*/
+
+#ifndef LSVIS_PROGRAM_IO_H
+#define LSVIS_PROGRAM_IO_H
+
+#include <iostream>
+#include <string>
+#include "base/Ptr.h"
+#include "base/vector.h"
+#include "tools/string_utils.h"
+
+#include "Deme.h"
+
+/// Here's a horrible, inefficient, and unforgiving load program function that definitely does not fail gracefully.
+/// Program format (.gp):
+///   Fn- <affinity bits>
+///     <inst name> [<affinity bits>] [arg0] [arg1] [arg2]
+///     ...
+inline program_t LoadProgram(std::istream & input, emp::Ptr<inst_lib_t> inst_lib) {
+  program_t prog(inst_lib);
+  std::string cur_line;
+  emp::vector<std::string> line_components;
+
+  while (!input.eof()) {
+    std::getline(input, cur_line);
+    emp::left_justify(cur_line); // Clear out leading whitespace.
+
+    if (cur_line == "") continue; // Skip empty lines.
+
+    //std::string command = emp::string_pop_word(cur_line);
+    emp::slice(cur_line, line_components, '-');
+    if (line_components[0] == "Fn") {
+      line_components.resize(0);
+      emp::slice(cur_line, line_components, ' ');
+      std::string aff_str = line_components[1];
+      // Extract function affinity.
+      affinity_t fun_aff;
+      for (size_t i = 0; i < aff_str.size(); ++i) {
+        if (i >= fun_aff.GetSize()) break;
+        if (aff_str[i] == '1') fun_aff.Set(fun_aff.GetSize() - i - 1, true);
+      }
+      // Push a new function onto the program.
+      prog.PushFunction(fun_t(fun_aff));
+    } else {
+      line_components.resize(0);
+      emp::slice(cur_line, line_components, ' ');
+      std::string inst_name = line_components[0];
+      size_t inst_id = inst_lib->GetID(inst_name);
+      bool has_affinity = inst_lib->HasProperty(inst_id, "affinity");
+      size_t arg = 1;
+      affinity_t inst_aff;
+      if (has_affinity) {
+        std::string aff_str = line_components[1];
+        ++arg;
+        for (size_t i = 0; i < aff_str.size(); ++i) {
+          if (i >= inst_aff.GetSize()) break;
+          if (aff_str[i] == '1') inst_aff.Set(inst_aff.GetSize() - i - 1, true);
+        }
+      }
+      int arg0 = 0;
+      int arg1 = 0;
+      int arg2 = 0;
+      if (arg < line_components.size()) {
+        arg0 = std::stoi(line_components[arg]); ++arg;
+      }
+      if (arg < line_components.size()) {
+        arg1 = std::stoi(line_components[arg]); ++arg;
+      }
+      if (arg < line_components.size()) {
+        arg2 = std::stoi(line_components[arg]); ++arg;
+      }
+      prog.PushInst(inst_id, arg0, arg1, arg2, inst_aff);
+    }
+
+  }
+  return prog;
+}
+
+/// Write program in the format understood by LoadProgram.
+inline void WriteProgram(const program_t & prog, std::ostream & os) {
+  for (size_t fID = 0; fID < prog.GetSize(); ++fID) {
+    os << "Fn- "; prog[fID].affinity.Print(os); os << "\n";
+    for (size_t iID = 0; iID < prog[fID].GetSize(); ++iID) {
+      const inst_t & inst = prog[fID].inst_seq[iID];
+      os << "  " << prog.inst_lib->GetName(inst.id);
+      if (prog.inst_lib->HasProperty(inst.id, "affinity")) { os << " "; inst.affinity.Print(os); }
+      for (size_t arg = 0; arg < MAX_INST_ARGS; ++arg) os << " " << inst.args[arg];
+      os << "\n";
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,272 @@
+/*
+  deme/ProgramOptimizer.h
+*/
+
+#ifndef LSVIS_PROGRAM_OPTIMIZER_H
+#define LSVIS_PROGRAM_OPTIMIZER_H
+
+#include <bitset>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include "base/vector.h"
+#include "hardware/EventDrivenGP.h"
+#include "hardware/InstLib.h"
+
+/// How hard to optimize programs before running them (see ProgramOptimizer).
+enum class ProgramOptLevel {
+  NONE,
+  TIMING,   // Keep every instruction's position (and so the tick it runs on): dead code becomes Nop.
+  FAST      // Drop Nops and dead code: fewer ticks per pass, so anything timed (roles, messages) may shift.
+};
+
+inline const char * ProgramOptLevelName(ProgramOptLevel level) {
+  switch (level) {
+    case ProgramOptLevel::NONE: return "none";
+    case ProgramOptLevel::TIMING: return "timing";
+    case ProgramOptLevel::FAST: return "fast";
+  }
+  return "none";
+}
+
+/// Returns false (leaving level alone) if name isn't a level.
+inline bool ParseProgramOptLevel(const std::string & name, ProgramOptLevel & level) {
+  if (name == "none") level = ProgramOptLevel::NONE;
+  else if (name == "timing") level = ProgramOptLevel::TIMING;
+  else if (name == "fast") level = ProgramOptLevel::FAST;
+  else return false;
+  return true;
+}
+
+/// What an optimization did. Work is non-Nop instructions: what a pass through the program costs to
+/// interpret beyond stepping.
+struct OptimizeReport {
+  size_t inst_cnt_before = 0;
+  size_t inst_cnt_after = 0;
+  size_t work_before = 0;
+  size_t work_after = 0;
+  size_t folded = 0;        // Instructions with a constant result turned into SetMem.
+  size_t dead = 0;          // Instructions whose results are never used (or that do nothing).
+
+  double GetWorkReduction() const { return work_before ? 1.0 - (double)work_after / (double)work_before : 0.0; }
+};
+
+/// Peephole optimizer for programs, run before they're loaded into hardware.
+///
+/// Each function is split into straight-line segments by every instruction we don't know to only touch
+/// local memory (flow control, calls, messages, input/output memory, ...). Such barriers are assumed to read
+/// and write any local register; so is the end of a function (blocks can loop back, and what happens to
+/// local memory after the main function ends is up to the hardware). Within a segment:
+///   - Registers set to known constants are tracked, and instructions whose result is a known integer
+///     become SetMem of it (e.g., SetMem 0 3; Inc 0 => SetMem 0 3; SetMem 0 4).
+///   - Instructions whose results are overwritten before anything reads them, or that do nothing
+///     (CopyMem/SwapMem of a register with itself), are dead.
+/// Dead instructions become Nop (TIMING) or are dropped along with every Nop (FAST). Either way the hardware
+/// ends up with the same role IDs; only FAST changes which tick anything happens on.
+class ProgramOptimizer {
+public:
+  using program_t = emp::EventDrivenGP::Program;
+  using inst_t = emp::EventDrivenGP::inst_t;
+  using inst_lib_t = emp::EventDrivenGP::inst_lib_t;
+
+  static constexpr size_t NUM_REGS = emp::EventDrivenGP::CPU_SIZE;
+
+protected:
+  using reg_set_t = std::bitset<NUM_REGS>;
+
+  enum class OptOp : uint8_t {
+    BARRIER, NOP, INC, DEC, NOT, ADD, SUB, MULT, TEST_EQU, TEST_NEQU, TEST_LESS,
+    SET_MEM, COPY_MEM, SWAP_MEM, GET_TRAIT, SET_ROLE_ID
+  };
+
+  emp::vector<OptOp> ops;     // By instruction id.
+  size_t nop_id;
+  size_t set_mem_id;
+  bool enabled;               // Does the library have Nop and SetMem?
+
+  static OptOp GetOp(const std::string & name) {
+    if (name == "Nop") return OptOp::NOP;
+    if (name == "Inc") return OptOp::INC;
+    if (name == "Dec") return OptOp::DEC;
+    if (name == "Not") return OptOp::NOT;
+    if (name == "Add") return OptOp::ADD;
+    if (name == "Sub") return OptOp::SUB;
+    if (name == "Mult") return OptOp::MULT;
+    if (name == "TestEqu") return OptOp::TEST_EQU;
+    if (name == "TestNEqu") return OptOp::TEST_NEQU;
+    if (name == "TestLess") return OptOp::TEST_LESS;
+    if (name == "SetMem") return OptOp::SET_MEM;
+    if (name == "CopyMem") return OptOp::COPY_MEM;
+    if (name == "SwapMem") return OptOp::SWAP_MEM;
+    if (name == "GetRoleID" || name == "GetXLoc" || name == "GetYLoc") return OptOp::GET_TRAIT;
+    if (name == "SetRoleID") return OptOp::SET_ROLE_ID;
+    return OptOp::BARRIER;
+  }
+
+  /// Registers inst reads and writes (as argument positions).
+  static void GetArgUse(OptOp op, emp::vector<size_t> & reads, emp::vector<size_t> & writes) {
+    reads.clear();
+    writes.clear();
+    switch (op) {
+      case OptOp::INC: case OptOp::DEC: case OptOp::NOT: reads = {0}; writes = {0}; break;
+      case OptOp::ADD: case OptOp::SUB: case OptOp::MULT:
+      case OptOp::TEST_EQU: case OptOp::TEST_NEQU: case OptOp::TEST_LESS: reads = {0, 1}; writes = {2}; break;
+      case OptOp::SET_MEM: case OptOp::GET_TRAIT: writes = {0}; break;
+      case OptOp::COPY_MEM: reads = {0}; writes = {1}; break;
+      case OptOp::SWAP_MEM: reads = {0, 1}; writes = {0, 1}; break;
+      case OptOp::SET_ROLE_ID: reads = {0}; break;
+      default: break;
+    }
+  }
+
+  /// What we know about inst: its op (BARRIER if it uses a register outside of [0, NUM_REGS)).
+  OptOp Classify(const inst_t & inst, emp::vector<size_t> & reads, emp::vector<size_t> & writes) const {
+    const OptOp op = inst.id < ops.size() ? ops[inst.id] : OptOp::BARRIER;
+    GetArgUse(op, reads, writes);
+    for (const emp::vector<size_t> * use : {&reads, &writes}) {
+      for (size_t arg : *use) {
+        if (inst.args[arg] < 0 || (size_t)inst.args[arg] >= NUM_REGS) return OptOp::BARRIER;
+      }
+    }
+    return op;
+  }
+
+  /// Value (of known register values vals) op writes to its (only) output register.
+  static double Compute(OptOp op, const inst_t & inst, const emp::vector<double> & vals) {
+    const double a = vals[(size_t)inst.args[0]];
+    const double b = (op == OptOp::INC || op == OptOp::DEC || op == OptOp::NOT) ? 0.0 : vals[(size_t)inst.args[1]];
+    switch (op) {
+      case OptOp::INC: return a + 1.0;
+      case OptOp::DEC: return a - 1.0;
+      case OptOp::NOT: return a == 0.0;
+      case OptOp::ADD: return a + b;
+      case OptOp::SUB: return a - b;
+      case OptOp::MULT: return a * b;
+      case OptOp::TEST_EQU: return a == b;
+      case OptOp::TEST_NEQU: return a != b;
+      case OptOp::TEST_LESS: return a < b;
+      default: break;
+    }
+    emp_assert(false);
+    return 0.0;
+  }
+
+  /// Fold instructions with known constant results of fun into SetMem.
+  void FoldConstants(emp::vector<inst_t> & fun, OptimizeReport & report) const {
+    reg_set_t known;
+    emp::vector<double> vals(NUM_REGS, 0.0);
+    emp::vector<size_t> reads, writes;
+    for (inst_t & inst : fun) {
+      const OptOp op = Classify(inst, reads, writes);
+      switch (op) {
+        case OptOp::BARRIER: known.reset(); break;
+        case OptOp::NOP: case OptOp::SET_ROLE_ID: break;
+        case OptOp::SET_MEM: known.set((size_t)inst.args[0]); vals[(size_t)inst.args[0]] = inst.args[1]; break;
+        case OptOp::GET_TRAIT: known.reset((size_t)inst.args[0]); break;
+        case OptOp::COPY_MEM:
+          known[(size_t)inst.args[1]] = known[(size_t)inst.args[0]];
+          vals[(size_t)inst.args[1]] = vals[(size_t)inst.args[0]];
+          break;
+        case OptOp::SWAP_MEM: {
+          const size_t r0 = (size_t)inst.args[0], r1 = (size_t)inst.args[1];
+          const bool known0 = known[r0];
+          known[r0] = known[r1];
+          known[r1] = known0;
+          std::swap(vals[r0], vals[r1]);
+          break;
+        }
+        default: {
+          const size_t out = (size_t)inst.args[writes[0]];
+          bool all_known = true;
+          for (size_t arg : reads) all_known = all_known && known[(size_t)inst.args[arg]];
+          if (!all_known) { known.reset(out); break; }
+          const double val = Compute(op, inst, vals);
+          known.set(out);
+          vals[out] = val;
+          // Only integers that fit an argument can be SetMem'd (and not -0, which SetMem can't make).
+          if (!(val >= (double)INT_MIN && val <= (double)INT_MAX) || val != std::floor(val) || (val == 0.0 && std::signbit(val))) break;
+          inst.id = set_mem_id;
+          inst.args[0] = (int)out;
+          inst.args[1] = (int)val;
+          inst.args[2] = 0;
+          ++report.folded;
+        }
+      }
+    }
+  }
+
+  /// Mark instructions of fun that are dead (see above).
+  void FindDead(const emp::vector<inst_t> & fun, emp::vector<bool> & dead) const {
+    dead.assign(fun.size(), false);
+    reg_set_t live;
+    live.set();
+    emp::vector<size_t> reads, writes;
+    for (size_t i = fun.size(); i-- > 0; ) {
+      const inst_t & inst = fun[i];
+      const OptOp op = Classify(inst, reads, writes);
+      if (op == OptOp::BARRIER) { live.set(); continue; }
+      if (op == OptOp::NOP) continue;
+      bool is_dead = (op != OptOp::SET_ROLE_ID);
+      for (size_t arg : writes) is_dead = is_dead && !live[(size_t)inst.args[arg]];
+      if ((op == OptOp::COPY_MEM || op == OptOp::SWAP_MEM) && inst.args[0] == inst.args[1]) is_dead = true;
+      if (is_dead) { dead[i] = true; continue; }
+      for (size_t arg : writes) live.reset((size_t)inst.args[arg]);
+      for (size_t arg : reads) live.set((size_t)inst.args[arg]);
+    }
+  }
+
+  size_t CountWork(const emp::vector<inst_t> & fun) const {
+    size_t work = 0;
+    for (const inst_t & inst : fun) if (!enabled || inst.id != nop_id) ++work;
+    return work;
+  }
+
+public:
+  ProgramOptimizer(const inst_lib_t & inst_lib)
+    : ops(inst_lib.GetSize()), nop_id(0), set_mem_id(0), enabled(false) {
+    bool has_nop = false, has_set_mem = false;
+    for (size_t id = 0; id < inst_lib.GetSize(); ++id) {
+      ops[id] = GetOp(inst_lib.GetName(id));
+      if (ops[id] == OptOp::NOP && !has_nop) { nop_id = id; has_nop = true; }
+      if (ops[id] == OptOp::SET_MEM && !has_set_mem) { set_mem_id = id; has_set_mem = true; }
+    }
+    enabled = has_nop && has_set_mem;
+  }
+
+  /// Optimized copy of prog (built on the instruction library we were). report (optional) says what changed.
+  program_t Optimize(const program_t & prog, ProgramOptLevel level, OptimizeReport * report=nullptr) const {
+    OptimizeReport local_report;
+    OptimizeReport & rep = report ? *report : local_report;
+    rep = OptimizeReport();
+    program_t opt_prog(prog);
+    emp::vector<bool> dead;
+    for (size_t fID = 0; fID < opt_prog.GetSize(); ++fID) {
+      emp::vector<inst_t> & fun = opt_prog[fID].inst_seq;
+      rep.inst_cnt_before += fun.size();
+      rep.work_before += CountWork(fun);
+      if (enabled && level != ProgramOptLevel::NONE) {
+        FoldConstants(fun, rep);
+        FindDead(fun, dead);
+        for (bool is_dead : dead) if (is_dead) ++rep.dead;
+        if (level == ProgramOptLevel::TIMING) {
+          for (size_t i = 0; i < fun.size(); ++i) {
+            if (dead[i]) { fun[i].id = nop_id; fun[i].args.fill(0); }
+          }
+        } else {
+          size_t kept = 0;
+          for (size_t i = 0; i < fun.size(); ++i) {
+            if (!dead[i] && fun[i].id != nop_id) fun[kept++] = fun[i];
+          }
+          fun.resize(kept);
+        }
+      }
+      rep.inst_cnt_after += fun.size();
+      rep.work_after += CountWork(fun);
+    }
+    return opt_prog;
+  }
+};
+
+#endif
@@ -0,0 +1,44 @@
+/*
+  deme/RandomProgram.h
+*/
+
+#ifndef LSVIS_RANDOM_PROGRAM_H
+#define LSVIS_RANDOM_PROGRAM_H
+
+#include "base/Ptr.h"
+#include "base/vector.h"
+#include "tools/Random.h"
+
+#include "Deme.h"
+
+/// Random affinity (each byte drawn uniformly).
+inline affinity_t GenRandomAffinity(emp::Random & rnd) {
+  affinity_t aff;
+  for (size_t byte = 0; byte < aff.GetSize() / 8; ++byte) aff.SetByte(byte, (uint8_t)rnd.GetUInt(256));
+  return aff;
+}
+
+/// Generate a random program: num_funs functions of fun_len instructions each, with opcodes drawn uniformly from
+/// inst_ids and arguments uniformly from [0, CPU_SIZE). Deterministic given rnd's seed.
+inline program_t GenRandomProgram(emp::Random & rnd, emp::Ptr<inst_lib_t> inst_lib, size_t num_funs, size_t fun_len,
+                                  const emp::vector<size_t> & inst_ids) {
+  program_t prog(inst_lib);
+  for (size_t fID = 0; fID < num_funs; ++fID) {
+    prog.PushFunction(fun_t(GenRandomAffinity(rnd)));
+    for (size_t iID = 0; iID < fun_len; ++iID) {
+      prog.PushInst(inst_ids[rnd.GetUInt((uint32_t)inst_ids.size())],
+                    rnd.GetInt((int)CPU_SIZE), rnd.GetInt((int)CPU_SIZE), rnd.GetInt((int)CPU_SIZE),
+                    GenRandomAffinity(rnd));
+    }
+  }
+  return prog;
+}
+
+/// GenRandomProgram over every instruction in inst_lib.
+inline program_t GenRandomProgram(emp::Random & rnd, emp::Ptr<inst_lib_t> inst_lib, size_t num_funs, size_t fun_len) {
+  emp::vector<size_t> inst_ids(inst_lib->GetSize());
+  for (size_t id = 0; id < inst_ids.size(); ++id) inst_ids[id] = id;
+  return GenRandomProgram(rnd, inst_lib, num_funs, fun_len, inst_ids);
+}
+
+#endif
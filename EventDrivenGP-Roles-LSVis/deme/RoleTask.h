@@ -0,0 +1,73 @@
+/*
+  deme/RoleTask.h
+*/
+
+#ifndef LSVIS_ROLE_TASK_H
+#define LSVIS_ROLE_TASK_H
+
+#include "base/Ptr.h"
+#include "base/vector.h"
+#include "hardware/EventDrivenGP.h"
+
+#include "Deme.h"
+
+// Some extra instructions for this experiment. Run in a deme, they use the deme's trait arrays (see
+// DemeTraits.h); otherwise they fall back on the hardware's own traits.
+inline void Inst_GetRoleID(emp::EventDrivenGP & hw, const inst_t & inst) {
+  state_t & state = *hw.GetCurState();
+  const ActiveCell & cell = GetActiveCell();
+  state.SetLocal(inst.args[0], cell.traits ? cell.traits->role_id[cell.id] : hw.GetTrait(TRAIT_ID__ROLE_ID));
+}
+
+inline void Inst_SetRoleID(emp::EventDrivenGP & hw, const inst_t & inst) {
+  state_t & state = *hw.GetCurState();
+  const ActiveCell & cell = GetActiveCell();
+  const int role_id = (int)state.AccessLocal(inst.args[0]);
+  if (cell.traits) cell.traits->SetRoleID(cell.id, role_id);
+  else hw.SetTrait(TRAIT_ID__ROLE_ID, role_id);
+}
+
+inline void Inst_GetXLoc(emp::EventDrivenGP & hw, const inst_t & inst) {
+  state_t & state = *hw.GetCurState();
+  const ActiveCell & cell = GetActiveCell();
+  state.SetLocal(inst.args[0], cell.traits ? cell.traits->x_loc[cell.id] : hw.GetTrait(TRAIT_ID__X_LOC));
+}
+
+inline void Inst_GetYLoc(emp::EventDrivenGP & hw, const inst_t & inst) {
+  state_t & state = *hw.GetCurState();
+  const ActiveCell & cell = GetActiveCell();
+  state.SetLocal(inst.args[0], cell.traits ? cell.traits->y_loc[cell.id] : hw.GetTrait(TRAIT_ID__Y_LOC));
+}
+
+/// Add the role-ID task instructions to an instruction library.
+inline void AddRoleInstructions(inst_lib_t & inst_lib) {
+  inst_lib.AddInst("GetRoleID", Inst_GetRoleID, 1, "Local memory[Arg1] = Trait[RoleID]");
+  inst_lib.AddInst("SetRoleID", Inst_SetRoleID, 1, "Trait[RoleID] = Local memory[Arg1]");
+  inst_lib.AddInst("GetXLoc", Inst_GetXLoc, 1, "Local memory[Arg1] = Trait[XLoc]");
+  inst_lib.AddInst("GetYLoc", Inst_GetYLoc, 1, "Local memory[Arg1] = Trait[YLoc]");
+}
+
+/// Role-ID fitness: number of cells with a valid ID, plus the number of unique valid IDs
+/// once every cell has one. O(1): the deme keeps these counts up to date as role IDs change.
+template<typename DEME_T>
+double RoleIDFitness(DEME_T * deme) {
+  if (deme == nullptr) { return 0.0; }
+  const size_t valid_id_cnt = deme->traits.GetValidIDCount();
+  if (valid_id_cnt < deme->traits.GetSize()) return (double)valid_id_cnt;
+  return (double)(valid_id_cnt + deme->traits.GetUniqueIDCount());
+}
+
+/// Load agent into deme, run deme for eval_time updates, and return the deme's role-ID fitness.
+/// If given fitness_curve, the deme's fitness after each update is appended to it.
+template<typename DEME_T>
+double EvaluateAgent(DEME_T & deme, emp::Ptr<Agent> agent, size_t eval_time=EVAL_TIME,
+                     emp::Ptr<emp::vector<double>> fitness_curve=nullptr) {
+  deme.LoadAgent(agent);
+  for (size_t t = 0; t < eval_time; ++t) {
+    deme.SingleAdvance();
+    if (fitness_curve) fitness_curve->emplace_back(RoleIDFitness(&deme));
+  }
+  return RoleIDFitness(&deme);
+}
+
+#endif
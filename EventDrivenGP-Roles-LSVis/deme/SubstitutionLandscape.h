@@ -0,0 +1,251 @@
+/*
+  deme/SubstitutionLandscape.h
+*/
+
+#ifndef LSVIS_SUBSTITUTION_LANDSCAPE_H
+#define LSVIS_SUBSTITUTION_LANDSCAPE_H
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "base/Ptr.h"
+#include "base/vector.h"
+
+#include "Deme.h"
+#include "Landscape.h"
+
+/// Fitness of programs that have already been evaluated, keyed by program contents, so that repeated
+/// and overlapping landscapes don't evaluate the same program twice. Results are only good for one
+/// evaluation setup (deme settings, knockouts, seed, ...); SetContext clears the cache when that changes.
+class LandscapeCache {
+protected:
+  std::unordered_map<uint64_t, double> fitness_map;
+  std::string context;
+  size_t hits;
+  size_t misses;
+
+  static void HashIn(uint64_t & hash, uint64_t val) {
+    // FNV-1a, a byte at a time.
+    for (size_t i = 0; i < 8; ++i) {
+      hash ^= (val >> (8 * i)) & 0xff;
+      hash *= 1099511628211ull;
+    }
+  }
+
+  static void HashIn(uint64_t & hash, const affinity_t & affinity) {
+    for (size_t i = 0; i < (affinity.GetSize() + 7) / 8; ++i) HashIn(hash, affinity.GetByte(i));
+  }
+
+public:
+  LandscapeCache() : fitness_map(), context(), hits(0), misses(0) { ; }
+
+  static uint64_t Hash(const program_t & prog) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t fID = 0; fID < prog.GetSize(); ++fID) {
+      HashIn(hash, prog[fID].GetSize());
+      HashIn(hash, prog[fID].affinity);
+      for (const inst_t & inst : prog[fID].inst_seq) {
+        HashIn(hash, inst.id);
+        for (size_t i = 0; i < MAX_INST_ARGS; ++i) HashIn(hash, (uint64_t)(int64_t)inst.args[i]);
+        HashIn(hash, inst.affinity);
+      }
+    }
+    return hash;
+  }
+
+  size_t GetSize() const { return fitness_map.size(); }
+  size_t GetHits() const { return hits; }
+  size_t GetMisses() const { return misses; }
+
+  /// Use the cache for evaluations under _context (any string that identifies the setup).
+  void SetContext(const std::string & _context) {
+    if (_context != context) Clear();
+    context = _context;
+  }
+
+  void Clear() { fitness_map.clear(); hits = 0; misses = 0; }
+
+  bool Get(uint64_t key, double & fitness) {
+    auto it = fitness_map.find(key);
+    if (it == fitness_map.end()) { ++misses; return false; }
+    ++hits;
+    fitness = it->second;
+    return true;
+  }
+
+  void Set(uint64_t key, double fitness) { fitness_map[key] = fitness; }
+};
+
+/// Results of a full single-point mutational landscape: one row per program position (program order),
+/// one column per mutation. Columns: substitution by each opcode in the instruction library (arguments and
+/// affinity kept), then each argument moved down and up by one (wrapping in [0, CPU_SIZE)).
+/// Entries are NaN where there's no mutation (the instruction's own opcode; arguments it doesn't use).
+///
+/// Binary format (host byte order):
+///   "LSSM" <uint32 version> <uint32 rows> <uint32 opcode columns> <uint32 argument columns> <float64 base fitness>
+///   <uint32 fID> <uint32 iID>   (each row)
+///   <float32 fitness>           (rows * columns, row-major)
+struct SubstitutionMatrix {
+  static constexpr uint32_t VERSION = 1;
+
+  double base_fitness;
+  size_t num_ops;
+  emp::vector<std::pair<size_t, size_t>> positions;
+  emp::vector<float> fitness;
+
+  SubstitutionMatrix(size_t _num_ops=0) : base_fitness(0.0), num_ops(_num_ops), positions(), fitness() { ; }
+
+  /// Mutation summary of one position (fitness over every mutation there).
+  struct Summary {
+    double mean;
+    double min;
+    double max;
+    size_t count;
+  };
+
+  size_t GetNumRows() const { return positions.size(); }
+  size_t GetNumCols() const { return num_ops + 2 * MAX_INST_ARGS; }
+  size_t GetOpCol(size_t op) const { return op; }
+  size_t GetArgCol(size_t arg, bool up) const { return num_ops + 2 * arg + (up ? 1 : 0); }
+
+  float Get(size_t row, size_t col) const { return fitness[row * GetNumCols() + col]; }
+
+  Summary GetSummary(size_t row) const {
+    Summary summary{0.0, 0.0, 0.0, 0};
+    for (size_t col = 0; col < GetNumCols(); ++col) {
+      const float val = Get(row, col);
+      if (std::isnan(val)) continue;
+      if (!summary.count || val < summary.min) summary.min = val;
+      if (!summary.count || val > summary.max) summary.max = val;
+      summary.mean += val;
+      ++summary.count;
+    }
+    if (summary.count) summary.mean /= (double)summary.count;
+    return summary;
+  }
+
+  void Write(std::ostream & os) const {
+    auto write_u32 = [&os](uint32_t val) { os.write((const char *)&val, sizeof(val)); };
+    os.write("LSSM", 4);
+    write_u32(VERSION);
+    write_u32((uint32_t)GetNumRows());
+    write_u32((uint32_t)num_ops);
+    write_u32((uint32_t)(2 * MAX_INST_ARGS));
+    os.write((const char *)&base_fitness, sizeof(base_fitness));
+    for (const auto & pos : positions) { write_u32((uint32_t)pos.first); write_u32((uint32_t)pos.second); }
+    os.write((const char *)fitness.data(), (std::streamsize)(fitness.size() * sizeof(float)));
+  }
+
+  /// Returns false (leaving an empty matrix) if is doesn't hold a matrix written by this build.
+  bool Read(std::istream & is) {
+    auto read_u32 = [&is](uint32_t & val) { return (bool)is.read((char *)&val, sizeof(val)); };
+    char magic[4];
+    uint32_t version, rows, ops, arg_cols;
+    positions.clear();
+    fitness.clear();
+    if (!is.read(magic, 4) || std::string(magic, 4) != "LSSM") return false;
+    if (!read_u32(version) || version != VERSION || !read_u32(rows) || !read_u32(ops) || !read_u32(arg_cols)) return false;
+    if (arg_cols != 2 * MAX_INST_ARGS || !is.read((char *)&base_fitness, sizeof(base_fitness))) return false;
+    num_ops = ops;
+    positions.resize(rows);
+    for (auto & pos : positions) {
+      uint32_t fID, iID;
+      if (!read_u32(fID) || !read_u32(iID)) { positions.clear(); return false; }
+      pos = std::make_pair(fID, iID);
+    }
+    fitness.resize(rows * GetNumCols());
+    if (!is.read((char *)fitness.data(), (std::streamsize)(fitness.size() * sizeof(float)))) {
+      positions.clear();
+      fitness.clear();
+      return false;
+    }
+    return true;
+  }
+};
+
+/// Full single-point mutational landscape of base_prog (see SubstitutionMatrix for the mutations tried).
+/// Mutants are evaluated with eval_program, spread over demes as in RunDemeJobs; every evaluation reseeds
+/// its deme's random number generator with seed, so each mutant's fitness depends only on the mutant.
+/// Mutants already in cache (and duplicate mutants) aren't re-evaluated; new results are added to cache.
+/// With batch, mutants it can run are evaluated there (see RunProgramJobs).
+inline SubstitutionMatrix SubstitutionLandscape(const program_t & base_prog,
+                                                const emp::vector<emp::Ptr<Deme>> & demes,
+                                                const std::function<double(Deme &, const program_t &)> & eval_program,
+                                                int seed, LandscapeCache & cache,
+                                                emp::Ptr<BatchEvaluator> batch=nullptr) {
+  const inst_lib_t & inst_lib = *base_prog.inst_lib;
+  SubstitutionMatrix matrix(inst_lib.GetSize());
+  const size_t num_cols = matrix.GetNumCols();
+  for (size_t fID = 0; fID < base_prog.GetSize(); ++fID)
+    for (size_t iID = 0; iID < base_prog[fID].GetSize(); ++iID) matrix.positions.emplace_back(fID, iID);
+  matrix.fitness.resize(matrix.GetNumRows() * num_cols, std::numeric_limits<float>::quiet_NaN());
+
+  // Each distinct, uncached mutant (and the base program) becomes a job; entries waiting on a job list it.
+  struct Job {
+    std::pair<size_t, size_t> pos;
+    inst_t inst;
+    uint64_t key;
+  };
+  emp::vector<Job> jobs;
+  std::unordered_map<uint64_t, size_t> job_ids;
+  emp::vector<std::pair<size_t, size_t>> pending;   // (matrix entry, job).
+  const size_t base_entry = matrix.fitness.size();  // Stands in for base fitness.
+  auto set_entry = [&matrix, base_entry](size_t entry, double fitness) {
+    if (entry == base_entry) matrix.base_fitness = fitness;
+    else matrix.fitness[entry] = (float)fitness;
+  };
+  program_t mutant(base_prog);
+  auto add_mutant = [&](size_t entry, size_t fID, size_t iID, const inst_t & inst) {
+    mutant.SetInst(fID, iID, inst);
+    const uint64_t key = LandscapeCache::Hash(mutant);
+    mutant.SetInst(fID, iID, base_prog[fID].inst_seq[iID]);
+    double fitness;
+    if (job_ids.count(key)) pending.emplace_back(entry, job_ids[key]);
+    else if (cache.Get(key, fitness)) set_entry(entry, fitness);
+    else {
+      job_ids[key] = jobs.size();
+      pending.emplace_back(entry, jobs.size());
+      jobs.push_back(Job{std::make_pair(fID, iID), inst, key});
+    }
+  };
+  if (matrix.GetNumRows()) add_mutant(base_entry, 0, 0, base_prog[0].inst_seq[0]);
+  for (size_t row = 0; row < matrix.GetNumRows(); ++row) {
+    const size_t fID = matrix.positions[row].first;
+    const size_t iID = matrix.positions[row].second;
+    const inst_t & base_inst = base_prog[fID].inst_seq[iID];
+    for (size_t op = 0; op < inst_lib.GetSize(); ++op) {
+      if (op == base_inst.id) continue;
+      inst_t inst(base_inst);
+      inst.id = op;
+      add_mutant(row * num_cols + matrix.GetOpCol(op), fID, iID, inst);
+    }
+    for (size_t arg = 0; arg < inst_lib.GetNumArgs(base_inst.id) && arg < MAX_INST_ARGS; ++arg) {
+      for (bool up : {false, true}) {
+        inst_t inst(base_inst);
+        inst.args[arg] = (int)(((size_t)inst.args[arg] + (up ? 1 : CPU_SIZE - 1)) % CPU_SIZE);
+        add_mutant(row * num_cols + matrix.GetArgCol(arg, up), fID, iID, inst);
+      }
+    }
+  }
+
+  emp::vector<double> job_fitness(jobs.size(), 0.0);
+  auto get_program = [&](size_t j) {
+    program_t job_prog(base_prog);
+    job_prog.SetInst(jobs[j].pos.first, jobs[j].pos.second, jobs[j].inst);
+    return job_prog;
+  };
+  RunProgramJobs(demes, jobs.size(), get_program, [&](Deme & deme, size_t j) {
+    deme.rnd->ResetSeed(seed);
+    return eval_program(deme, get_program(j));
+  }, batch, [&job_fitness](size_t j, double fitness) { job_fitness[j] = fitness; });
+  for (size_t j = 0; j < jobs.size(); ++j) cache.Set(jobs[j].key, job_fitness[j]);
+  for (const auto & wait : pending) set_entry(wait.first, job_fitness[wait.second]);
+  return matrix;
+}
+
+#endif
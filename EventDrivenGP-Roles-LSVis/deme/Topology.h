@@ -0,0 +1,336 @@
+/*
+  deme/Topology.h
+*/
+
+#ifndef LSVIS_TOPOLOGY_H
+#define LSVIS_TOPOLOGY_H
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include "base/vector.h"
+#include "tools/assert.h"
+#include "tools/math.h"
+#include "tools/Random.h"
+
+/// Which cells of a deme can message which, in compressed sparse row form: the neighbors of cell id are
+/// adjacency[offsets[id]] through adjacency[offsets[id+1] - 1]. Built once; dispatching to (or picking
+/// from) a cell's neighbors is a walk over a contiguous slice of adjacency.
+/// Broadcasts go to every neighbor. Sends go to a random neighbor, unless the topology has its own send
+/// candidates (same form, in send_offsets/send_adjacency): then to a random one of those.
+class Topology {
+protected:
+  emp::vector<size_t> offsets;    // Size: number of cells + 1.
+  emp::vector<size_t> adjacency;
+  emp::vector<size_t> send_offsets;   // Empty => sends pick from neighbors.
+  emp::vector<size_t> send_adjacency; // May include the sender and repeats (which weight the pick).
+
+public:
+  Topology() : offsets(1, 0), adjacency(), send_offsets(), send_adjacency() { ; }
+
+  /// Topology a width x height deme starts out with (see BuildDefaultTorus).
+  static Topology Default(size_t width, size_t height);
+
+  /// Build from per-cell neighbor lists. Self-loops and repeated neighbors are dropped.
+  Topology(const emp::vector<emp::vector<size_t>> & neighbors)
+    : offsets(neighbors.size() + 1, 0), adjacency(), send_offsets(), send_adjacency() {
+    for (size_t id = 0; id < neighbors.size(); ++id) {
+      offsets[id] = adjacency.size();
+      for (size_t nID : neighbors[id]) {
+        emp_assert(nID < neighbors.size());
+        if (nID == id) continue;
+        if (std::find(adjacency.begin() + offsets[id], adjacency.end(), nID) != adjacency.end()) continue;
+        adjacency.emplace_back(nID);
+      }
+    }
+    offsets[neighbors.size()] = adjacency.size();
+  }
+
+  /// Build from per-cell neighbor lists and per-cell send candidates (kept as given).
+  Topology(const emp::vector<emp::vector<size_t>> & neighbors, const emp::vector<emp::vector<size_t>> & send_candidates)
+    : Topology(neighbors) {
+    emp_assert(send_candidates.size() == neighbors.size());
+    send_offsets.resize(send_candidates.size() + 1);
+    for (size_t id = 0; id < send_candidates.size(); ++id) {
+      send_offsets[id] = send_adjacency.size();
+      for (size_t nID : send_candidates[id]) {
+        emp_assert(nID < send_candidates.size());
+        send_adjacency.emplace_back(nID);
+      }
+    }
+    send_offsets[send_candidates.size()] = send_adjacency.size();
+  }
+
+  size_t GetSize() const { return offsets.size() - 1; }
+  size_t GetDegree(size_t id) const { return offsets[id + 1] - offsets[id]; }
+  size_t GetNeighbor(size_t id, size_t i) const { return adjacency[offsets[id] + i]; }
+  const emp::vector<size_t> & GetOffsets() const { return offsets; }
+  const emp::vector<size_t> & GetAdjacency() const { return adjacency; }
+
+  /// Call fun(neighbor id) for each of id's neighbors.
+  template<typename FUN>
+  void ForEachNeighbor(size_t id, FUN fun) const {
+    for (size_t i = offsets[id]; i < offsets[id + 1]; ++i) fun(adjacency[i]);
+  }
+
+  bool HasSendCandidates() const { return send_offsets.size(); }
+
+  /// Where a send from id goes: a uniformly random send candidate (or neighbor, without candidates) of id
+  /// (id itself if it has none).
+  size_t GetRandomNeighbor(size_t id, emp::Random & rnd) const {
+    const emp::vector<size_t> & pick_offsets = HasSendCandidates() ? send_offsets : offsets;
+    const emp::vector<size_t> & pick_adjacency = HasSendCandidates() ? send_adjacency : adjacency;
+    const size_t num_candidates = pick_offsets[id + 1] - pick_offsets[id];
+    if (!num_candidates) return id;
+    return pick_adjacency[pick_offsets[id] + rnd.GetUInt((uint32_t)num_candidates)];
+  }
+
+  /// Text form: 'topology <num cells>' followed by one line of neighbor ids per cell; with send candidates,
+  /// each line goes on with '|' and the cell's send candidates.
+  void Write(std::ostream & os) const {
+    os << "topology " << GetSize() << "\n";
+    for (size_t id = 0; id < GetSize(); ++id) {
+      for (size_t i = offsets[id]; i < offsets[id + 1]; ++i) os << (i == offsets[id] ? "" : " ") << adjacency[i];
+      if (HasSendCandidates()) {
+        os << (GetDegree(id) ? " |" : "|");
+        for (size_t i = send_offsets[id]; i < send_offsets[id + 1]; ++i) os << " " << send_adjacency[i];
+      }
+      os << "\n";
+    }
+  }
+};
+
+/// Topologies demes can be built with.
+enum class TopologyType {
+  DEFAULT,         // Original deme: broadcast to 4 neighbors, send to any of the 3x3 block (sender included).
+  VON_NEUMANN,     // 4-neighbor torus.
+  MOORE,           // 8-neighbor torus.
+  HEX,             // 6-neighbor torus (odd rows shifted right; wraps cleanly when height is even).
+  SMALL_WORLD,     // 4-neighbor torus with each edge rewired with probability param (Watts-Strogatz).
+  RANDOM_REGULAR   // Random graph with every cell having degree param.
+};
+
+inline std::string TopologyName(TopologyType type) {
+  switch (type) {
+    case TopologyType::DEFAULT: return "default";
+    case TopologyType::VON_NEUMANN: return "von_neumann";
+    case TopologyType::MOORE: return "moore";
+    case TopologyType::HEX: return "hex";
+    case TopologyType::SMALL_WORLD: return "small_world";
+    case TopologyType::RANDOM_REGULAR: return "random_regular";
+  }
+  return "";
+}
+
+/// Returns false (leaving type alone) if name isn't a topology.
+inline bool ParseTopologyType(const std::string & name, TopologyType & type) {
+  if (name == "default") type = TopologyType::DEFAULT;
+  else if (name == "von_neumann") type = TopologyType::VON_NEUMANN;
+  else if (name == "moore") type = TopologyType::MOORE;
+  else if (name == "hex") type = TopologyType::HEX;
+  else if (name == "small_world") type = TopologyType::SMALL_WORLD;
+  else if (name == "random_regular") type = TopologyType::RANDOM_REGULAR;
+  else return false;
+  return true;
+}
+
+/// Cells at the given (dx, dy) offsets from each cell (x, y) of a width x height torus, in offset order.
+inline emp::vector<emp::vector<size_t>> TorusNeighbors(size_t width, size_t height,
+                                                       const emp::vector<std::pair<int, int>> & offsets) {
+  emp::vector<emp::vector<size_t>> neighbors(width * height);
+  for (size_t id = 0; id < neighbors.size(); ++id) {
+    const int x = (int)(id % width);
+    const int y = (int)(id / width);
+    for (const auto & offset : offsets) {
+      neighbors[id].emplace_back((size_t)emp::Mod(x + offset.first, (int)width)
+                                 + (size_t)emp::Mod(y + offset.second, (int)height) * width);
+    }
+  }
+  return neighbors;
+}
+
+/// Torus where cell (x, y)'s neighbors are at the given (dx, dy) offsets.
+inline Topology BuildTorus(size_t width, size_t height, const emp::vector<std::pair<int, int>> & offsets) {
+  return Topology(TorusNeighbors(width, height, offsets));
+}
+
+inline Topology BuildVonNeumannTorus(size_t width, size_t height) {
+  return BuildTorus(width, height, {{-1, 0}, {1, 0}, {0, -1}, {0, 1}});
+}
+
+/// The original deme's messaging: broadcasts go to the 4 neighbors of a torus, sends to a random cell of
+/// the 3x3 block around the sender (the sender included).
+inline Topology BuildDefaultTorus(size_t width, size_t height) {
+  return Topology(TorusNeighbors(width, height, {{-1, 0}, {1, 0}, {0, -1}, {0, 1}}),
+                  TorusNeighbors(width, height, {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {0, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}}));
+}
+
+inline Topology Topology::Default(size_t width, size_t height) { return BuildDefaultTorus(width, height); }
+
+/// Default topology (see BuildDefaultTorus) of a W x H torus with its dimensions fixed at compile time:
+/// neighbors (and wraparound) are computed from constants rather than looked up. Same interface as
+/// Topology, in the same neighbor and send candidate order as BuildDefaultTorus; use with Deme_t (see
+/// FixedDeme in Deme.h).
+template<size_t W, size_t H>
+struct FixedTorus {
+  static_assert(W >= 3 && H >= 3, "FixedTorus needs distinct neighbors on each side.");
+  static constexpr size_t WIDTH = W;
+  static constexpr size_t HEIGHT = H;
+  static constexpr size_t DEGREE = 4;
+
+  static FixedTorus Default(size_t width, size_t height) {
+    emp_assert(width == W && height == H);
+    return FixedTorus();
+  }
+
+  static constexpr size_t GetSize() { return W * H; }
+  static constexpr size_t GetDegree(size_t) { return DEGREE; }
+
+  static constexpr size_t GetNeighbor(size_t id, size_t i) {
+    const size_t x = id % W;
+    const size_t y = id / W;
+    switch (i) {
+      case 0: return x ? id - 1 : id + (W - 1);                 // Left
+      case 1: return (x + 1 < W) ? id + 1 : id - (W - 1);       // Right
+      case 2: return y ? id - W : id + (H - 1) * W;             // Up
+      default: return (y + 1 < H) ? id + W : id - (H - 1) * W;  // Down
+    }
+  }
+
+  template<typename FUN>
+  static void ForEachNeighbor(size_t id, FUN fun) {
+    for (size_t i = 0; i < DEGREE; ++i) fun(GetNeighbor(id, i));
+  }
+
+  /// Random cell of the 3x3 block around id (id included).
+  static size_t GetRandomNeighbor(size_t id, emp::Random & rnd) {
+    const size_t offset = rnd.GetUInt(9);
+    const size_t x = (id % W + W + offset % 3 - 1) % W;
+    const size_t y = (id / W + H + offset / 3 - 1) % H;
+    return x + y * W;
+  }
+};
+
+inline Topology BuildMooreTorus(size_t width, size_t height) {
+  return BuildTorus(width, height, {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}});
+}
+
+inline Topology BuildHexTorus(size_t width, size_t height) {
+  emp::vector<emp::vector<size_t>> neighbors(width * height);
+  for (size_t id = 0; id < neighbors.size(); ++id) {
+    const int x = (int)(id % width);
+    const int y = (int)(id / width);
+    // Odd rows are shifted half a cell right.
+    const int shift = (y % 2) ? 0 : -1;
+    const emp::vector<std::pair<int, int>> offsets = {{-1, 0}, {1, 0}, {shift, -1}, {shift + 1, -1}, {shift, 1}, {shift + 1, 1}};
+    for (const auto & offset : offsets) {
+      neighbors[id].emplace_back((size_t)emp::Mod(x + offset.first, (int)width)
+                                 + (size_t)emp::Mod(y + offset.second, (int)height) * width);
+    }
+  }
+  return Topology(neighbors);
+}
+
+/// Watts-Strogatz style small world: start from a 4-neighbor torus and rewire the far end of each edge,
+/// with probability rewire_prob, to a random cell it isn't already connected to.
+inline Topology BuildSmallWorld(size_t width, size_t height, double rewire_prob, emp::Random & rnd) {
+  const size_t num_cells = width * height;
+  emp::vector<std::set<size_t>> neighbors(num_cells);
+  const Topology lattice = BuildVonNeumannTorus(width, height);
+  for (size_t id = 0; id < num_cells; ++id) lattice.ForEachNeighbor(id, [&](size_t nID) { neighbors[id].insert(nID); });
+  for (size_t id = 0; id < num_cells; ++id) {
+    // Consider each lattice edge once (from its lower id end).
+    lattice.ForEachNeighbor(id, [&](size_t nID) {
+      if (nID < id || !rnd.P(rewire_prob)) return;
+      if (neighbors[id].size() + 1 >= num_cells) return; // Nothing to rewire to.
+      size_t new_nID = rnd.GetUInt((uint32_t)num_cells);
+      while (new_nID == id || neighbors[id].count(new_nID)) new_nID = rnd.GetUInt((uint32_t)num_cells);
+      neighbors[id].erase(nID);
+      neighbors[nID].erase(id);
+      neighbors[id].insert(new_nID);
+      neighbors[new_nID].insert(id);
+    });
+  }
+  emp::vector<emp::vector<size_t>> lists(num_cells);
+  for (size_t id = 0; id < num_cells; ++id) lists[id].assign(neighbors[id].begin(), neighbors[id].end());
+  return Topology(lists);
+}
+
+/// Random graph where every cell has exactly degree neighbors (num_cells * degree must be even and
+/// degree < num_cells). Pairs up edge stubs at random, restarting whenever it paints itself into a corner.
+/// Returns an empty topology if the parameters are bad or max_restarts restarts didn't get there.
+inline Topology BuildRandomRegular(size_t num_cells, size_t degree, emp::Random & rnd, size_t max_restarts=1000) {
+  if (degree >= num_cells || (num_cells * degree) % 2) return Topology();
+  emp::vector<std::set<size_t>> neighbors(num_cells);
+  bool done = false;
+  for (size_t restarts = 0; !done; ++restarts) {
+    if (restarts > max_restarts) return Topology();
+    for (auto & cell_neighbors : neighbors) cell_neighbors.clear();
+    emp::vector<size_t> stubs;
+    for (size_t id = 0; id < num_cells; ++id) stubs.insert(stubs.end(), degree, id);
+    done = true;
+    while (stubs.size() > 1) {
+      const size_t id = stubs.back();
+      stubs.pop_back();
+      // Find a partner stub that doesn't make a self-loop or a repeated edge.
+      size_t pick = stubs.size();
+      for (size_t tries = 0; tries < 2 * stubs.size() && pick == stubs.size(); ++tries) {
+        const size_t i = rnd.GetUInt((uint32_t)stubs.size());
+        if (stubs[i] != id && !neighbors[id].count(stubs[i])) pick = i;
+      }
+      if (pick == stubs.size()) { done = false; break; }
+      const size_t nID = stubs[pick];
+      stubs[pick] = stubs.back();
+      stubs.pop_back();
+      neighbors[id].insert(nID);
+      neighbors[nID].insert(id);
+    }
+  }
+  emp::vector<emp::vector<size_t>> lists(num_cells);
+  for (size_t id = 0; id < num_cells; ++id) lists[id].assign(neighbors[id].begin(), neighbors[id].end());
+  return Topology(lists);
+}
+
+/// Build a topology of the given type for a width x height deme. param is the rewire probability
+/// for SMALL_WORLD and the degree for RANDOM_REGULAR (ignored otherwise). Returns an empty topology
+/// (GetSize() == 0) if param doesn't make sense for type; callers should treat that as an error.
+inline Topology BuildTopology(TopologyType type, size_t width, size_t height, emp::Random & rnd, double param=0.0) {
+  switch (type) {
+    case TopologyType::DEFAULT: return BuildDefaultTorus(width, height);
+    case TopologyType::VON_NEUMANN: return BuildVonNeumannTorus(width, height);
+    case TopologyType::MOORE: return BuildMooreTorus(width, height);
+    case TopologyType::HEX: return BuildHexTorus(width, height);
+    case TopologyType::SMALL_WORLD:
+      if (!(param >= 0.0 && param <= 1.0)) return Topology();
+      return BuildSmallWorld(width, height, param, rnd);
+    case TopologyType::RANDOM_REGULAR:
+      if (!(param >= 0.0 && param < (double)(width * height)) || param != (double)(size_t)param) return Topology();
+      return BuildRandomRegular(width * height, (size_t)param, rnd);
+  }
+  return BuildDefaultTorus(width, height);
+}
+
+/// Read a topology written by Topology::Write (after its 'topology <num cells>' line has been read).
+inline Topology ReadTopology(std::istream & is, size_t num_cells) {
+  emp::vector<emp::vector<size_t>> neighbors(num_cells);
+  emp::vector<emp::vector<size_t>> send_candidates(num_cells);
+  bool has_send_candidates = false;
+  std::string line;
+  for (size_t id = 0; id < num_cells && std::getline(is, line); ++id) {
+    const size_t bar = line.find('|');
+    std::istringstream fields(line.substr(0, bar));
+    size_t nID;
+    while (fields >> nID) if (nID < num_cells) neighbors[id].emplace_back(nID);
+    if (bar == std::string::npos) continue;
+    has_send_candidates = true;
+    std::istringstream send_fields(line.substr(bar + 1));
+    while (send_fields >> nID) if (nID < num_cells) send_candidates[id].emplace_back(nID);
+  }
+  if (has_send_candidates) return Topology(neighbors, send_candidates);
+  return Topology(neighbors);
+}
+
+#endif
@@ -0,0 +1,115 @@
+// Headless driver for the LSVis evaluation worker (web/js/EventDrivenGP-Roles-LSVis-worker.js; build with
+// 'make web-worker'). Runs the worker under Node, standing in for the browser's worker scope, and prints
+// its (streamed) responses. With --server, sends the request to a native evaluation server instead
+// (EventDrivenGP-Roles-LSVis-server; build with 'make server'). Batch mode runs every program given.
+//
+// Usage: node node/lsvis_worker_cli.js <program.gp> [more.gp ...] [landscape|cell_landscape|mutation_landscape|evaluate|batch] [--seed N] [--time T] [--size W H] [--ko id,id,...] [--inbox CAP POLICY] [--samples COUNT K] [--hardware default|compact] [--seeds MIN MAX HALF_WIDTH] [--optimize none|timing|fast] [--server unix:PATH|tcp:PORT]
+
+var fs = require("fs");
+var path = require("path");
+var vm = require("vm");
+
+var args = process.argv.slice(2);
+if (args.length < 1) {
+  console.log("Usage: node lsvis_worker_cli.js <program.gp> [more.gp ...] [landscape|cell_landscape|mutation_landscape|evaluate|batch] [--seed N] [--time T] [--size W H] [--ko id,id,...] [--inbox CAP POLICY] [--samples COUNT K] [--hardware default|compact] [--seeds MIN MAX HALF_WIDTH] [--optimize none|timing|fast] [--server unix:PATH|tcp:PORT]");
+  process.exit(1);
+}
+
+var prog_files = [args[0]];
+var mode = "landscape";
+var seed = 1;
+var eval_time = 50;
+var width = 5;
+var height = 5;
+var knockouts = [];
+var inbox = "0 drop_oldest";
+var cell_samples = "0 2";
+var hardware = "";
+var seeds = "";
+var optimize = "";
+var server = "";
+for (var i = 1; i < args.length; i++) {
+  if (args[i] == "landscape" || args[i] == "cell_landscape" || args[i] == "mutation_landscape" || args[i] == "evaluate" || args[i] == "batch") mode = args[i];
+  else if (args[i] == "--seed") seed = parseInt(args[++i]);
+  else if (args[i] == "--time") eval_time = parseInt(args[++i]);
+  else if (args[i] == "--size") { width = parseInt(args[++i]); height = parseInt(args[++i]); }
+  else if (args[i] == "--ko") knockouts = args[++i].split(",");
+  else if (args[i] == "--inbox") { inbox = args[i+1] + " " + args[i+2]; i += 2; }
+  else if (args[i] == "--samples") { cell_samples = args[i+1] + " " + args[i+2]; i += 2; }
+  else if (args[i] == "--hardware") hardware = (args[++i] == "compact") ? "hardware 8 16 0\n" : "";  // See deme/HardwareProfile.h.
+  else if (args[i] == "--seeds") { seeds = "seeds " + args[i+1] + " " + args[i+2] + " " + args[i+3] + "\n"; i += 3; }
+  else if (args[i] == "--optimize") optimize = "optimize " + args[++i] + "\n";  // See deme/ProgramOptimizer.h.
+  else if (args[i] == "--server") server = args[++i];
+  else prog_files.push(args[i]);
+}
+
+// Build the request (see deme/EvalRequest.h).
+var request = "seed " + seed + "\n" +
+              "size " + width + " " + height + "\n" +
+              "time " + eval_time + "\n" +
+              "knockouts " + knockouts.join(" ") + "\n" +
+              "inbox " + inbox + "\n" +
+              "cell_samples " + cell_samples + "\n" + hardware + seeds + optimize +
+              "program\n" + prog_files.map(function(file) {
+                return fs.readFileSync(file, "utf8").replace(/\n*$/, "\n");
+              }).join("===\n");
+
+var start_time = Date.now();
+function printResponse(data) {
+  var elapsed = (Date.now() - start_time) / 1000.0;
+  data.split("\n").forEach(function(line) {
+    if (line != "") console.log("[" + elapsed.toFixed(3) + "s] " + line);
+  });
+}
+
+// Native server: frames are <4-byte big-endian length> <payload>; the request payload is '<mode>\n<request>'.
+function runOnServer() {
+  var net = require("net");
+  var conn = server.startsWith("unix:") ? net.connect(server.slice(5)) : net.connect(parseInt(server.slice(4)), "127.0.0.1");
+  var payload = Buffer.from(mode + "\n" + request, "utf8");
+  var header = Buffer.alloc(4);
+  header.writeUInt32BE(payload.length, 0);
+  conn.write(Buffer.concat([header, payload]));
+  var pending = Buffer.alloc(0);
+  conn.on("data", function(chunk) {
+    pending = Buffer.concat([pending, chunk]);
+    while (pending.length >= 4 && pending.length >= 4 + pending.readUInt32BE(0)) {
+      var frame = pending.slice(4, 4 + pending.readUInt32BE(0)).toString("utf8");
+      pending = pending.slice(4 + pending.readUInt32BE(0));
+      printResponse(frame);
+      if (/(^|\n)done\n$/.test(frame)) { conn.end(); process.exit(0); }
+    }
+  });
+  conn.on("error", function(err) { console.log("Server connection failed: " + err.message); process.exit(1); });
+}
+
+// Load the worker into a sandbox that looks enough like a worker scope.
+function runOnWorker() {
+  var worker_file = path.join(__dirname, "..", "web", "js", "EventDrivenGP-Roles-LSVis-worker.js");
+  var decoder = new TextDecoder("utf-8");
+  var sandbox = {
+    console: console,
+    require: require,
+    process: process,
+    Buffer: Buffer,
+    setTimeout: setTimeout,
+    clearTimeout: clearTimeout,
+    TextDecoder: TextDecoder,
+    __dirname: path.dirname(worker_file),
+    __filename: worker_file,
+    postMessage: function(msg) {
+      printResponse(msg["data"] ? decoder.decode(new Uint8Array(msg["data"])) : "");
+      if (msg["finalResponse"]) process.exit(0);
+    }
+  };
+  sandbox.self = sandbox;
+  vm.createContext(sandbox);
+  vm.runInContext(fs.readFileSync(worker_file, "utf8"), sandbox, { filename: worker_file });
+
+  sandbox.onmessage({ data: { funcName: "lsvis_worker_" + mode,
+                              callbackId: 0,
+                              data: new Uint8Array(Buffer.from(request, "utf8")) } });
+}
+
+if (server != "") runOnServer();
+else runOnWorker();
@@ -0,0 +1,71 @@
+// Batch vs deme agreement (build and run with: make test). Evaluates random straight-line programs
+// (built from the instructions the batch evaluator supports) with a BatchEvaluator and with a deme, for
+// several deme sizes, knockout patterns and program lengths, and checks every fitness matches; then
+// checks RunProgramJobs reports the same fitnesses with and without a batch evaluator.
+
+#include <unordered_set>
+
+#include "deme/BatchEvaluator.h"
+#include "deme/Deme.h"
+#include "deme/Landscape.h"
+#include "deme/RandomProgram.h"
+#include "deme/RoleTask.h"
+
+#include "check.h"
+
+constexpr size_t TEST_EVAL_TIME = 40;
+constexpr size_t TEST_PROGRAMS = 120;
+
+struct DemeSetup {
+  size_t width;
+  size_t height;
+  std::unordered_set<size_t> knockouts;
+};
+
+int main() {
+  emp::Ptr<event_lib_t> event_lib = emp::NewPtr<event_lib_t>(*emp::EventDrivenGP::DefaultEventLib());
+  emp::Ptr<inst_lib_t> inst_lib = emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib());
+  AddRoleInstructions(*inst_lib);
+
+  const emp::vector<DemeSetup> setups = { {1, 1, {}}, {2, 3, {}}, {4, 3, {1, 7}}, {5, 5, {0, 12, 24}} };
+  for (const DemeSetup & setup : setups) {
+    emp::Random rnd(7 + setup.width * 10 + setup.height);
+    Deme deme(&rnd, setup.width, setup.height, event_lib, inst_lib);
+    deme.knockouts = setup.knockouts;
+    BatchEvaluator batch(*inst_lib);
+    batch.Configure(deme, TEST_EVAL_TIME);
+    if (!batch.IsEnabled()) continue;  // Calibration found hardware it can't match; nothing to compare.
+    CHECK(batch.IsConfiguredFor(deme));
+
+    emp::vector<program_t> progs;
+    for (size_t i = 0; i < TEST_PROGRAMS; ++i) {
+      progs.push_back(GenRandomProgram(rnd, inst_lib, 2, 1 + i % 12, batch.GetBatchInsts()));
+    }
+    emp::vector<emp::Ptr<const program_t>> prog_ptrs;
+    for (const program_t & prog : progs) {
+      CHECK(batch.CanBatch(prog));
+      prog_ptrs.push_back(&prog);
+    }
+    const emp::vector<double> batch_fitness = batch.Evaluate(prog_ptrs);
+    CHECK(batch_fitness.size() == progs.size());
+
+    auto eval_deme = [&progs](Deme & d, size_t i) {
+      Agent agent(progs[i]);
+      return EvaluateAgent(d, &agent, TEST_EVAL_TIME);
+    };
+    emp::vector<double> deme_fitness(progs.size());
+    for (size_t i = 0; i < progs.size(); ++i) {
+      deme_fitness[i] = eval_deme(deme, i);
+      CHECK(deme_fitness[i] == batch_fitness[i]);
+    }
+
+    emp::vector<double> job_fitness(progs.size(), -1.0);
+    RunProgramJobs({emp::Ptr<Deme>(&deme)}, progs.size(), [&progs](size_t i) { return progs[i]; }, eval_deme,
+                   &batch, [&job_fitness](size_t i, double fitness) { job_fitness[i] = fitness; });
+    CHECK(job_fitness == deme_fitness);
+  }
+
+  inst_lib.Delete();
+  event_lib.Delete();
+  return TestResult("BatchEvaluator");
+}
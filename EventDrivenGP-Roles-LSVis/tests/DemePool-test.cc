@@ -0,0 +1,95 @@
+// Agent and deme pools (build and run with: make test): released objects are handed out again (reset, and
+// for demes switched to the asked-for hardware profile) rather than rebuilt; demes only match the same
+// generator and dimensions, and at most max_idle are kept.
+
+#include "deme/DemePool.h"
+#include "deme/RandomProgram.h"
+#include "deme/RoleTask.h"
+#include "tools/Random.h"
+
+#include "check.h"
+
+int main() {
+  emp::Ptr<event_lib_t> event_lib = emp::NewPtr<event_lib_t>(*emp::EventDrivenGP::DefaultEventLib());
+  emp::Ptr<inst_lib_t> inst_lib = emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib());
+  AddRoleInstructions(*inst_lib);
+  emp::Random rnd(5);
+  emp::Random other_rnd(6);
+
+  // Agents: a released agent is reused, holding the new program and no stale counts.
+  {
+    AgentPool pool(inst_lib);
+    const program_t prog_a = GenRandomProgram(rnd, inst_lib, 2, 6);
+    const program_t prog_b = GenRandomProgram(rnd, inst_lib, 1, 3);
+    emp::Ptr<Agent> agent = pool.Acquire(prog_a);
+    CHECK(SameProgram(agent->program, prog_a));
+    agent->valid_id_cnt = 7;
+    agent->valid_uid_cnt = 3;
+    pool.Release(agent);
+    emp::Ptr<Agent> reused = pool.Acquire(prog_b);
+    CHECK(reused.Raw() == agent.Raw());
+    CHECK(pool.GetSize() == 1);
+    CHECK(SameProgram(reused->program, prog_b));
+    CHECK(reused->valid_id_cnt == 0 && reused->valid_uid_cnt == 0);
+    emp::Ptr<Agent> second = pool.Acquire(prog_a);  // None free: a new one.
+    CHECK(second.Raw() != reused.Raw());
+    CHECK(pool.GetSize() == 2);
+    pool.Release(second);
+    pool.Release(reused);
+  }
+
+  // Demes: reused when generator and dimensions match, reset, and switched to the profile asked for.
+  {
+    DemePool pool(event_lib, inst_lib, 2);
+    const program_t prog = GenRandomProgram(rnd, inst_lib, 2, 6);
+    Agent agent(prog);
+    emp::Ptr<Deme> deme = pool.Acquire(&rnd, 3, 2);
+    CHECK(deme->GetHardwareProfile() == HardwareProfile::Default());
+    const size_t default_max_cores = deme->grid[0]->GetMaxCores();
+    deme->LoadAgent(&agent);
+    deme->traits.SetRoleID(4, 2);
+    pool.Release(deme);
+    CHECK(pool.GetIdleCount() == 1);
+
+    emp::Ptr<Deme> compact = pool.Acquire(&rnd, 3, 2, HardwareProfile::Compact());
+    CHECK(compact.Raw() == deme.Raw());
+    CHECK(pool.GetIdleCount() == 0);
+    CHECK(compact->GetHardwareProfile() == HardwareProfile::Compact());
+    for (size_t i = 0; i < compact->grid.size(); ++i) {
+      CHECK(compact->grid[i]->GetMaxCores() == HardwareProfile::Compact().max_cores);
+      CHECK(compact->grid[i]->GetMaxCallDepth() == HardwareProfile::Compact().max_call_depth);
+    }
+    CHECK(compact->traits.role_id == compact->clean_traits.role_id);
+    CHECK(RoleIDFitness(compact.Raw()) == 0.0);
+    pool.Release(compact);
+
+    emp::Ptr<Deme> back = pool.Acquire(&rnd, 3, 2);  // And back to the default profile.
+    CHECK(back.Raw() == deme.Raw());
+    CHECK(back->GetHardwareProfile() == HardwareProfile::Default());
+    CHECK(back->grid[0]->GetMaxCores() == default_max_cores);
+
+    // Other dimensions or another generator: built fresh, and the idle one stays idle.
+    pool.Release(back);
+    emp::Ptr<Deme> wide = pool.Acquire(&rnd, 2, 3);
+    emp::Ptr<Deme> other = pool.Acquire(&other_rnd, 3, 2);
+    CHECK(wide.Raw() != deme.Raw() && other.Raw() != deme.Raw());
+    CHECK(pool.GetIdleCount() == 1);
+
+    // At most max_idle kept: the least recently released (deme) goes first.
+    pool.Release(wide);
+    pool.Release(other);
+    CHECK(pool.GetIdleCount() == 2);
+    emp::Ptr<Deme> rebuilt = pool.Acquire(&rnd, 3, 2);
+    CHECK(pool.GetIdleCount() == 2);   // Nothing idle matched: deme was dropped.
+    pool.Release(rebuilt);             // Drops wide.
+    CHECK(pool.GetIdleCount() == 2);
+    emp::Ptr<Deme> kept = pool.Acquire(&other_rnd, 3, 2);
+    CHECK(kept.Raw() == other.Raw());
+    CHECK(pool.GetIdleCount() == 1);
+    pool.Release(kept);
+  }
+
+  inst_lib.Delete();
+  event_lib.Delete();
+  return TestResult("DemePool");
+}
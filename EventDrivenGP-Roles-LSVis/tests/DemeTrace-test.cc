@@ -0,0 +1,148 @@
+// Deme trace codec (build and run with: make test): varint/zigzag round trips at the edges, a recorded
+// run of random changes and messages read back state-for-state (across several keyframes), and
+// truncated or hostile traces rejected.
+
+#include <cstdint>
+#include <limits>
+
+#include "deme/DemeTrace.h"
+#include "tools/Random.h"
+
+#include "check.h"
+
+constexpr size_t TEST_WIDTH = 5;
+constexpr size_t TEST_HEIGHT = 3;
+constexpr size_t TEST_UPDATES = 200;  // Several keyframes' worth.
+
+emp::vector<uint8_t> TraceHeader(uint64_t version, uint64_t width, uint64_t height) {
+  emp::vector<uint8_t> bytes = {'L', 'S', 'T', 'R'};
+  trace_io::WriteUInt(bytes, version);
+  trace_io::WriteUInt(bytes, width);
+  trace_io::WriteUInt(bytes, height);
+  return bytes;
+}
+
+int main() {
+  // Varints.
+  const emp::vector<uint64_t> uvals = { 0, 1, 127, 128, 300, 16383, 16384, (uint64_t)1 << 32,
+                                        std::numeric_limits<uint64_t>::max() };
+  const emp::vector<int64_t> svals = { 0, 1, -1, 63, -64, 64, -65, std::numeric_limits<int64_t>::max(),
+                                       std::numeric_limits<int64_t>::min() };
+  {
+    emp::vector<uint8_t> bytes;
+    for (uint64_t val : uvals) trace_io::WriteUInt(bytes, val);
+    for (int64_t val : svals) trace_io::WriteInt(bytes, val);
+    const uint8_t * pos = bytes.data();
+    const uint8_t * end = bytes.data() + bytes.size();
+    for (uint64_t val : uvals) {
+      uint64_t read = 0;
+      CHECK(trace_io::ReadUInt(pos, end, read) && read == val);
+    }
+    for (int64_t val : svals) {
+      int64_t read = 0;
+      CHECK(trace_io::ReadInt(pos, end, read) && read == val);
+    }
+    CHECK(pos == end);
+  }
+  {
+    emp::vector<uint8_t> bytes;
+    trace_io::WriteUInt(bytes, 1);
+    CHECK(bytes.size() == 1);
+    trace_io::WriteInt(bytes, -1);
+    CHECK(bytes.size() == 2 && bytes[1] == 1);  // Zigzag keeps small negatives small.
+    // Truncated, and longer than any 64-bit value.
+    const emp::vector<uint8_t> truncated = {0x80, 0x80};
+    const emp::vector<uint8_t> too_long(11, 0x80);
+    uint64_t val;
+    const uint8_t * pos = truncated.data();
+    CHECK(!trace_io::ReadUInt(pos, truncated.data() + truncated.size(), val));
+    pos = too_long.data();
+    CHECK(!trace_io::ReadUInt(pos, too_long.data() + too_long.size(), val));
+  }
+
+  // Record a run of random role ID changes, core count changes and messages; read it back.
+  const size_t num_cells = TEST_WIDTH * TEST_HEIGHT;
+  emp::Random rnd(17);
+  emp::vector<emp::vector<int>> roles;
+  emp::vector<emp::vector<size_t>> cores;
+  emp::vector<emp::vector<std::pair<size_t, size_t>>> msgs;
+  emp::vector<double> role_ids(num_cells, 0.0);
+  emp::vector<size_t> core_cnts(num_cells, 1);
+  DemeTraceRecorder recorder;
+  recorder.Start(TEST_WIDTH, TEST_HEIGHT, role_ids, core_cnts);
+  roles.emplace_back(role_ids.begin(), role_ids.end());
+  cores.emplace_back(core_cnts);
+  msgs.emplace_back();
+  for (size_t t = 1; t <= TEST_UPDATES; ++t) {
+    msgs.emplace_back();
+    for (size_t i = 0; i < 3; ++i) {
+      const size_t src = rnd.GetUInt((uint32_t)num_cells);
+      const size_t dest = rnd.GetUInt((uint32_t)num_cells);
+      recorder.OnMessage(src, dest);
+      msgs.back().emplace_back(src, dest);
+    }
+    role_ids[rnd.GetUInt((uint32_t)num_cells)] = rnd.GetInt(-5, 6);
+    if (rnd.P(0.5)) core_cnts[rnd.GetUInt((uint32_t)num_cells)] = rnd.GetUInt(8);
+    recorder.OnUpdate(role_ids, core_cnts);
+    roles.emplace_back(role_ids.begin(), role_ids.end());
+    cores.emplace_back(core_cnts);
+  }
+  CHECK(recorder.GetNumUpdates() == TEST_UPDATES);
+
+  const emp::vector<uint8_t> & bytes = recorder.GetBytes();
+  DemeTrace trace;
+  CHECK(trace.Read(bytes.data(), bytes.size()));
+  CHECK(trace.GetWidth() == TEST_WIDTH && trace.GetHeight() == TEST_HEIGHT);
+  CHECK(trace.GetNumUpdates() == TEST_UPDATES);
+  if (trace.GetNumUpdates() == TEST_UPDATES) {
+    for (size_t t = 0; t <= TEST_UPDATES; ++t) {
+      emp::vector<int> trace_roles;
+      emp::vector<size_t> trace_cores;
+      trace.GetState(t, trace_roles, trace_cores);
+      CHECK(trace_roles == roles[t]);
+      CHECK(trace_cores == cores[t]);
+      CHECK(trace.GetMessages(t) == msgs[t]);
+    }
+  }
+
+  // Bad traces leave an empty trace.
+  CHECK(!trace.Read(bytes.data(), bytes.size() - 1));
+  CHECK(trace.IsEmpty());
+  emp::vector<uint8_t> bad_magic(bytes);
+  bad_magic[0] = 'X';
+  CHECK(!trace.Read(bad_magic.data(), bad_magic.size()));
+  emp::vector<uint8_t> header_only = TraceHeader(trace_io::VERSION, TEST_WIDTH, TEST_HEIGHT);
+  CHECK(!trace.Read(header_only.data(), header_only.size()));
+  const emp::vector<std::pair<uint64_t, uint64_t>> bad_sizes = { {0, 4}, {4, 0}, {DemeTrace::MAX_CELLS + 1, 1},
+                                                                 {1 << 9, 1 << 9}, {(uint64_t)1 << 32, (uint64_t)1 << 32} };
+  for (const auto & size : bad_sizes) {
+    emp::vector<uint8_t> header = TraceHeader(trace_io::VERSION, size.first, size.second);
+    header.insert(header.end(), {0, 0, 0});   // An empty frame.
+    CHECK(!trace.Read(header.data(), header.size()));
+  }
+  emp::vector<uint8_t> bad_version = TraceHeader(trace_io::VERSION + 1, TEST_WIDTH, TEST_HEIGHT);
+  bad_version.insert(bad_version.end(), {0, 0, 0});
+  CHECK(!trace.Read(bad_version.data(), bad_version.size()));
+  emp::vector<uint8_t> bad_cell = TraceHeader(trace_io::VERSION, TEST_WIDTH, TEST_HEIGHT);
+  bad_cell.insert(bad_cell.end(), {1, (uint8_t)num_cells, 2, 0, 0});  // Role change of a cell past the deme.
+  CHECK(!trace.Read(bad_cell.data(), bad_cell.size()));
+  // Deltas that would overflow (or wrap back into the deme) are rejected up front.
+  emp::vector<uint8_t> huge_dest = TraceHeader(trace_io::VERSION, TEST_WIDTH, TEST_HEIGHT);
+  huge_dest.push_back(0);
+  trace_io::WriteUInt(huge_dest, 1);
+  trace_io::WriteInt(huge_dest, 1);
+  trace_io::WriteInt(huge_dest, std::numeric_limits<int64_t>::max());
+  huge_dest.push_back(0);
+  CHECK(!trace.Read(huge_dest.data(), huge_dest.size()));
+  emp::vector<uint8_t> wrapped_id = TraceHeader(trace_io::VERSION, TEST_WIDTH, TEST_HEIGHT);
+  trace_io::WriteUInt(wrapped_id, 2);
+  trace_io::WriteUInt(wrapped_id, 1);
+  trace_io::WriteInt(wrapped_id, 0);
+  trace_io::WriteUInt(wrapped_id, std::numeric_limits<uint64_t>::max());
+  trace_io::WriteInt(wrapped_id, 0);
+  wrapped_id.insert(wrapped_id.end(), {0, 0});
+  CHECK(!trace.Read(wrapped_id.data(), wrapped_id.size()));
+  CHECK(trace.IsEmpty());
+
+  return TestResult("DemeTrace");
+}
@@ -0,0 +1,104 @@
+// Evaluation request format (build and run with: make test): a request using every optional field reads
+// back as written, defaults survive a round trip, and requests that are malformed or past the MAX_*
+// limits are rejected.
+
+#include <sstream>
+#include <string>
+
+#include "deme/EvalRequest.h"
+
+#include "check.h"
+
+bool ReadRequest(const std::string & text, EvalRequest & req) {
+  std::istringstream is(text);
+  return req.Read(is);
+}
+
+std::string WriteRequest(const EvalRequest & req) {
+  std::ostringstream os;
+  req.Write(os);
+  return os.str();
+}
+
+int main() {
+  // Every field set.
+  {
+    EvalRequest req;
+    req.seed = -17;
+    req.width = 4;
+    req.height = 3;
+    req.eval_time = 123;
+    req.knockouts = {0, 5, 11};
+    req.inbox_capacity = 6;
+    req.inbox_policy = InboxPolicy::COALESCE;
+    req.topology = BuildMooreTorus(4, 3);
+    req.cell_samples = 20;
+    req.cell_sample_k = 3;
+    req.hw_profile.max_cores = 4;
+    req.sampling = SeedSampling(3, 10, 0.25);
+    req.opt_level = ProgramOptLevel::TIMING;
+    req.positions = {{-1, -1}, {0, 2}, {1, 0}};
+    req.program = "fn-00000000:\n  Nop[00000000](0,0,0)\n";
+    const std::string text = WriteRequest(req);
+    EvalRequest read;
+    CHECK(ReadRequest(text, read));
+    CHECK(read.seed == req.seed && read.width == req.width && read.height == req.height);
+    CHECK(read.eval_time == req.eval_time && read.knockouts == req.knockouts);
+    CHECK(read.inbox_capacity == req.inbox_capacity && read.inbox_policy == req.inbox_policy);
+    CHECK(read.topology.GetOffsets() == req.topology.GetOffsets());
+    CHECK(read.topology.GetAdjacency() == req.topology.GetAdjacency());
+    CHECK(read.cell_samples == req.cell_samples && read.cell_sample_k == req.cell_sample_k);
+    CHECK(read.hw_profile == req.hw_profile);
+    CHECK(read.sampling.min_seeds == 3 && read.sampling.max_seeds == 10 && read.sampling.max_half_width == 0.25);
+    CHECK(read.opt_level == req.opt_level && read.positions == req.positions);
+    CHECK(read.program == req.program);
+  }
+
+  // Defaults (no optional lines written); a request read over an old one forgets the old optional fields.
+  {
+    EvalRequest req;
+    req.program = "";
+    const std::string text = WriteRequest(req);
+    CHECK(text.find("topology") == std::string::npos && text.find("seeds") == std::string::npos);
+    EvalRequest read;
+    read.topology = BuildVonNeumannTorus(2, 2);
+    read.opt_level = ProgramOptLevel::FAST;
+    CHECK(ReadRequest(text, read));
+    CHECK(read.topology.GetSize() == 0 && read.opt_level == ProgramOptLevel::NONE);
+    CHECK(read.sampling.IsSingleSeed() && read.positions.empty());
+    CHECK(WriteRequest(read) == text);
+  }
+
+  // Malformed or too big.
+  const emp::vector<std::string> bad = {
+    "size 5 5\n",                                   // No program.
+    "size 5 5\nbogus 1\nprogram\n",
+    "size 5 5\ninbox 4 sometimes\nprogram\n",
+    "size 5 5\noptimize lots\nprogram\n",
+    "size 0 5\nprogram\n",
+    "size 100000 100000\nprogram\n",
+    "size 4294967296 4294967296\nprogram\n",
+    "size 5 5\ntopology 10000000000\nprogram\n",
+    "size 5 5\ntopology 4\n1\n0\n3\n2\nprogram\n",   // Topology of the wrong size.
+    "size 5 5\ntime 99999999\nprogram\n",
+    "size 5 5\ninbox 99999999 drop_oldest\nprogram\n",
+    "size 5 5\nseeds 1 100000 0.1\nprogram\n",
+    "size 5 5\ncell_samples 99999999 2\nprogram\n",
+    "size 256 256\ncell_samples 100000 65536\nprogram\n",   // Sampled cells past MAX_SAMPLED_CELLS.
+    "size 256 256\ncell_samples 100000 64\nprogram\n",
+    "size 5 5\nhardware 99999999 16 1\nprogram\n",
+    "size 5 5\nhardware 8 99999999 1\nprogram\n"
+  };
+  for (const std::string & text : bad) {
+    EvalRequest req;
+    const bool read = ReadRequest(text, req);
+    CHECK(!read);
+    if (read) std::cerr << "  accepted: " << text;
+  }
+  EvalRequest req;
+  CHECK(ReadRequest("size 256 256\ntime 100000\nseeds 4 64 0.5\nprogram\n", req));   // At the limits.
+  CHECK(ReadRequest("size 256 256\ncell_samples 100000 2\nhardware 1024 1024 0\nprogram\n", req));
+  CHECK(ReadRequest("size 4 4\ncell_samples 100000 65536\nprogram\n", req));   // k past the deme counts as the deme.
+
+  return TestResult("EvalRequest");
+}
@@ -0,0 +1,113 @@
+// EventInbox ring buffer behaviour (build and run with: make test): wrap-around order, each overflow
+// policy, unbounded growth, and pushes made while draining.
+
+#include <memory>
+
+#include "deme/EventInbox.h"
+
+#include "check.h"
+
+using event_t = EventInbox::event_t;
+using event_ptr_t = EventInbox::event_ptr_t;
+
+// Event tagged with value (in msg[0]) so drained order can be checked.
+event_ptr_t MakeEvent(double value) {
+  event_t event;
+  event.msg[0] = value;
+  return std::make_shared<const event_t>(event);
+}
+
+emp::vector<double> DrainValues(EventInbox & inbox) {
+  emp::vector<double> values;
+  inbox.Drain([&values](const event_t & event) { values.emplace_back(event.msg.at(0)); });
+  return values;
+}
+
+int main() {
+  // Wrap-around: after a drain, pushes run past the end of the buffer, order stays oldest first.
+  {
+    EventInbox inbox(4);
+    for (int i = 0; i < 3; ++i) CHECK(inbox.Push(MakeEvent(i), InboxPolicy::DROP_OLDEST));
+    CHECK(DrainValues(inbox) == emp::vector<double>({0, 1, 2}));
+    CHECK(inbox.GetSize() == 0);
+    for (int i = 3; i < 7; ++i) CHECK(inbox.Push(MakeEvent(i), InboxPolicy::DROP_OLDEST));
+    CHECK(inbox.GetSize() == 4);
+    CHECK(DrainValues(inbox) == emp::vector<double>({3, 4, 5, 6}));
+    CHECK(inbox.GetDroppedCount() == 0);
+  }
+
+  // DROP_OLDEST keeps the newest capacity messages.
+  {
+    EventInbox inbox(3);
+    for (int i = 0; i < 5; ++i) CHECK(inbox.Push(MakeEvent(i), InboxPolicy::DROP_OLDEST));
+    CHECK(inbox.GetDroppedCount() == 2);
+    CHECK(DrainValues(inbox) == emp::vector<double>({2, 3, 4}));
+  }
+
+  // DROP_NEWEST refuses messages once full.
+  {
+    EventInbox inbox(3);
+    for (int i = 0; i < 5; ++i) CHECK(inbox.Push(MakeEvent(i), InboxPolicy::DROP_NEWEST) == (i < 3));
+    CHECK(inbox.GetDroppedCount() == 2);
+    CHECK(DrainValues(inbox) == emp::vector<double>({0, 1, 2}));
+  }
+
+  // COALESCE drops duplicates of waiting messages (equal by value, not just by pointer), else drops oldest.
+  {
+    EventInbox inbox(2);
+    event_ptr_t one = MakeEvent(1);
+    CHECK(inbox.Push(one, InboxPolicy::COALESCE));
+    CHECK(!inbox.Push(one, InboxPolicy::COALESCE));
+    CHECK(!inbox.Push(MakeEvent(1), InboxPolicy::COALESCE));
+    CHECK(inbox.Push(MakeEvent(2), InboxPolicy::COALESCE));
+    CHECK(inbox.Push(MakeEvent(3), InboxPolicy::COALESCE));
+    CHECK(inbox.GetCoalescedCount() == 2);
+    CHECK(inbox.GetDroppedCount() == 1);
+    CHECK(DrainValues(inbox) == emp::vector<double>({2, 3}));
+  }
+
+  // Unbounded inboxes grow (unrolling a wrapped ring) and never drop.
+  {
+    EventInbox inbox;
+    for (int i = 0; i < 5; ++i) inbox.Push(MakeEvent(i), InboxPolicy::DROP_OLDEST);
+    CHECK(DrainValues(inbox).size() == 5);
+    emp::vector<double> expected;
+    for (int i = 0; i < 100; ++i) {
+      CHECK(inbox.Push(MakeEvent(i), InboxPolicy::DROP_OLDEST));
+      expected.emplace_back(i);
+    }
+    CHECK(inbox.GetDroppedCount() == 0);
+    CHECK(DrainValues(inbox) == expected);
+  }
+
+  // Messages pushed while draining are drained too, in order.
+  {
+    EventInbox inbox(4);
+    inbox.Push(MakeEvent(0), InboxPolicy::DROP_OLDEST);
+    emp::vector<double> values;
+    inbox.Drain([&values, &inbox](const event_t & event) {
+      const double value = event.msg.at(0);
+      values.emplace_back(value);
+      if (value < 5) inbox.Push(MakeEvent(value + 1), InboxPolicy::DROP_OLDEST);
+    });
+    CHECK(values == emp::vector<double>({0, 1, 2, 3, 4, 5}));
+  }
+
+  // SetCapacity and Clear empty the inbox.
+  {
+    EventInbox inbox(2);
+    inbox.Push(MakeEvent(0), InboxPolicy::DROP_OLDEST);
+    inbox.Push(MakeEvent(1), InboxPolicy::DROP_OLDEST);
+    inbox.Push(MakeEvent(2), InboxPolicy::DROP_OLDEST);
+    inbox.Clear();
+    CHECK(inbox.GetSize() == 0 && inbox.GetDroppedCount() == 0);
+    inbox.Push(MakeEvent(0), InboxPolicy::DROP_OLDEST);
+    inbox.SetCapacity(1);
+    CHECK(inbox.GetSize() == 0 && inbox.GetCapacity() == 1);
+    inbox.Push(MakeEvent(4), InboxPolicy::DROP_OLDEST);
+    inbox.Push(MakeEvent(5), InboxPolicy::DROP_OLDEST);
+    CHECK(DrainValues(inbox) == emp::vector<double>({5}));
+  }
+
+  return TestResult("EventInbox");
+}
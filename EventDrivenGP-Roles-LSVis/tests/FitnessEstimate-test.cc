@@ -0,0 +1,106 @@
+// Seed-sampled fitness estimates (build and run with: make test): Welford running stats against a
+// two-pass computation (including values with a large common offset), the t table, confidence intervals,
+// the stopping rule, and estimates that don't depend on how many demes share the work.
+
+#include <cmath>
+
+#include "deme/Deme.h"
+#include "deme/FitnessEstimate.h"
+
+#include "check.h"
+
+bool Near(double a, double b, double tolerance) { return std::abs(a - b) <= tolerance; }
+
+int main() {
+  // Running stats.
+  emp::Random rnd(21);
+  for (double offset : {0.0, 1e9}) {
+    emp::vector<double> vals;
+    for (size_t i = 0; i < 1000; ++i) vals.emplace_back(offset + rnd.GetDouble(-2.0, 2.0));
+    RunningStats stats;
+    double sum = 0.0;
+    for (double val : vals) { stats.Add(val); sum += val - offset; }
+    const double mean = offset + sum / (double)vals.size();
+    double sq = 0.0;
+    for (double val : vals) sq += (val - mean) * (val - mean);
+    CHECK(stats.GetCount() == vals.size());
+    CHECK(Near(stats.GetMean(), mean, 1e-9 * std::max(1.0, offset)));
+    CHECK(Near(stats.GetVariance(), sq / (double)(vals.size() - 1), 1e-6));
+  }
+  {
+    RunningStats stats;
+    CHECK(stats.GetVariance() == 0.0);
+    stats.Add(4.0);
+    CHECK(stats.GetMean() == 4.0 && stats.GetVariance() == 0.0);
+    for (double val : {2.0, 4.0, 4.0, 4.0, 5.0, 5.0, 7.0, 9.0}) stats.Add(val);
+    CHECK(Near(stats.GetMean(), 44.0 / 9.0, 1e-12));
+  }
+
+  // t critical values: known points, never increasing with df.
+  CHECK(std::isinf(TCritical95(0)));
+  CHECK(TCritical95(1) == 12.706 && TCritical95(10) == 2.228 && TCritical95(30) == 2.042);
+  CHECK(TCritical95(1000) == 1.960);
+  for (size_t df = 1; df < 200; ++df) CHECK(TCritical95(df + 1) <= TCritical95(df));
+
+  // Confidence interval of {1, 2, 3, 4, 5}: mean 3, sd sqrt(2.5), t(4) = 2.776.
+  {
+    RunningStats stats;
+    for (double val : {1.0, 2.0, 3.0, 4.0, 5.0}) stats.Add(val);
+    const FitnessEstimate estimate = FitnessEstimate::FromStats(stats);
+    CHECK(estimate.seeds == 5 && estimate.mean == 3.0);
+    CHECK(Near(estimate.half_width, 2.776 * std::sqrt(2.5 / 5.0), 1e-12));
+    CHECK(Near(estimate.GetHigh() - estimate.GetLow(), 2.0 * estimate.half_width, 1e-12));
+    RunningStats one;
+    one.Add(1.0);
+    CHECK(std::isinf(FitnessEstimate::FromStats(one).half_width));
+  }
+
+  // Stopping rule.
+  {
+    const SeedSampling single;
+    CHECK(single.IsSingleSeed());
+    CHECK(single.ConstantEstimate(2.5).seeds == 1 && single.ConstantEstimate(2.5).mean == 2.5);
+    const SeedSampling sampling(3, 20, 0.5);
+    CHECK(!sampling.IsSingleSeed());
+    CHECK(sampling.ConstantEstimate(1.0).seeds == 3);   // Zero width once min_seeds are in.
+    CHECK(!sampling.IsDone(FitnessEstimate(0.0, 0.0, 2)));
+    CHECK(!sampling.IsDone(FitnessEstimate(0.0, 0.6, 10)));
+    CHECK(sampling.IsDone(FitnessEstimate(0.0, 0.4, 10)));
+    CHECK(sampling.IsDone(FitnessEstimate(0.0, 9.0, 20)));
+    const SeedSampling bad(0, 0);
+    CHECK(bad.min_seeds == 1 && bad.max_seeds == 1);
+  }
+
+  // Estimates over seeds come out the same however many demes evaluate them.
+  emp::Ptr<event_lib_t> event_lib = emp::NewPtr<event_lib_t>(*emp::EventDrivenGP::DefaultEventLib());
+  emp::Ptr<inst_lib_t> inst_lib = emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib());
+  emp::vector<emp::Ptr<emp::Random>> deme_rnds;
+  emp::vector<emp::Ptr<Deme>> demes;
+  for (size_t i = 0; i < 4; ++i) {
+    deme_rnds.emplace_back(emp::NewPtr<emp::Random>((int)i + 1));
+    demes.emplace_back(emp::NewPtr<Deme>(deme_rnds.back(), 2, 2, event_lib, inst_lib));
+  }
+  auto eval_deme = [](Deme & deme) { return deme.rnd->GetDouble(0.0, 10.0); };
+  for (const SeedSampling & sampling : {SeedSampling(3, 7, 0.0), SeedSampling(2, 50, 2.0), SeedSampling(5, 5)}) {
+    const FitnessEstimate one = EstimateFitness({demes[0]}, eval_deme, 77, sampling);
+    for (size_t num_demes = 2; num_demes <= demes.size(); ++num_demes) {
+      const emp::vector<emp::Ptr<Deme>> used(demes.begin(), demes.begin() + num_demes);
+      const FitnessEstimate many = EstimateFitness(used, eval_deme, 77, sampling);
+      CHECK(many.seeds == one.seeds && many.mean == one.mean && many.half_width == one.half_width);
+    }
+    CHECK(sampling.IsDone(one));
+    CHECK(one.seeds >= sampling.min_seeds && one.seeds <= sampling.max_seeds);
+  }
+  {
+    size_t rounds = 0;
+    const FitnessEstimate stopped = EstimateFitness(demes, eval_deme, 77, SeedSampling(2, 100, 0.0),
+                                                    [&rounds](const FitnessEstimate &) { return ++rounds < 2; });
+    CHECK(rounds == 2 && stopped.seeds == 2 * demes.size());
+  }
+
+  for (auto deme : demes) deme.Delete();
+  for (auto deme_rnd : deme_rnds) deme_rnd.Delete();
+  inst_lib.Delete();
+  event_lib.Delete();
+  return TestResult("FitnessEstimate");
+}
@@ -0,0 +1,135 @@
+// Knockout landscape scheduling (build and run with: make test): the base program first, then by impact
+// (ties in program order); Prioritize before and after part of the landscape is handed out; Cancel; and
+// chunks growing while they're quick and shrinking once they're slow.
+
+#include <chrono>
+#include <thread>
+
+#include "deme/LandscapeScheduler.h"
+#include "deme/RoleTask.h"
+
+#include "check.h"
+
+using pos_t = LandscapeScheduler::pos_t;
+
+// Every chunk until the scheduler runs dry, each marked done straight away.
+emp::vector<pos_t> TakeAll(LandscapeScheduler & scheduler) {
+  emp::vector<pos_t> positions;
+  for (emp::vector<pos_t> chunk = scheduler.NextChunk(); chunk.size(); chunk = scheduler.NextChunk()) {
+    positions.insert(positions.end(), chunk.begin(), chunk.end());
+    scheduler.Done(chunk.size());
+  }
+  return positions;
+}
+
+int main() {
+  emp::Ptr<inst_lib_t> inst_lib = emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib());
+  AddRoleInstructions(*inst_lib);
+  const size_t nop_id = inst_lib->GetID("Nop");
+  // Two functions: 3 and 4 instructions.
+  program_t prog(inst_lib);
+  for (size_t len : {3, 4}) {
+    prog.PushFunction(fun_t());
+    for (size_t i = 0; i < len; ++i) prog.PushInst(nop_id, 0, 0, 0);
+  }
+  // (0, 2) matters most, then all of function 1 (tied), then the rest of function 0 (tied).
+  auto impact = [](int fID, int iID) { return (fID == 1) ? 5.0 : (iID == 2 ? 9.0 : 0.0); };
+  const emp::vector<pos_t> by_impact = { {-1, -1}, {0, 2}, {1, 0}, {1, 1}, {1, 2}, {1, 3}, {0, 0}, {0, 1} };
+  const double never_slow = 1e9;
+
+  // Base first, then by impact; chunks double while they're quick.
+  {
+    LandscapeScheduler scheduler(never_slow);
+    scheduler.Start(prog, impact);
+    CHECK(scheduler.IsActive() && !scheduler.IsDone());
+    CHECK(scheduler.GetNumPositions() == by_impact.size());
+    CHECK(scheduler.NextChunk() == emp::vector<pos_t>(1, pos_t(-1, -1)));
+    scheduler.Done(1);
+    CHECK(scheduler.NextChunk().size() == 2);
+    scheduler.Done(2);
+    CHECK(scheduler.NextChunk().size() == 4);
+    scheduler.Done(4);
+    CHECK(scheduler.NextChunk().size() == 1);  // All that's left.
+    scheduler.Done(1);
+    CHECK(scheduler.IsDone() && !scheduler.IsActive());
+    CHECK(scheduler.GetNumDone() == by_impact.size());
+    CHECK(scheduler.NextChunk().empty());
+
+    scheduler.Start(prog, impact);  // Starting over resets everything.
+    CHECK(TakeAll(scheduler) == by_impact);
+  }
+
+  // Prioritize before anything is handed out: wanted positions keep their relative order, base stays first.
+  {
+    LandscapeScheduler scheduler(never_slow);
+    scheduler.Start(prog, impact);
+    scheduler.Prioritize({ {0, 1}, {1, 3}, {-1, -1} });
+    const emp::vector<pos_t> expected = { {-1, -1}, {1, 3}, {0, 1}, {0, 2}, {1, 0}, {1, 1}, {1, 2}, {0, 0} };
+    CHECK(TakeAll(scheduler) == expected);
+  }
+
+  // Prioritize after part of the landscape is handed out: only what's left moves ((0, 2) is already out).
+  {
+    LandscapeScheduler scheduler(never_slow);
+    scheduler.Start(prog, impact);
+    CHECK(scheduler.NextChunk().size() == 1);
+    scheduler.Done(1);
+    const emp::vector<pos_t> second = scheduler.NextChunk();
+    CHECK(second == emp::vector<pos_t>({ {0, 2}, {1, 0} }));
+    scheduler.Prioritize({ {0, 0}, {1, 2}, {0, 2} });
+    scheduler.Done(second.size());
+    const emp::vector<pos_t> expected = { {1, 2}, {0, 0}, {1, 1}, {1, 3}, {0, 1} };
+    CHECK(TakeAll(scheduler) == expected);
+    CHECK(scheduler.IsDone());
+  }
+
+  // Cancel: nothing more is handed out, and Prioritize leaves things be.
+  {
+    LandscapeScheduler scheduler(never_slow);
+    scheduler.Start(prog, impact);
+    CHECK(scheduler.NextChunk().size() == 1);
+    scheduler.Cancel();
+    scheduler.Done(1);
+    scheduler.Prioritize({ {0, 0} });
+    CHECK(!scheduler.IsActive() && !scheduler.IsDone());
+    CHECK(scheduler.NextChunk().empty());
+    CHECK(scheduler.GetNumDone() == 1);
+  }
+
+  // Chunks halve once one takes longer than target_ms (but never drop below one position).
+  {
+    const double target_ms = 20.0;
+    LandscapeScheduler scheduler(target_ms);
+    scheduler.Start(prog, impact);
+    CHECK(scheduler.NextChunk().size() == 1);
+    scheduler.Done(1);
+    CHECK(scheduler.NextChunk().size() == 2);
+    scheduler.Done(2);
+    CHECK(scheduler.NextChunk().size() == 4);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    scheduler.Done(4);
+    CHECK(scheduler.NextChunk().size() == 1);  // Would be 2, but only one position is left.
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    scheduler.Done(1);
+    CHECK(scheduler.IsDone());
+
+    scheduler.Start(prog, impact);
+    CHECK(scheduler.NextChunk().size() == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    scheduler.Done(1);
+    CHECK(scheduler.NextChunk().size() == 1);  // Slow, but already as small as chunks get.
+    scheduler.Done(1);
+    CHECK(scheduler.NextChunk().size() == 2);  // Quick again.
+  }
+
+  // An empty program is just the base program.
+  {
+    LandscapeScheduler scheduler(never_slow);
+    scheduler.Start(program_t(inst_lib), impact);
+    CHECK(TakeAll(scheduler) == emp::vector<pos_t>(1, pos_t(-1, -1)));
+    CHECK(scheduler.IsDone());
+  }
+
+  inst_lib.Delete();
+  return TestResult("LandscapeScheduler");
+}
@@ -0,0 +1,150 @@
+// Landscape store format (build and run with: make test): landscapes read back as appended (in memory and
+// from a file, reopened with and without its index), later appends supersede earlier ones, LoadTable
+// matches the appended rows, blocks cut short are ignored and overwritten, and matrices survive
+// StoreMatrix/LoadMatrix.
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "deme/LandscapeStore.h"
+#include "deme/RandomProgram.h"
+#include "deme/RoleTask.h"
+
+#include "check.h"
+
+const std::string TEST_STORE_PATH = "tests/LandscapeStore-test.lsls";
+
+StoredLandscape MakeLandscape(emp::Random & rnd, uint64_t prog_hash, LandscapeKind kind, int seed, size_t rows) {
+  StoredLandscape landscape(prog_hash, 99, kind, seed);
+  landscape.Add(-1, -1, 0, rnd.GetDouble());
+  for (size_t i = 1; i < rows; ++i) landscape.Add((int)rnd.GetUInt(4), (int)rnd.GetUInt(20), rnd.GetUInt(40), rnd.GetDouble(-1.0, 10.0));
+  return landscape;
+}
+
+bool SameLandscape(const StoredLandscape & a, const StoredLandscape & b) {
+  return a.prog_hash == b.prog_hash && a.context_hash == b.context_hash && a.kind == b.kind && a.seed == b.seed
+    && a.fIDs == b.fIDs && a.iIDs == b.iIDs && a.variants == b.variants && a.fitness == b.fitness;
+}
+
+// Does store hold exactly landscapes (latest per key) and do its table rows match them?
+bool StoreHolds(LandscapeStore & store, const emp::vector<StoredLandscape> & landscapes) {
+  if (store.GetNumLandscapes() != landscapes.size()) return false;
+  LandscapeTable table;
+  store.LoadTable(table);
+  if (table.GetNumLandscapes() != landscapes.size()) return false;
+  for (size_t l = 0; l < landscapes.size(); ++l) {
+    const StoredLandscape & want = landscapes[l];
+    StoredLandscape found;
+    if (!store.Find(want.prog_hash, want.context_hash, want.kind, want.seed, found) || !SameLandscape(found, want)) return false;
+    if (table.starts[l + 1] - table.starts[l] != want.GetSize()) return false;
+    for (size_t i = 0; i < want.GetSize(); ++i) {
+      const size_t row = table.starts[l] + i;
+      if (table.prog_hash[row] != want.prog_hash || table.kind[row] != want.kind || table.seed[row] != want.seed) return false;
+      if (table.fID[row] != want.fIDs[i] || table.iID[row] != want.iIDs[i] || table.variant[row] != want.variants[i]) return false;
+      if (table.fitness[row] != want.fitness[i]) return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  emp::Random rnd(31);
+  const StoredLandscape first = MakeLandscape(rnd, 1, LandscapeKind::KNOCKOUT, 5, 12);
+  const StoredLandscape second = MakeLandscape(rnd, 2, LandscapeKind::SUBSTITUTION, 5, 300);
+  const StoredLandscape first_again = MakeLandscape(rnd, 1, LandscapeKind::KNOCKOUT, 5, 7);
+  const StoredLandscape third = MakeLandscape(rnd, 1, LandscapeKind::KNOCKOUT, 6, 1);
+
+  // In memory.
+  {
+    LandscapeStore store;
+    StoredLandscape found;
+    CHECK(!store.Find(1, 99, LandscapeKind::KNOCKOUT, 5, found));
+    CHECK(store.Append(first) && store.Append(second));
+    CHECK(StoreHolds(store, {first, second}));
+    CHECK(store.Append(first_again) && store.Append(third));
+    CHECK(store.GetNumBlocks() == 4);
+    CHECK(StoreHolds(store, {second, first_again, third}));
+    LandscapeTable all;
+    store.LoadTable(all, false);
+    CHECK(all.GetNumLandscapes() == 4);
+    CHECK(all.GetSize() == first.GetSize() + second.GetSize() + first_again.GetSize() + third.GetSize());
+  }
+
+  // In a file: reopened with its index, without it, and after a crash mid-append.
+  std::remove(TEST_STORE_PATH.c_str());
+  std::remove((TEST_STORE_PATH + ".idx").c_str());
+  {
+    LandscapeStore store;
+    CHECK(store.Open(TEST_STORE_PATH));
+    CHECK(store.Append(first) && store.Append(second) && store.Append(first_again));
+  }
+  uint64_t data_size = 0;
+  {
+    LandscapeStore store;
+    CHECK(store.Open(TEST_STORE_PATH));
+    CHECK(StoreHolds(store, {second, first_again}));
+    data_size = store.GetDataSize();
+  }
+  std::remove((TEST_STORE_PATH + ".idx").c_str());
+  {
+    LandscapeStore store;
+    CHECK(store.Open(TEST_STORE_PATH));
+    CHECK(StoreHolds(store, {second, first_again}));
+    CHECK(store.GetDataSize() == data_size);
+  }
+  {
+    // Half a block at the end of the file, as if the process died while appending it.
+    std::ofstream data(TEST_STORE_PATH, std::ios::binary | std::ios::app);
+    data.write("LSLB\x10\0\0\0", 8);
+  }
+  {
+    LandscapeStore store;
+    CHECK(store.Open(TEST_STORE_PATH));
+    CHECK(StoreHolds(store, {second, first_again}));
+    CHECK(store.Append(third));
+  }
+  {
+    LandscapeStore store;
+    CHECK(store.Open(TEST_STORE_PATH));
+    CHECK(StoreHolds(store, {second, first_again, third}));
+  }
+  {
+    std::ofstream data(TEST_STORE_PATH, std::ios::binary | std::ios::trunc);
+    data.write("NOTASTORE", 9);
+  }
+  {
+    LandscapeStore store;
+    CHECK(!store.Open(TEST_STORE_PATH));
+    CHECK(store.GetPath().empty() && store.GetNumLandscapes() == 0);
+  }
+  std::remove(TEST_STORE_PATH.c_str());
+  std::remove((TEST_STORE_PATH + ".idx").c_str());
+
+  // Mutational landscapes survive StoreMatrix/LoadMatrix (NaNs, the missing mutations, included).
+  {
+    emp::Ptr<inst_lib_t> inst_lib = emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib());
+    AddRoleInstructions(*inst_lib);
+    const program_t prog = GenRandomProgram(rnd, inst_lib, 2, 5);
+    SubstitutionMatrix matrix(inst_lib->GetSize());
+    for (size_t fID = 0; fID < prog.GetSize(); ++fID)
+      for (size_t iID = 0; iID < prog[fID].GetSize(); ++iID) matrix.positions.emplace_back(fID, iID);
+    matrix.base_fitness = 3.5;
+    for (size_t i = 0; i < matrix.GetNumRows() * matrix.GetNumCols(); ++i) {
+      matrix.fitness.emplace_back(rnd.P(0.3) ? NAN : (float)rnd.GetDouble(0.0, 5.0));
+    }
+    const StoredLandscape stored = StoreMatrix(matrix, LandscapeCache::Hash(prog), 7, 2);
+    const SubstitutionMatrix loaded = LoadMatrix(stored, prog);
+    CHECK(loaded.base_fitness == matrix.base_fitness);
+    CHECK(loaded.positions == matrix.positions);
+    bool same = loaded.fitness.size() == matrix.fitness.size();
+    for (size_t i = 0; same && i < matrix.fitness.size(); ++i) {
+      same = std::isnan(matrix.fitness[i]) ? std::isnan(loaded.fitness[i]) : loaded.fitness[i] == matrix.fitness[i];
+    }
+    CHECK(same);
+    inst_lib.Delete();
+  }
+
+  return TestResult("LandscapeStore");
+}
@@ -0,0 +1,98 @@
+// Program optimizer equivalence (build and run with: make test): TIMING-optimized programs give the same
+// role IDs on every update (and the same fitness) as the originals, for random programs over the whole
+// instruction set and over straight-line arithmetic; FAST and NONE keep their structural promises.
+
+#include <string>
+
+#include "deme/Deme.h"
+#include "deme/ProgramOptimizer.h"
+#include "deme/RandomProgram.h"
+#include "deme/RoleTask.h"
+
+#include "check.h"
+
+constexpr size_t TEST_EVAL_TIME = 40;
+constexpr size_t TEST_PROGRAMS = 150;
+
+// Role IDs of every cell after each update of running prog on deme (from seed).
+emp::vector<emp::vector<double>> RunRoles(Deme & deme, const program_t & prog, int seed) {
+  Agent agent(prog);
+  deme.rnd->ResetSeed(seed);
+  deme.LoadAgent(&agent);
+  emp::vector<emp::vector<double>> roles;
+  for (size_t t = 0; t < TEST_EVAL_TIME; ++t) {
+    deme.SingleAdvance();
+    roles.emplace_back(deme.traits.role_id);
+  }
+  return roles;
+}
+
+int main() {
+  emp::Ptr<event_lib_t> event_lib = emp::NewPtr<event_lib_t>(*emp::EventDrivenGP::DefaultEventLib());
+  emp::Ptr<inst_lib_t> inst_lib = emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib());
+  AddRoleInstructions(*inst_lib);
+  const ProgramOptimizer optimizer(*inst_lib);
+  const size_t nop_id = inst_lib->GetID("Nop");
+  const size_t set_mem_id = inst_lib->GetID("SetMem");
+
+  // A constant folded and its dead producer dropped: SetMem 0 3; Inc 0; SetRoleID 0.
+  {
+    program_t prog(inst_lib);
+    prog.PushFunction(fun_t());
+    prog.PushInst(set_mem_id, 0, 3, 0);
+    prog.PushInst(inst_lib->GetID("Inc"), 0, 0, 0);
+    prog.PushInst(inst_lib->GetID("SetRoleID"), 0, 0, 0);
+    OptimizeReport report;
+    const program_t timing = optimizer.Optimize(prog, ProgramOptLevel::TIMING, &report);
+    CHECK(timing[0].GetSize() == 3);
+    CHECK(timing[0][0].id == nop_id);
+    CHECK(timing[0][1].id == set_mem_id && timing[0][1].args[0] == 0 && timing[0][1].args[1] == 4);
+    CHECK(report.folded == 1 && report.dead == 1);
+    CHECK(report.work_before == 3 && report.work_after == 2);
+    const program_t fast = optimizer.Optimize(prog, ProgramOptLevel::FAST);
+    CHECK(fast[0].GetSize() == 2);
+  }
+
+  const emp::vector<std::string> straight_names = { "Inc", "Dec", "Not", "Add", "Sub", "Mult", "TestEqu", "TestNEqu",
+                                                    "TestLess", "SetMem", "CopyMem", "SwapMem", "Nop", "GetRoleID",
+                                                    "SetRoleID" };
+  emp::vector<size_t> straight_ids;
+  for (const std::string & name : straight_names) straight_ids.emplace_back(inst_lib->GetID(name));
+  emp::vector<size_t> all_ids(inst_lib->GetSize());
+  for (size_t id = 0; id < all_ids.size(); ++id) all_ids[id] = id;
+
+  emp::Random rnd(12);
+  Deme deme(&rnd, 3, 3, event_lib, inst_lib);
+  size_t changed = 0;
+  for (size_t i = 0; i < TEST_PROGRAMS; ++i) {
+    const emp::vector<size_t> & ids = (i % 2) ? all_ids : straight_ids;
+    const program_t prog = GenRandomProgram(rnd, inst_lib, 1 + i % 3, 4 + i % 13, ids);
+    OptimizeReport report;
+    const program_t timing = optimizer.Optimize(prog, ProgramOptLevel::TIMING, &report);
+    if (report.folded || report.dead) ++changed;
+    CHECK(SameProgram(optimizer.Optimize(prog, ProgramOptLevel::NONE), prog));
+    CHECK(report.inst_cnt_after == report.inst_cnt_before);
+    CHECK(report.work_after <= report.work_before);
+    bool same_shape = timing.GetSize() == prog.GetSize();
+    for (size_t fID = 0; same_shape && fID < prog.GetSize(); ++fID) same_shape = timing[fID].GetSize() == prog[fID].GetSize();
+    CHECK(same_shape);
+
+    const int seed = (int)i + 1;
+    deme.SetOptLevel(ProgramOptLevel::NONE);
+    CHECK(RunRoles(deme, timing, seed) == RunRoles(deme, prog, seed));
+    // The deme's own optimizing load agrees too.
+    deme.SetOptLevel(ProgramOptLevel::TIMING);
+    const emp::vector<emp::vector<double>> deme_opt_roles = RunRoles(deme, prog, seed);
+    deme.SetOptLevel(ProgramOptLevel::NONE);
+    CHECK(deme_opt_roles == RunRoles(deme, prog, seed));
+
+    const program_t fast = optimizer.Optimize(prog, ProgramOptLevel::FAST, &report);
+    CHECK(report.inst_cnt_after <= report.inst_cnt_before);
+    CHECK(report.work_after == report.inst_cnt_after);    // No Nops left.
+  }
+  CHECK(changed > 0);
+
+  inst_lib.Delete();
+  event_lib.Delete();
+  return TestResult("ProgramOptimizer");
+}
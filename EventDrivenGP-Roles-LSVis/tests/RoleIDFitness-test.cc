@@ -0,0 +1,73 @@
+// Incremental role-ID fitness (build and run with: make test): random SetRoleID/ClearRoleIDs sequences,
+// with invalid and repeated IDs and deme resets in between, always score what a rescan of the deme's role
+// IDs does.
+
+#include <unordered_set>
+
+#include "deme/Deme.h"
+#include "deme/RoleTask.h"
+#include "tools/Random.h"
+
+#include "check.h"
+
+constexpr size_t TEST_STEPS = 20000;
+
+// Role-ID fitness from scratch: cells with a valid ID, plus unique valid IDs once every cell has one.
+double ScanRoleIDFitness(const emp::vector<double> & role_ids) {
+  std::unordered_set<double> valid_ids;
+  size_t valid_id_cnt = 0;
+  for (double id : role_ids) {
+    if (id <= 0 || id > (double)role_ids.size()) continue;
+    ++valid_id_cnt;
+    valid_ids.insert(id);
+  }
+  if (valid_id_cnt < role_ids.size()) return (double)valid_id_cnt;
+  return (double)(valid_id_cnt + valid_ids.size());
+}
+
+int main() {
+  emp::Ptr<event_lib_t> event_lib = emp::NewPtr<event_lib_t>(*emp::EventDrivenGP::DefaultEventLib());
+  emp::Ptr<inst_lib_t> inst_lib = emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib());
+  AddRoleInstructions(*inst_lib);
+  emp::Random rnd(11);
+  Agent agent(inst_lib);
+
+  for (size_t size : {1, 3, 4}) {
+    Deme deme(&rnd, size, size, event_lib, inst_lib);
+    const int num_cells = (int)(size * size);
+    CHECK(RoleIDFitness(&deme) == 0.0);
+    deme.LoadAgent(&agent);
+    for (size_t step = 0; step < TEST_STEPS; ++step) {
+      const size_t cell = rnd.GetUInt((uint32_t)num_cells);
+      const double choice = rnd.GetDouble();
+      if (choice < 0.002) {
+        deme.traits.ClearRoleIDs();
+      } else if (choice < 0.004) {
+        deme.Reset();  // Back to clean_traits.
+        CHECK(deme.traits.role_id == deme.clean_traits.role_id);
+        CHECK(RoleIDFitness(&deme) == 0.0);
+        deme.LoadAgent(&agent);
+      } else if (choice < 0.2) {
+        // Invalid IDs: zero, negative, or past the number of cells.
+        const int bad_ids[] = { 0, -1 - rnd.GetInt(3), num_cells + 1 + rnd.GetInt(3) };
+        deme.traits.SetRoleID(cell, bad_ids[rnd.GetUInt(3)]);
+      } else if (choice < 0.3) {
+        deme.traits.SetRoleID(cell, (int)deme.traits.role_id[cell]);  // Same ID again.
+      } else if (choice < 0.5) {
+        // An ID some other cell already holds.
+        deme.traits.SetRoleID(cell, (int)deme.traits.role_id[rnd.GetUInt((uint32_t)num_cells)]);
+      } else {
+        deme.traits.SetRoleID(cell, 1 + rnd.GetInt(num_cells));
+      }
+      CHECK(RoleIDFitness(&deme) == ScanRoleIDFitness(deme.traits.role_id));
+    }
+    // Every cell valid with all IDs distinct: the top score.
+    for (int i = 0; i < num_cells; ++i) deme.traits.SetRoleID((size_t)i, num_cells - i);
+    CHECK(RoleIDFitness(&deme) == 2.0 * num_cells);
+    CHECK(RoleIDFitness(&deme) == ScanRoleIDFitness(deme.traits.role_id));
+  }
+
+  inst_lib.Delete();
+  event_lib.Delete();
+  return TestResult("RoleIDFitness");
+}
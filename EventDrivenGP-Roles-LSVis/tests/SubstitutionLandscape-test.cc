@@ -0,0 +1,101 @@
+// Mutational landscapes (build and run with: make test): every entry of a SubstitutionLandscape matches
+// evaluating that mutant on its own, a cached re-run gives the same matrix without evaluating anything,
+// and the LSSM format round-trips the matrix bit for bit.
+
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+#include "deme/Deme.h"
+#include "deme/RandomProgram.h"
+#include "deme/RoleTask.h"
+#include "deme/SubstitutionLandscape.h"
+
+#include "check.h"
+
+constexpr size_t TEST_EVAL_TIME = 40;
+constexpr int TEST_SEED = 3;
+
+bool SameMatrix(const SubstitutionMatrix & a, const SubstitutionMatrix & b) {
+  return a.num_ops == b.num_ops && a.positions == b.positions && a.fitness.size() == b.fitness.size()
+    && std::memcmp(&a.base_fitness, &b.base_fitness, sizeof(double)) == 0
+    && std::memcmp(a.fitness.data(), b.fitness.data(), a.fitness.size() * sizeof(float)) == 0;
+}
+
+int main() {
+  emp::Ptr<event_lib_t> event_lib = emp::NewPtr<event_lib_t>(*emp::EventDrivenGP::DefaultEventLib());
+  emp::Ptr<inst_lib_t> inst_lib = emp::NewPtr<inst_lib_t>(*emp::EventDrivenGP::DefaultInstLib());
+  AddRoleInstructions(*inst_lib);
+  emp::Random rnd(3);
+  const program_t prog = GenRandomProgram(rnd, inst_lib, 2, 3);
+
+  emp::Random rnd0(1);
+  emp::Random rnd1(2);
+  Deme deme0(&rnd0, 3, 3, event_lib, inst_lib);
+  Deme deme1(&rnd1, 3, 3, event_lib, inst_lib);
+  auto eval_program = [](Deme & deme, const program_t & eval_prog) {
+    Agent agent(eval_prog);
+    return EvaluateAgent(deme, &agent, TEST_EVAL_TIME);
+  };
+  auto eval_alone = [&](const program_t & eval_prog) {
+    deme0.rnd->ResetSeed(TEST_SEED);
+    return (float)eval_program(deme0, eval_prog);
+  };
+
+  LandscapeCache cache;
+  const SubstitutionMatrix matrix = SubstitutionLandscape(prog, {&deme0, &deme1}, eval_program, TEST_SEED, cache);
+  CHECK(matrix.GetNumRows() == 6);
+  CHECK(matrix.GetNumCols() == inst_lib->GetSize() + 2 * MAX_INST_ARGS);
+  CHECK((float)matrix.base_fitness == eval_alone(prog));
+  for (size_t row = 0; row < matrix.GetNumRows(); ++row) {
+    const size_t fID = matrix.positions[row].first;
+    const size_t iID = matrix.positions[row].second;
+    const inst_t & base_inst = prog[fID].inst_seq[iID];
+    program_t mutant(prog);
+    for (size_t op = 0; op < inst_lib->GetSize(); ++op) {
+      const float val = matrix.Get(row, matrix.GetOpCol(op));
+      if (op == base_inst.id) { CHECK(std::isnan(val)); continue; }
+      inst_t inst(base_inst);
+      inst.id = op;
+      mutant.SetInst(fID, iID, inst);
+      CHECK(val == eval_alone(mutant));
+    }
+    for (size_t arg = 0; arg < MAX_INST_ARGS; ++arg) {
+      for (bool up : {false, true}) {
+        const float val = matrix.Get(row, matrix.GetArgCol(arg, up));
+        if (arg >= inst_lib->GetNumArgs(base_inst.id)) { CHECK(std::isnan(val)); continue; }
+        inst_t inst(base_inst);
+        inst.args[arg] = (int)(((size_t)inst.args[arg] + (up ? 1 : CPU_SIZE - 1)) % CPU_SIZE);
+        mutant.SetInst(fID, iID, inst);
+        CHECK(val == eval_alone(mutant));
+      }
+    }
+    mutant.SetInst(fID, iID, base_inst);
+  }
+
+  // Everything is cached now: the same matrix comes back without any new evaluations.
+  const size_t cached = cache.GetSize();
+  const SubstitutionMatrix again = SubstitutionLandscape(prog, {&deme0, &deme1}, eval_program, TEST_SEED, cache);
+  CHECK(SameMatrix(again, matrix));
+  CHECK(cache.GetSize() == cached);
+  CHECK(cache.GetHits() > 0);
+
+  // LSSM round trip; truncated or foreign data reads as an empty matrix.
+  std::stringstream lssm;
+  matrix.Write(lssm);
+  const std::string bytes = lssm.str();
+  SubstitutionMatrix read;
+  CHECK(read.Read(lssm));
+  CHECK(SameMatrix(read, matrix));
+  std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+  CHECK(!read.Read(truncated));
+  CHECK(read.GetNumRows() == 0 && read.fitness.empty());
+  std::string bad_magic(bytes);
+  bad_magic[0] = 'X';
+  std::stringstream foreign(bad_magic);
+  CHECK(!read.Read(foreign));
+
+  inst_lib.Delete();
+  event_lib.Delete();
+  return TestResult("SubstitutionLandscape");
+}
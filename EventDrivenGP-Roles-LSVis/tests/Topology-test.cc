@@ -0,0 +1,124 @@
+// Topology construction and text round trip (build and run with: make test): every type survives
+// Write/ReadTopology unchanged (sends included), neighbor counts and symmetry hold, the default
+// topology sends the way the original deme did, and bad parameters give an empty topology.
+
+#include <sstream>
+#include <string>
+
+#include "deme/Topology.h"
+
+#include "check.h"
+
+// Cell the original deme sent to from id: a random cell of the 3x3 block around it (id included).
+size_t OriginalSend(size_t id, emp::Random & rnd, size_t width, size_t height) {
+  const int offset = rnd.GetInt(9);
+  const int x = (int)(id % width) + offset % 3 - 1;
+  const int y = (int)(id / width) + offset / 3 - 1;
+  return (size_t)emp::Mod(x, (int)width) + (size_t)emp::Mod(y, (int)height) * width;
+}
+
+Topology RoundTrip(const Topology & topology) {
+  std::stringstream ss;
+  topology.Write(ss);
+  std::string header;
+  size_t num_cells = 0;
+  ss >> header >> num_cells;
+  std::getline(ss, header);
+  CHECK(num_cells == topology.GetSize());
+  return ReadTopology(ss, num_cells);
+}
+
+bool SameSends(const Topology & a, const Topology & b, int seed) {
+  emp::Random rnd_a(seed);
+  emp::Random rnd_b(seed);
+  for (size_t i = 0; i < 20 * a.GetSize(); ++i) {
+    const size_t id = i % a.GetSize();
+    if (a.GetRandomNeighbor(id, rnd_a) != b.GetRandomNeighbor(id, rnd_b)) return false;
+  }
+  return true;
+}
+
+bool IsSymmetric(const Topology & topology) {
+  for (size_t id = 0; id < topology.GetSize(); ++id) {
+    for (size_t i = 0; i < topology.GetDegree(id); ++i) {
+      const size_t nID = topology.GetNeighbor(id, i);
+      bool back = false;
+      topology.ForEachNeighbor(nID, [&](size_t n) { back = back || n == id; });
+      if (!back) return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  const emp::vector<TopologyType> types = { TopologyType::DEFAULT, TopologyType::VON_NEUMANN, TopologyType::MOORE,
+                                            TopologyType::HEX, TopologyType::SMALL_WORLD,
+                                            TopologyType::RANDOM_REGULAR };
+  for (TopologyType type : types) {
+    TopologyType parsed = TopologyType::DEFAULT;
+    CHECK(ParseTopologyType(TopologyName(type), parsed) && parsed == type);
+    emp::Random rnd(11);
+    const double param = type == TopologyType::SMALL_WORLD ? 0.2 : 5;
+    const Topology topology = BuildTopology(type, 6, 4, rnd, param);
+    CHECK(topology.GetSize() == 24);
+    CHECK(topology.GetOffsets().size() == 25);
+    CHECK(topology.GetOffsets().back() == topology.GetAdjacency().size());
+    CHECK(IsSymmetric(topology));
+    const Topology read = RoundTrip(topology);
+    CHECK(read.GetOffsets() == topology.GetOffsets());
+    CHECK(read.GetAdjacency() == topology.GetAdjacency());
+    CHECK(read.HasSendCandidates() == topology.HasSendCandidates());
+    CHECK(SameSends(read, topology, 3));
+  }
+
+  // Neighbor counts.
+  emp::Random rnd(5);
+  for (size_t id = 0; id < 24; ++id) {
+    CHECK(BuildVonNeumannTorus(6, 4).GetDegree(id) == 4);
+    CHECK(BuildDefaultTorus(6, 4).GetDegree(id) == 4);
+    CHECK(BuildMooreTorus(6, 4).GetDegree(id) == 8);
+    CHECK(BuildHexTorus(6, 4).GetDegree(id) == 6);
+  }
+  const Topology regular = BuildRandomRegular(24, 5, rnd);
+  for (size_t id = 0; id < regular.GetSize(); ++id) CHECK(regular.GetDegree(id) == 5);
+
+  // Default topology: sends to the 3x3 block like the original deme; FixedTorus agrees with it.
+  CHECK(BuildDefaultTorus(5, 5).HasSendCandidates());
+  CHECK(!BuildVonNeumannTorus(5, 5).HasSendCandidates());
+  for (size_t width : {3, 5, 7}) {
+    for (size_t height : {3, 4, 5}) {
+      const Topology topology = Topology::Default(width, height);
+      emp::Random rnd_orig(9);
+      emp::Random rnd_topo(9);
+      bool same = true;
+      for (size_t i = 0; i < 100 * width * height; ++i) {
+        const size_t id = i % (width * height);
+        same = same && OriginalSend(id, rnd_orig, width, height) == topology.GetRandomNeighbor(id, rnd_topo);
+      }
+      CHECK(same);
+    }
+  }
+  {
+    const Topology topology = Topology::Default(5, 5);
+    bool same = true;
+    for (int seed = 1; seed < 200; ++seed) {
+      emp::Random rnd_fixed(seed);
+      emp::Random rnd_topo(seed);
+      const size_t id = (size_t)seed % 25;
+      same = same && FixedTorus<5, 5>::GetRandomNeighbor(id, rnd_fixed) == topology.GetRandomNeighbor(id, rnd_topo);
+      for (size_t i = 0; i < 4; ++i) same = same && FixedTorus<5, 5>::GetNeighbor(id, i) == topology.GetNeighbor(id, i);
+    }
+    CHECK(same);
+  }
+
+  // Bad parameters.
+  CHECK(BuildTopology(TopologyType::SMALL_WORLD, 4, 4, rnd, -0.1).GetSize() == 0);
+  CHECK(BuildTopology(TopologyType::SMALL_WORLD, 4, 4, rnd, 1.5).GetSize() == 0);
+  CHECK(BuildTopology(TopologyType::RANDOM_REGULAR, 4, 4, rnd, 2.5).GetSize() == 0);
+  CHECK(BuildTopology(TopologyType::RANDOM_REGULAR, 4, 4, rnd, 16).GetSize() == 0);
+  CHECK(BuildTopology(TopologyType::RANDOM_REGULAR, 4, 4, rnd, -1).GetSize() == 0);
+  CHECK(BuildRandomRegular(5, 3, rnd).GetSize() == 0);  // Odd number of edge ends.
+  CHECK(BuildRandomRegular(4, 4, rnd).GetSize() == 0);  // Degree too big.
+
+  return TestResult("Topology");
+}
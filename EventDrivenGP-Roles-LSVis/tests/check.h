@@ -0,0 +1,36 @@
+/*
+  tests/check.h
+
+  Minimal checks for the native tests (build and run them all with: make test). A failed CHECK prints
+  where and what failed and is counted; each test's main returns TestResult(name).
+*/
+
+#ifndef LSVIS_TESTS_CHECK_H
+#define LSVIS_TESTS_CHECK_H
+
+#include <iostream>
+#include <string>
+
+inline size_t & CheckFailures() {
+  static size_t failures = 0;
+  return failures;
+}
+
+#define CHECK(COND) do {                                                                   \
+    if (!(COND)) {                                                                         \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #COND << std::endl;   \
+      ++CheckFailures();                                                                   \
+    }                                                                                      \
+  } while (0)
+
+/// Prints the test's outcome; returns main's exit code (non-zero if any check failed).
+inline int TestResult(const std::string & name) {
+  if (CheckFailures()) {
+    std::cout << name << ": " << CheckFailures() << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << name << ": ok" << std::endl;
+  return 0;
+}
+
+#endif
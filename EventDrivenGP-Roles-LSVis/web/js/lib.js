@@ -1,4 +1,21 @@
 var program_name_set = new Set();
+// Program view (see drawProgVis). Only rows on screen (give or take margin_rows) are ever in the svg.
+var prog_vis_state = {
+  program: null,    // Program data being shown; functions also get fID, row (of their header) and collapsed.
+  num_rows: 0,
+  iblk_h: 20,
+  iblk_w: 65,
+  fblk_w: 100,
+  fitblk_w: 10,
+  txt_lpad: 2,
+  margin_rows: 30,
+  xScale: null,
+  func_font: null,  // Font size/shift for function and instruction labels (see fitProgVisText).
+  inst_font: null,
+  func_label: "",   // Longest labels (what fonts get fit to).
+  inst_label: "",
+  render_pending: false
+};
 var prog_reader = new FileReader();
 var control = document.getElementById("prog-file-selector");
 prog_reader.onload = function(){ emp.read_prog_from_str(control.files[0].name, prog_reader.result); };
@@ -17,7 +34,7 @@ var on_inst_click = function(inst, i) {
 };
 
 var on_func_click = function(func, i) {
-  emp.knockout_func(i);
+  emp.knockout_func(func.fID);
   var func_def = d3.select(this);
   if (func_def.attr("knockout") == "false") {
     func_def.attr("knockout", "true");
@@ -28,6 +45,14 @@ var on_func_click = function(func, i) {
   }
 };
 
+var on_func_collapse_click = function(func, i) {
+  emp.collapse_func(func.fID);
+  func.collapsed = !func.collapsed;
+  layoutProgVis();
+  d3.select("#program-vis").select("svg").attr({"height": prog_vis_state.num_rows * prog_vis_state.iblk_h});
+  renderProgVis();
+};
+
 var on_deme_cell_click = function(d, i) {
   emp.deme_cell_knockout(i);
   var cell = d3.select(this.parentNode);
@@ -64,16 +89,20 @@ var landscapeProg = function() {
   var prog_vis = d3.select("#program-vis");
   var svg = prog_vis.select("svg");
   var functions = svg.selectAll(".program-function");
-  functions.each(function(func, fID) {
+  functions.each(function(func) {
+    var fID = func.fID;
     // var instructions = d3.select(this).selectAll(".program-instruction");
     var ls_blks = d3.select(this).selectAll(".fitness-contribution-blk");
     ls_blks.attr({
-      "fill": function(d, i) {
-        if (emp.is_code_knockedout(fID, i)) {
+      "fill": function(inst) {
+        var iID = inst.position;
+        if (emp.is_code_knockedout(fID, iID)) {
           return "black";
         } else {
-          var built_loc = emp.original_to_built_prog_space(fID, i);
+          var built_loc = emp.original_to_built_prog_space(fID, iID);
           if (built_loc.fID == -1 && built_loc.iID == -1) return "black";
+          // Landscaping may still be in progress (worker builds stream results in).
+          if (!emp.has_landscape_val(-1, -1) || !emp.has_landscape_val(built_loc.fID, built_loc.iID)) return "white";
           // Terrible and hacky color coding. (no support for negative fitness).
           var base_fitness = emp.get_landscape_val(-1, -1);
           var ko_fitness = emp.get_landscape_val(built_loc.fID, built_loc.iID);
@@ -86,99 +115,320 @@ var landscapeProg = function() {
         }
       }
     });
+    // Collapsed functions summarize their instructions' landscape (min/mean/max, top to bottom).
+    var effects = [];
+    if (func.collapsed) {
+      var summary = emp.get_func_landscape_summary(fID);
+      if (summary.min >= 0.0) effects = [summary.min, summary.mean, summary.max];
+    }
+    drawProgSummaryBlks(d3.select(this), "function-summary-blk", effects, cScale,
+                        prog_vis_state.xScale(prog_vis_state.fblk_w - prog_vis_state.fitblk_w));
   });
 }
 
-// Ran into some weird bugs... just redraw the entire thing for now.
-var resizeProgVis = function() {
-  var prog_vis = d3.select("#program-vis");
-  var svg = prog_vis.select("svg");
+// Stack a block per effect (relative fitness) at x in the fitness contribution column of a program view row.
+var drawProgSummaryBlks = function(row, cls, effects, cScale, x) {
+  var blk_h = prog_vis_state.iblk_h / effects.length;
+  var blks = row.selectAll("." + cls).data(effects);
+  blks.enter().append("rect");
+  blks.exit().remove();
+  blks.attr({"class": cls,
+             "x": x,
+             "y": function(d, i) { return i * blk_h; },
+             "width": prog_vis_state.xScale(prog_vis_state.fitblk_w),
+             "height": blk_h,
+             "pointer-events": "none"})
+      .style("fill", function(d) { return cScale(Math.min(d, 2.0)); });
+}
 
-  var iblk_h= 20;
-  var iblk_w = 65;
-  var fblk_w = 100;
-  var fitblk_w = 10;
-  var iblk_lpad = fblk_w - (iblk_w + fitblk_w);
-  var txt_lpad = 2;
+// Rows of the program view currently on screen, as [first, last] (each function takes a row for its
+// header, then a row per instruction unless it's collapsed).
+var visibleProgRows = function() {
+  var svg = d3.select("#program-vis").select("svg");
+  if (svg.empty()) return [0, -1];
+  var iblk_h = prog_vis_state.iblk_h;
+  var rect = svg.node().getBoundingClientRect();
+  var top = Math.max(0, -rect.top);
+  var bottom = Math.min(rect.height, window.innerHeight - rect.top);
+  if (bottom <= top) return [0, -1];
+  return [Math.floor(top / iblk_h), Math.floor(bottom / iblk_h)];
+}
 
-  var vis_w = prog_vis[0][0].clientWidth;
+// Mutational landscape: split each instruction's fitness contribution block into its min/mean/max
+// relative fitness over every single-point mutation (top to bottom).
+var mutationLandscapeProg = function() {
+  var cScale = d3.scale.linear().domain([0, 1.0, 2.0]).range(["#b2182b", "grey", "#2166ac"]);
+  var svg = d3.select("#program-vis").select("svg");
+  svg.selectAll(".mutation-effect-blk").remove();
+  svg.selectAll(".program-function").each(function(func) {
+    d3.select(this).selectAll(".program-instruction").each(function(inst) {
+      var built_loc = emp.original_to_built_prog_space(func.fID, inst.position);
+      if (built_loc.fID == -1 || !emp.has_mutation_summary(built_loc.fID, built_loc.iID)) return;
+      var summary = emp.get_mutation_summary(built_loc.fID, built_loc.iID);
+      drawProgSummaryBlks(d3.select(this), "mutation-effect-blk", [summary.min, summary.mean, summary.max], cScale,
+                          d3.select(this).select(".fitness-contribution-blk").attr("x"));
+    });
+  });
+}
 
-  var x_domain = Array(0, 100);
-  var x_range = Array(0, vis_w);
-  var xScale = d3.scale.linear().domain(x_domain).range(x_range);
+// Cell knockout landscape: shade each deme cell by fitness with it knocked out (relative to base fitness;
+// -1 => not known yet). Same colors as landscapeProg.
+var landscapeDeme = function(rel_fitness) {
+  var cScale = d3.scale.linear().domain([0, 1.0, 2.0]).range(["#b2182b", "grey", "#2166ac"]);
+  var cells = d3.select("#deme-vis").select("svg").selectAll(".deme_cell");
+  cells.select("rect").attr({
+    "fill": function(d) {
+      var rel = rel_fitness[d.loc];
+      if (rel < 0.0) return "white";
+      return cScale(Math.min(rel, 2.0));
+    }
+  });
+}
 
-  // Update width/x attributes (height/y never changes with resize).
-  svg.attr({"width": xScale(fblk_w)});
+// Execution profile overlay: shade each instruction proportional to how often it executed in the last run.
+var profileProg = function() {
+  var svg = d3.select("#program-vis").select("svg");
+  var max_cnt = emp.get_max_exec_count();
   var functions = svg.selectAll(".program-function");
+  functions.each(function(func) {
+    var fID = func.fID;
+    d3.select(this).selectAll(".program-instruction").each(function(inst) {
+      var iID = inst.position;
+      var cnt = 0;
+      if (max_cnt > 0 && !emp.is_code_knockedout(fID, iID) && !emp.is_code_knockedout(fID, -1)) {
+        var built_loc = emp.original_to_built_prog_space(fID, iID);
+        if (built_loc.fID != -1) cnt = emp.get_exec_count(built_loc.fID, built_loc.iID);
+      }
+      var blk_w = d3.select(this).select(".program-instruction-blk").attr("width");
+      d3.select(this).select(".exec-profile-blk")
+                     .attr({"width": (max_cnt > 0) ? blk_w * cnt / max_cnt : 0});
+    });
+  });
+}
+
+var downloadText = function(text, filename, mime_type) {
+  var link = document.createElement("a");
+  link.href = URL.createObjectURL(new Blob([text], {type: mime_type}));
+  link.download = filename;
+  document.body.appendChild(link);
+  link.click();
+  document.body.removeChild(link);
+}
+
+var downloadBytes = function(bytes, filename) {
+  downloadText(bytes, filename, "application/octet-stream");
+}
+
+// Open a deme trace file (written by 'Save Trace' or the native tracer) for replay.
+var readTraceFile = function(file) {
+  if (!file) return;
+  var reader = new FileReader();
+  reader.onload = function() {
+    var bytes = new Uint8Array(reader.result);
+    var hex = "";
+    for (var i = 0; i < bytes.length; ++i) hex += (bytes[i] < 16 ? "0" : "") + bytes[i].toString(16);
+    emp.load_trace_hex(hex);
+  };
+  reader.readAsArrayBuffer(file);
+}
+
+var progFuncLabel = function(func, collapsed) {
+  var label = "fn-" + func.fID + " " + func.affinity + ":";
+  if (collapsed) label += " " + func.sequence_len + " inst";
+  return label;
+}
+
+var progInstLabel = function(inst) {
+  var inst_str = inst.name;
+  if (inst.has_affinity) inst_str += " " + inst.affinity;
+  for (var arg = 0; arg < inst.num_args; arg++) inst_str += " " + inst.args[arg];
+  return inst_str;
+}
+
+// Font size (and vertical shift) that fits label (of class cls) in a w x h block. Measured once on a
+// throwaway element; every label of the same kind is drawn at that size.
+var fitProgVisText = function(svg, cls, label, w, h) {
+  var probe = svg.append("text").attr({"class": cls, "y": h}).style("font-size", "10px").text(label);
+  var box = probe.node().getBBox();
+  var fsize = (box.width > 0 && box.height > 0) ? Math.min(w/box.width, h/box.height)*0.9*10 : 10;
+  probe.style("font-size", fsize + "px");
+  box = probe.node().getBBox();
+  probe.remove();
+  return {"size": fsize + "px", "dy": (-1 * ((h - box.height)/2 + 2)) + "px"};
+}
+
+// Lay out rows: each function takes a row for its header, then a row per instruction unless it's collapsed.
+var layoutProgVis = function() {
+  var row = 0;
+  prog_vis_state.program["functions"].forEach(function(func) {
+    func.row = row;
+    row += 1 + (func.collapsed ? 0 : func.sequence_len);
+  });
+  prog_vis_state.num_rows = row;
+}
+
+// Show a program (see SetProgramData for its format).
+var drawProgVis = function(program_data) {
+  var state = prog_vis_state;
+  state.program = program_data;
+  state.func_label = "";
+  state.inst_label = "";
+  program_data["functions"].forEach(function(func, fID) {
+    func.fID = fID;
+    func.collapsed = emp.is_func_collapsed(fID);
+    var func_label = progFuncLabel(func, true);
+    if (func_label.length > state.func_label.length) state.func_label = func_label;
+    func.sequence.forEach(function(inst) {
+      var inst_label = progInstLabel(inst);
+      if (inst_label.length > state.inst_label.length) state.inst_label = inst_label;
+    });
+  });
+  layoutProgVis();
+  d3.select("#program-vis").select("svg").selectAll("*").remove();
+  resizeProgVis();
+}
+
+// Draw whatever rows of the program are on screen (plus a margin) and drop the rest.
+var renderProgVis = function() {
+  var state = prog_vis_state;
+  state.render_pending = false;
+  var svg = d3.select("#program-vis").select("svg");
+  if (!state.program || svg.empty()) return;
+  var iblk_h = state.iblk_h;
+  var iblk_lpad = state.fblk_w - (state.iblk_w + state.fitblk_w);
+  var txt_lpad = state.txt_lpad;
+  var xScale = state.xScale;
+
+  var rows = visibleProgRows();
+  var first = Math.max(0, rows[0] - state.margin_rows);
+  var last = rows[1] + state.margin_rows;
+  // Functions are in row order: find the first one that reaches first, then take them until last.
+  var funcs = state.program["functions"];
+  var lo = 0;
+  var hi = funcs.length;
+  while (lo < hi) {
+    var mid = Math.floor((lo + hi) / 2);
+    var func_end = funcs[mid].row + 1 + (funcs[mid].collapsed ? 0 : funcs[mid].sequence_len);
+    if (func_end <= first) lo = mid + 1;
+    else hi = mid;
+  }
+  var visible = [];
+  for (var fID = lo; fID < funcs.length && funcs[fID].row <= last; fID++) visible.push(funcs[fID]);
+
+  var functions = svg.selectAll(".program-function").data(visible, function(func) { return func.fID; });
+  var new_functions = functions.enter().append("g").attr({"class": "program-function"});
+  new_functions.append("rect")
+               .attr({"class": "function-collapse-blk", "height": iblk_h})
+               .on("click", on_func_collapse_click);
+  new_functions.append("text")
+               .attr({"class": "function-collapse-txt", "x": txt_lpad, "y": iblk_h, "pointer-events": "none"});
+  new_functions.append("rect")
+               .attr({"class": "function-def-rect", "height": iblk_h})
+               .on("click", on_func_click);
+  new_functions.append("text")
+               .attr({"class": "function-def-txt", "y": iblk_h, "pointer-events": "none"});
+  functions.exit().remove();
   functions.attr({
-    "transform": function(func, fID) {
-      var x_trans = xScale(0);
-      var y_trans = (fID * iblk_h + func.cumulative_seq_len * iblk_h);
-      return "translate(" + x_trans + "," + y_trans + ")";
-    }
+    "knockout": function(func) { return emp.is_code_knockedout(func.fID, -1) ? "true" : "false"; },
+    "transform": function(func) { return "translate(" + xScale(0) + "," + (func.row * iblk_h) + ")"; }
   });
-  var min_fsize = -1;
-  var func_blks = functions.selectAll(".function-def-rect");
-  func_blks.attr({"width": xScale(fblk_w)});
-  var func_txt = functions.selectAll(".function-def-txt");
-  func_txt.style("font-size", "1px");
-  func_txt.each(function(d) {
-    var box = this.getBBox();
-    var rbox = $(".function-def-rect")[0].getBBox();
-    var fsize = Math.min(rbox.width/box.width, rbox.height/box.height)*0.9;
-    if (min_fsize == -1 || fsize < min_fsize) {
-      min_fsize = fsize;
+  functions.select(".function-collapse-blk").attr({"width": xScale(state.fitblk_w)});
+  functions.select(".function-collapse-txt")
+           .text(function(func) { return func.collapsed ? "+" : "-"; })
+           .style("font-size", state.func_font.size)
+           .attr({"dy": state.func_font.dy});
+  functions.select(".function-def-rect")
+           .attr({
+             "x": xScale(state.fitblk_w),
+             "width": xScale(state.fblk_w - state.fitblk_w),
+             "knockout": function(func) { return emp.is_code_knockedout(func.fID, -1) ? "true" : "false"; }
+           });
+  functions.select(".function-def-txt")
+           .text(function(func) { return progFuncLabel(func, func.collapsed); })
+           .style("font-size", state.func_font.size)
+           .attr({"x": xScale(state.fitblk_w) + txt_lpad, "dy": state.func_font.dy});
+
+  // Draw the visible instructions of each (expanded) function.
+  functions.each(function(func) {
+    var seq = [];
+    if (!func.collapsed) {
+      var begin = Math.max(0, first - func.row - 1);
+      var end = Math.min(func.sequence_len, last - func.row);
+      if (end > begin) seq = func.sequence.slice(begin, end);
     }
-  });
-  func_txt.style("font-size", min_fsize)
-          .attr({
-            "dy": function(d) { return (-1 * 2.0)+"px"; }//return (-1 * (d.shift + 2)) + "px"; }
-          });
-
-  // Resize instructions for each function.
-  functions.each(function(func, fID) {
-    var instructions = d3.select(this).selectAll(".program-instruction");
+    var instructions = d3.select(this).selectAll(".program-instruction").data(seq, function(inst) { return inst.position; });
+    var new_instructions = instructions.enter().append("g").attr({"class": "program-instruction"});
+    new_instructions.append("rect")
+                    .attr({"class": "program-instruction-blk", "height": iblk_h})
+                    .on("click", on_inst_click);
+    new_instructions.append("text")
+                    .attr({"class": "program-instruction-txt", "x": txt_lpad, "y": iblk_h, "pointer-events": "none"})
+                    .text(progInstLabel);
+    // Fitness contribution indicator.
+    new_instructions.append("rect")
+                    .attr({"class": "fitness-contribution-blk", "height": iblk_h, "fill": "white"});
+    // Execution profile overlay (see profileProg).
+    new_instructions.append("rect")
+                    .attr({"class": "exec-profile-blk", "width": 0, "height": iblk_h, "pointer-events": "none"});
+    instructions.exit().remove();
     instructions.attr({
-      "transform": function(d, i) {
-                            var x_trans = xScale(iblk_lpad);
-                            var y_trans = (iblk_h + i * iblk_h);
-                            return "translate(" + x_trans + "," + y_trans + ")";
-                          }
-    });
-    var inst_blks = instructions.selectAll(".program-instruction-blk");
-    inst_blks.attr({"width": xScale(iblk_w)});
-    min_fsize = -1;
-    var inst_txt = instructions.selectAll(".program-instruction-txt");
-    inst_txt.style("font-size", "1px")
-                  .each(function(d) {
-                    var box = this.getBBox();
-                    var pbox = this.parentNode.getBBox();
-                    var fsize = Math.min(pbox.width/(box.width+1), pbox.height/box.height)*0.9;
-                    if (min_fsize == -1 || fsize < min_fsize) {
-                      min_fsize = fsize;
-                    }
-                  })
-                  .style("font-size", min_fsize)
-                  .each(function(d) {
-                    var box = this.getBBox();
-                    var pbox = this.parentNode.getBBox();
-                    d.shift = ((pbox.height - box.height)/2);
-                  })
-                  .attr({
-                    "dy": function(d) { return (-1 * (d.shift + 2)) + "px"; }
-                  });
-    var ls_blks = instructions.selectAll(".fitness-contribution-blk");
-    ls_blks.attr({
-      "x": xScale(iblk_w),
-      "width": xScale(fitblk_w)
+      "transform": function(inst) {
+        return "translate(" + xScale(iblk_lpad) + "," + (iblk_h + inst.position * iblk_h) + ")";
+      },
+      "knockout": function(inst) { return emp.is_code_knockedout(func.fID, inst.position) ? "true" : "false"; }
     });
+    instructions.select(".program-instruction-blk")
+                .attr({
+                  "width": xScale(state.iblk_w),
+                  "knockout": function(inst) { return emp.is_code_knockedout(func.fID, inst.position) ? "true" : "false"; }
+                });
+    instructions.select(".program-instruction-txt")
+                .style("font-size", state.inst_font.size)
+                .attr({"dy": state.inst_font.dy});
+    instructions.select(".fitness-contribution-blk")
+                .attr({"x": xScale(state.iblk_w), "width": xScale(state.fitblk_w)});
   });
+  // Overlays (only over what's drawn).
+  landscapeProg();
+  mutationLandscapeProg();
+  profileProg();
+}
+
+// Scrolling redraws at most once a frame.
+var scheduleProgVisRender = function() {
+  if (prog_vis_state.render_pending) return;
+  prog_vis_state.render_pending = true;
+  window.requestAnimationFrame(renderProgVis);
+}
+
+// Resizing changes every width and font size, so drop what's drawn and draw it again (only what's on
+// screen, so this stays cheap).
+var resizeProgVis = function() {
+  var state = prog_vis_state;
+  var prog_vis = d3.select("#program-vis");
+  var svg = prog_vis.select("svg");
+  if (!state.program || svg.empty()) return;
+
+  var vis_w = prog_vis[0][0].clientWidth;
+  var x_domain = Array(0, 100);
+  var x_range = Array(0, vis_w);
+  state.xScale = d3.scale.linear().domain(x_domain).range(x_range);
+
+  svg.attr({"width": state.xScale(state.fblk_w), "height": state.num_rows * state.iblk_h});
+  state.func_font = fitProgVisText(svg, "function-def-txt", state.func_label,
+                                   state.xScale(state.fblk_w - 3 * state.fitblk_w), state.iblk_h);
+  state.inst_font = fitProgVisText(svg, "program-instruction-txt", state.inst_label,
+                                   state.xScale(state.iblk_w) - state.txt_lpad, state.iblk_h);
+  svg.selectAll(".program-function").remove();
+  renderProgVis();
 }
 
 var resizeDemeVis = function() {
   // update deme sizing.
   var deme_vis = d3.select("#deme-vis");
   var deme_svg = deme_vis.select("svg");
+  // Replayed message edges are positioned for the old size; they come back on the next scrub.
+  deme_svg.selectAll(".deme-msg-edge").remove();
   var deme_vis_w = deme_vis[0][0].clientWidth;
   deme_svg.attr({"width": deme_vis_w, "height": deme_vis_w});
   var deme_width = deme_svg.attr("deme-width");
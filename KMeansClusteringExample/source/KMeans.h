@@ -0,0 +1,459 @@
+//  This file is part of Project Name
+//  Copyright (C) Michigan State University, 2017.
+//  Released under the MIT Software license; see doc/LICENSE
+//
+//  K-means clustering engine (no UI): shared by the web demo and the native command-line tool.
+
+#ifndef KMEANS_H
+#define KMEANS_H
+
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "base/vector.h"
+#include "tools/Random.h"
+#include "tools/random_utils.h"
+
+/// K-means clustering of 2D points.
+/// The first step assigns points to clusters at random (evenly); every step after that assigns each point to
+/// its nearest centroid. Each step then moves every centroid to the mean of its points (clusters that end up
+/// empty keep their centroid where it was).
+/// Coordinates are kept in separate contiguous arrays (x's, y's) so that the assignment step can work on
+/// several points at once with SIMD instructions (AVX: 4, SSE2: 2; see AssignNearest).
+/// With bounds on (SetUseBounds), assignment instead keeps Hamerly's bounds for each point (see AssignBounded)
+/// and skips most distance computations; assignments come out the same either way.
+/// Points are worked a block (BLOCK_SIZE points) at a time, spread over num_threads threads (SetNumThreads).
+/// Each block sums up its own points for the centroid update and block sums are added up in block order, so
+/// results don't depend on the number of threads.
+class KMeans {
+protected:
+  static constexpr size_t BLOCK_SIZE = 16384;  //< Points per block (see RunBlocks).
+
+  emp::Random & random;     //< The RNGod (only used for the initial assignment).
+
+  size_t num_bins;          //< How many K-means clustering bins should we have?
+  size_t cluster_iteration; //< What iteration of the clustering algorithm are we on?
+  size_t num_changed;       //< How many points changed cluster on the last step?
+
+  emp::vector<double> xs;             //< Data point x's.
+  emp::vector<double> ys;             //< Data point y's.
+  emp::vector<size_t> cluster_ids;    //< Vector to keep track of which cluster each point belongs to.
+  emp::vector<double> centroid_xs;    //< Cluster centroid x's.
+  emp::vector<double> centroid_ys;    //< Cluster centroid y's.
+  emp::vector<size_t> cluster_sizes;  //< How many points each cluster had at the last update.
+
+  bool use_bounds;                    //< Assign with AssignBounded (rather than AssignNearest)?
+  bool bounds_valid;                  //< Do upper/lower bound every point (as of the current centroids)?
+  double bound_slack;                 //< Margin for rounding error in bound comparisons.
+  emp::vector<double> upper;          //< Upper bound on each point's distance to its centroid.
+  emp::vector<double> lower;          //< Lower bound on each point's distance to any other centroid.
+  emp::vector<double> half_separation;  //< Half the distance from each centroid to the nearest other one.
+  size_t num_dist_computed;           //< Point-centroid distances computed in nearest-centroid steps so far.
+  size_t num_dist_brute;              //< ...and how many brute force would have computed.
+
+  size_t num_threads;                 //< How many threads to cluster with?
+  emp::vector<double> block_sum_xs;   //< Sum of each block's x's by cluster (block * num_bins + cluster).
+  emp::vector<double> block_sum_ys;   //< Sum of each block's y's by cluster.
+  emp::vector<size_t> block_counts;   //< Number of each block's points by cluster.
+
+  size_t GetNumBlocks() const { return (xs.size() + BLOCK_SIZE - 1) / BLOCK_SIZE; }
+
+  /// Run job(block, begin, end) for every block of points ([begin, end)), spreading blocks over num_threads
+  /// threads (blocks go to whichever thread is free next). Without threads (e.g., in browsers) every block
+  /// runs on this one.
+  void RunBlocks(const std::function<void(size_t, size_t, size_t)> & job) {
+    const size_t num_blocks = GetNumBlocks();
+    const size_t num_points = xs.size();
+    std::atomic<size_t> next_block(0);
+    auto run_blocks = [&]() {
+      for (size_t b = next_block++; b < num_blocks; b = next_block++) {
+        job(b, b * BLOCK_SIZE, std::min(num_points, (b + 1) * BLOCK_SIZE));
+      }
+    };
+    emp::vector<std::thread> threads;
+#ifndef __EMSCRIPTEN__
+    for (size_t t = 1; t < std::min(num_threads, num_blocks); ++t) threads.emplace_back(run_blocks);
+#endif
+    run_blocks();
+    for (auto & thread : threads) thread.join();
+  }
+
+  /// Sum up block's points ([begin, end)) by cluster.
+  void AccumulateBlock(size_t block, size_t begin, size_t end) {
+    double * sum_xs = block_sum_xs.data() + block * num_bins;
+    double * sum_ys = block_sum_ys.data() + block * num_bins;
+    size_t * counts = block_counts.data() + block * num_bins;
+    for (size_t c = 0; c < num_bins; ++c) { sum_xs[c] = 0.0; sum_ys[c] = 0.0; counts[c] = 0; }
+    for (size_t i = begin; i < end; ++i) {
+      const size_t c = cluster_ids[i];
+      sum_xs[c] += xs[i];
+      sum_ys[c] += ys[i];
+      ++counts[c];
+    }
+  }
+
+  /// Nearest centroid to (x, y) by squared distance (ties go to the lower centroid).
+  size_t NearestCentroid(double x, double y) const {
+    double min_dist = std::numeric_limits<double>::max();
+    size_t cID = 0;
+    for (size_t c = 0; c < num_bins; ++c) {
+      const double cen_dist = SquaredDistance(x, y, centroid_xs[c], centroid_ys[c]);
+      if (cen_dist < min_dist) { min_dist = cen_dist; cID = c; }
+    }
+    return cID;
+  }
+
+  /// Set point i's cluster; returns whether it changed.
+  bool SetClusterID(size_t i, size_t cID) {
+    const bool changed = (cluster_ids[i] != cID);
+    cluster_ids[i] = cID;
+    return changed;
+  }
+
+  /// Assign points [begin, end) to their nearest centroids; returns how many changed cluster.
+  /// With SIMD, each lane keeps its own best distance and centroid (as a double) while we go through the
+  /// centroids in order, so the result is the same as NearestCentroid point by point. Lanes are worked in
+  /// ASSIGN_GROUPS independent groups so the compare/select chains overlap.
+  size_t AssignNearest(size_t begin, size_t end) {
+    size_t changed = 0;
+    size_t i = begin;
+#if defined(__AVX__)
+    using simd_t = __m256d;
+    constexpr size_t LANES = 4;
+    auto load = [](const double * ptr) { return _mm256_loadu_pd(ptr); };
+    auto store = [](double * ptr, simd_t val) { _mm256_storeu_pd(ptr, val); };
+    auto set1 = [](double val) { return _mm256_set1_pd(val); };
+    auto sub = [](simd_t a, simd_t b) { return _mm256_sub_pd(a, b); };
+    auto add = [](simd_t a, simd_t b) { return _mm256_add_pd(a, b); };
+    auto mul = [](simd_t a, simd_t b) { return _mm256_mul_pd(a, b); };
+    auto less = [](simd_t a, simd_t b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); };
+    auto min = [](simd_t a, simd_t b) { return _mm256_min_pd(a, b); };
+    auto select = [](simd_t mask, simd_t a, simd_t b) { return _mm256_or_pd(_mm256_and_pd(mask, a), _mm256_andnot_pd(mask, b)); };
+#elif defined(__SSE2__)
+    using simd_t = __m128d;
+    constexpr size_t LANES = 2;
+    auto load = [](const double * ptr) { return _mm_loadu_pd(ptr); };
+    auto store = [](double * ptr, simd_t val) { _mm_storeu_pd(ptr, val); };
+    auto set1 = [](double val) { return _mm_set1_pd(val); };
+    auto sub = [](simd_t a, simd_t b) { return _mm_sub_pd(a, b); };
+    auto add = [](simd_t a, simd_t b) { return _mm_add_pd(a, b); };
+    auto mul = [](simd_t a, simd_t b) { return _mm_mul_pd(a, b); };
+    auto less = [](simd_t a, simd_t b) { return _mm_cmplt_pd(a, b); };
+    auto min = [](simd_t a, simd_t b) { return _mm_min_pd(a, b); };
+    auto select = [](simd_t mask, simd_t a, simd_t b) { return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b)); };
+#endif
+#if defined(__AVX__) || defined(__SSE2__)
+    constexpr size_t ASSIGN_GROUPS = 4;
+    constexpr size_t STRIDE = LANES * ASSIGN_GROUPS;
+    for (; i + STRIDE <= end; i += STRIDE) {
+      simd_t px[ASSIGN_GROUPS], py[ASSIGN_GROUPS], best_dist[ASSIGN_GROUPS], best_id[ASSIGN_GROUPS];
+      for (size_t g = 0; g < ASSIGN_GROUPS; ++g) {
+        px[g] = load(xs.data() + i + g * LANES);
+        py[g] = load(ys.data() + i + g * LANES);
+        best_dist[g] = set1(std::numeric_limits<double>::max());
+        best_id[g] = set1(0.0);
+      }
+      for (size_t c = 0; c < num_bins; ++c) {
+        const simd_t cx = set1(centroid_xs[c]);
+        const simd_t cy = set1(centroid_ys[c]);
+        const simd_t cid = set1((double)c);
+        for (size_t g = 0; g < ASSIGN_GROUPS; ++g) {
+          const simd_t dx = sub(px[g], cx);
+          const simd_t dy = sub(py[g], cy);
+          const simd_t dist = add(mul(dx, dx), mul(dy, dy));
+          const simd_t closer = less(dist, best_dist[g]);
+          best_dist[g] = min(dist, best_dist[g]);  // (dist < best_dist) ? dist : best_dist
+          best_id[g] = select(closer, cid, best_id[g]);
+        }
+      }
+      double ids[STRIDE];
+      for (size_t g = 0; g < ASSIGN_GROUPS; ++g) store(ids + g * LANES, best_id[g]);
+      for (size_t j = 0; j < STRIDE; ++j) changed += SetClusterID(i + j, (size_t)ids[j]);
+    }
+#endif
+    // Whatever's left (or everything, without SIMD).
+    for (; i < end; ++i) changed += SetClusterID(i, NearestCentroid(xs[i], ys[i]));
+    return changed;
+  }
+
+  /// Find point i's nearest centroid (as NearestCentroid) and reset its bounds from the exact distances.
+  size_t ScanBounded(size_t i) {
+    double min_dist = std::numeric_limits<double>::max();
+    double second_dist = std::numeric_limits<double>::max();
+    size_t cID = 0;
+    for (size_t c = 0; c < num_bins; ++c) {
+      const double cen_dist = SquaredDistance(xs[i], ys[i], centroid_xs[c], centroid_ys[c]);
+      if (cen_dist < min_dist) { second_dist = min_dist; min_dist = cen_dist; cID = c; }
+      else if (cen_dist < second_dist) { second_dist = cen_dist; }
+    }
+    upper[i] = std::sqrt(min_dist);
+    lower[i] = (second_dist == std::numeric_limits<double>::max()) ? second_dist : std::sqrt(second_dist);
+    return cID;
+  }
+
+  /// Assign points [begin, end) to their nearest centroids using their bounds (see UpdateBounds), adding
+  /// the number of point-centroid distances computed to computed; returns how many changed cluster.
+  /// A point whose upper bound is below both its lower bound and half the distance from its centroid to
+  /// the next nearest centroid can't be closer to another centroid (triangle inequality), so it's skipped;
+  /// otherwise we tighten its upper bound and check again, then fall back to checking every centroid.
+  /// Comparisons are strict and padded by bound_slack so ties and rounding still go the way brute force
+  /// would have them.
+  size_t AssignBounded(size_t begin, size_t end, size_t & computed) {
+    size_t changed = 0;
+    for (size_t i = begin; i < end; ++i) {
+      const size_t cID = cluster_ids[i];
+      const double bound = std::max(half_separation[cID], lower[i]) - bound_slack;
+      if (upper[i] + bound_slack < bound) continue;
+      upper[i] = std::sqrt(SquaredDistance(xs[i], ys[i], centroid_xs[cID], centroid_ys[cID]));
+      ++computed;
+      if (upper[i] + bound_slack < bound) continue;
+      changed += SetClusterID(i, ScanBounded(i));
+      computed += num_bins;
+    }
+    return changed;
+  }
+
+  /// Get ready for an AssignBounded pass: (re)start bounds from scratch if they're not valid, and work out
+  /// how far apart the centroids are.
+  void PrepareBounds() {
+    if (!bounds_valid) {
+      upper.assign(xs.size(), std::numeric_limits<double>::max());
+      lower.assign(xs.size(), 0.0);
+      // Rounding error scales with the coordinates (not the distances).
+      double scale = 0.0;
+      for (size_t i = 0; i < xs.size(); ++i) scale = std::max(scale, std::max(std::abs(xs[i]), std::abs(ys[i])));
+      bound_slack = scale * 1e-9;
+    }
+    half_separation.assign(num_bins, std::numeric_limits<double>::max());
+    for (size_t c = 0; c < num_bins; ++c) {
+      for (size_t c2 = c + 1; c2 < num_bins; ++c2) {
+        const double half_dist = std::sqrt(SquaredDistance(centroid_xs[c], centroid_ys[c], centroid_xs[c2], centroid_ys[c2])) / 2.0;
+        half_separation[c] = std::min(half_separation[c], half_dist);
+        half_separation[c2] = std::min(half_separation[c2], half_dist);
+      }
+    }
+  }
+
+  /// Centroids have moved (from prev_xs, prev_ys): loosen every point's bounds by how far they went.
+  void UpdateBounds(const emp::vector<double> & prev_xs, const emp::vector<double> & prev_ys) {
+    emp::vector<double> drift(num_bins);
+    size_t max_c = 0;
+    double max_drift = 0.0;
+    double second_drift = 0.0;
+    for (size_t c = 0; c < num_bins; ++c) {
+      drift[c] = std::sqrt(SquaredDistance(prev_xs[c], prev_ys[c], centroid_xs[c], centroid_ys[c]));
+      if (drift[c] > max_drift) { second_drift = max_drift; max_drift = drift[c]; max_c = c; }
+      else if (drift[c] > second_drift) { second_drift = drift[c]; }
+    }
+    RunBlocks([&](size_t, size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        const size_t cID = cluster_ids[i];
+        upper[i] += drift[cID];
+        lower[i] -= (cID == max_c) ? second_drift : max_drift;
+      }
+    });
+  }
+
+  /// Move each centroid to the mean of its points (empty clusters stay put), from the block sums (see
+  /// AccumulateBlock), added up in block order.
+  void UpdateCentroids() {
+    const size_t num_blocks = GetNumBlocks();
+    for (size_t c = 0; c < num_bins; ++c) {
+      double sum_x = 0.0;
+      double sum_y = 0.0;
+      size_t count = 0;
+      for (size_t b = 0; b < num_blocks; ++b) {
+        sum_x += block_sum_xs[b * num_bins + c];
+        sum_y += block_sum_ys[b * num_bins + c];
+        count += block_counts[b * num_bins + c];
+      }
+      cluster_sizes[c] = count;
+      if (!count) continue;
+      centroid_xs[c] = sum_x / (double)count;
+      centroid_ys[c] = sum_y / (double)count;
+    }
+  }
+
+public:
+  KMeans(emp::Random & _random, size_t _num_bins=3)
+    : random(_random),
+      num_bins(_num_bins),
+      cluster_iteration(0),
+      num_changed(0),
+      xs(), ys(), cluster_ids(),
+      centroid_xs(_num_bins, 0.0), centroid_ys(_num_bins, 0.0), cluster_sizes(_num_bins, 0),
+      use_bounds(false), bounds_valid(false), bound_slack(0.0),
+      upper(), lower(), half_separation(),
+      num_dist_computed(0), num_dist_brute(0),
+      num_threads(1), block_sum_xs(), block_sum_ys(), block_counts()
+  { ; }
+
+  size_t GetNumBins() const { return num_bins; }
+  size_t GetIteration() const { return cluster_iteration; }
+  size_t GetNumChanged() const { return num_changed; }
+  size_t GetSize() const { return xs.size(); }
+  double GetX(size_t i) const { return xs[i]; }
+  double GetY(size_t i) const { return ys[i]; }
+  const emp::vector<size_t> & GetClusterIDs() const { return cluster_ids; }
+  double GetCentroidX(size_t c) const { return centroid_xs[c]; }
+  double GetCentroidY(size_t c) const { return centroid_ys[c]; }
+  size_t GetClusterSize(size_t c) const { return cluster_sizes[c]; }
+  bool GetUseBounds() const { return use_bounds; }
+  size_t GetNumThreads() const { return num_threads; }
+
+  /// Cluster with this many threads (results are the same for any number).
+  void SetNumThreads(size_t _num_threads) { num_threads = std::max((size_t)1, _num_threads); }
+
+  /// Fraction of point-centroid distance computations (in nearest-centroid steps since the last Reset) that
+  /// bounds let us skip.
+  double GetFractionAvoided() const {
+    if (!num_dist_brute) return 0.0;
+    return 1.0 - (double)num_dist_computed / (double)num_dist_brute;
+  }
+
+  /// Assign points with (Hamerly's) bounds instead of checking every centroid.
+  void SetUseBounds(bool _use_bounds) {
+    use_bounds = _use_bounds;
+    bounds_valid = false;
+  }
+
+  /// Has clustering converged (i.e., did the last nearest-centroid assignment leave every point where it was)?
+  bool IsConverged() const { return cluster_iteration > 1 && num_changed == 0; }
+
+  /// Add a single point to data.
+  void AddPoint(double x, double y) {
+    xs.emplace_back(x);
+    ys.emplace_back(y);
+    cluster_ids.emplace_back(0);
+    bounds_valid = false;
+  }
+
+  void Reserve(size_t n) {
+    xs.reserve(n);
+    ys.reserve(n);
+    cluster_ids.reserve(n);
+  }
+
+  /// The nuclear option! Clear all points.
+  void Clear() {
+    xs.clear();
+    ys.clear();
+    cluster_ids.clear();
+    Reset();
+  }
+
+  /// Reset clustering algorithm (cluster memberships, etc, etc.).
+  void Reset() {
+    cluster_iteration = 0;
+    num_changed = 0;
+    centroid_xs.assign(num_bins, 0.0);
+    centroid_ys.assign(num_bins, 0.0);
+    cluster_sizes.assign(num_bins, 0);
+    for (size_t i = 0; i < cluster_ids.size(); ++i) { cluster_ids[i] = 0; }
+    bounds_valid = false;
+    num_dist_computed = 0;
+    num_dist_brute = 0;
+  }
+
+  /// Reset clustering algorithm with a new number of bins.
+  void Reset(size_t _num_bins) {
+    num_bins = _num_bins;
+    Reset();
+  }
+
+  /// Take a single step in the k-means clustering algorithm.
+  void ClusterSingleStep() {
+    // If no points have been laid down... do nothing.
+    if (xs.empty() || !num_bins) return;
+    const size_t num_blocks = GetNumBlocks();
+    emp::vector<size_t> block_changed(num_blocks, 0);
+    emp::vector<size_t> block_computed(num_blocks, 0);
+    block_sum_xs.resize(num_blocks * num_bins);
+    block_sum_ys.resize(num_blocks * num_bins);
+    block_counts.resize(num_blocks * num_bins);
+    // Assign membership (and sum up each block's clusters while it's at hand).
+    if (cluster_iteration == 0) {
+      // Randomly if on initial iteration.
+      for (size_t i = 0; i < cluster_ids.size(); ++i) { cluster_ids[i] = i % num_bins; }
+      emp::Shuffle(random, cluster_ids);
+      RunBlocks([this](size_t b, size_t begin, size_t end) { AccumulateBlock(b, begin, end); });
+      num_changed = xs.size();
+    } else {
+      // Assign each point to it's nearest centroid; with bounds, skip those that can't have moved (once
+      // bounds have been set up by checking everything).
+      if (use_bounds) PrepareBounds();
+      const bool bounded = use_bounds && bounds_valid;
+      RunBlocks([&](size_t b, size_t begin, size_t end) {
+        if (bounded) {
+          block_changed[b] = AssignBounded(begin, end, block_computed[b]);
+        } else if (use_bounds) {
+          for (size_t i = begin; i < end; ++i) block_changed[b] += SetClusterID(i, ScanBounded(i));
+          block_computed[b] = (end - begin) * num_bins;
+        } else {
+          block_changed[b] = AssignNearest(begin, end);
+          block_computed[b] = (end - begin) * num_bins;
+        }
+        AccumulateBlock(b, begin, end);
+      });
+      if (use_bounds) bounds_valid = true;
+      num_changed = 0;
+      for (size_t b = 0; b < num_blocks; ++b) {
+        num_changed += block_changed[b];
+        num_dist_computed += block_computed[b];
+      }
+      num_dist_brute += xs.size() * num_bins;
+    }
+    // Update centurions.
+    if (bounds_valid) {
+      const emp::vector<double> prev_xs(centroid_xs);
+      const emp::vector<double> prev_ys(centroid_ys);
+      UpdateCentroids();
+      UpdateBounds(prev_xs, prev_ys);
+    } else {
+      UpdateCentroids();
+    }
+    ++cluster_iteration;
+  }
+
+  /// Step until converged (or max_iterations steps have been taken); returns the number of steps taken.
+  size_t Run(size_t max_iterations) {
+    size_t steps = 0;
+    while (steps < max_iterations && !IsConverged()) {
+      ClusterSingleStep();
+      ++steps;
+    }
+    return steps;
+  }
+
+  /// Sum of squared distances from each point to its cluster's centroid.
+  double GetInertia() const {
+    if (num_bins == 0) return 0.0;
+    double inertia = 0.0;
+    for (size_t i = 0; i < xs.size(); ++i) {
+      const size_t c = cluster_ids[i];
+      inertia += SquaredDistance(xs[i], ys[i], centroid_xs[c], centroid_ys[c]);
+    }
+    return inertia;
+  }
+
+  /// Squared euclidean distance between two points; used as the point similarity metric for the k-means
+  /// clustering algorithm (nearest by squared distance is nearest by distance, and it skips the sqrt).
+  static double SquaredDistance(double x1, double y1, double x2, double y2) {
+    const double dx = x1 - x2;
+    const double dy = y1 - y2;
+    return dx * dx + dy * dy;
+  }
+
+};
+
+#endif
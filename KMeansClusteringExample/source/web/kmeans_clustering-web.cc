@@ -16,6 +16,8 @@
 #include "web/JSWrap.h"
 #include "web/color_map.h"
 
+#include "../KMeans.h"
+
 namespace UI = emp::web;
 
 constexpr size_t MAX_RANDOMIZE_TRIES = 10000; //< How many times should we retry dropping random points to avoid point-collisions?
@@ -40,12 +42,9 @@ size_t point_radius;  //< Radius of data points. (only matters for drawing)
 double canvas_pos_x;  //< Internally-used variable to keep track of canvas x position on client window. (NOTE: only updated on mouse click events)
 double canvas_pos_y;  //< Internally-used variable to keep track of canvas y position on client window. (NOTE: only updated on mouse click events)
 
-size_t cluster_iteration; //< What iteration of the clustering algorithm are we on?
 size_t num_bins;          //< How many K-means clustering bins should we have?
 
-emp::vector<emp::Circle> points;    //< Vector to keep track of data points.
-emp::vector<size_t> cluster_ids;    //< Vector to keep track of which cluster each point belongs to.
-emp::vector<emp::Circle> centroids; //< Vector to keep track of cluster centroids.
+KMeans kmeans;            //< The clustering algorithm (and its data points).
 
 enum class Mode { CLUSTER, CONFIG } page_mode;  //< What mode is the page in?
 
@@ -88,9 +87,8 @@ public:
       random(),
       width(500), height(500),
       point_radius(10),
-      cluster_iteration(0),
       num_bins(3),
-      points(), cluster_ids(), centroids(),
+      kmeans(random, num_bins),
       page_mode(Mode::CONFIG)
   {
     // Wrap some necessary functions for js<-->c++ comms.
@@ -157,14 +155,14 @@ public:
     });
     int x = event.clientX - canvas_pos_x;
     int y = event.clientY - canvas_pos_y;
-    AddPoint(x, y, point_radius);
+    AddPoint(x, y);
     Draw();
   }
 
   /// Animate function: called every step of animation/running algorithm (i.e. this is the body of the run loop).
   void Animate(const UI::Animate & anim) {
     // 1) Update (iterate the clustering algorithm)
-    ClusterSingleStep();
+    kmeans.ClusterSingleStep();
     // 2) Redraw the world.
     Draw();
   }
@@ -200,9 +198,7 @@ public:
 
   /// The nuclear option! Clear the canvas of all points.
   void DoClear() {
-    points.clear();
-    cluster_ids.clear();
-    centroids.clear();
+    kmeans.Clear();
     Draw();
   }
 
@@ -222,16 +218,17 @@ public:
     auto canvas = viewer.Canvas("DataViewer");
     canvas.Clear("black");
     const auto & color_map = emp::GetHueMap(num_bins, 0.0, 330);
+    const auto & cluster_ids = kmeans.GetClusterIDs();
     // Draw points.
-    for (size_t i = 0; i < points.size(); ++i) {
-      std::string color = (cluster_iteration) ? color_map[cluster_ids[i]] : "yellow";
-      canvas.Circle(points[i], color);
+    for (size_t i = 0; i < kmeans.GetSize(); ++i) {
+      std::string color = (kmeans.GetIteration()) ? color_map[cluster_ids[i]] : "yellow";
+      canvas.Circle(kmeans.GetX(i), kmeans.GetY(i), point_radius, color);
     }
-    // Draw centroids.
-    for (size_t i = 0; i < centroids.size(); ++i) {
-      auto & centroid = centroids[i];
-      canvas.Circle(centroid.GetCenterX(), centroid.GetCenterY(), centroid.GetRadius() * 2, "grey");
-      canvas.Circle(centroid, color_map[i]);
+    // Draw centroids (none until the first step places them).
+    if (!kmeans.GetIteration()) return;
+    for (size_t i = 0; i < kmeans.GetNumBins(); ++i) {
+      canvas.Circle(kmeans.GetCentroidX(i), kmeans.GetCentroidY(i), point_radius, "grey");
+      canvas.Circle(kmeans.GetCentroidX(i), kmeans.GetCentroidY(i), point_radius/2.0, color_map[i]);
     }
   }
 
@@ -258,10 +255,7 @@ public:
   /// Reset clustering algorithm (cluster memberships, etc, etc.) then redraw.
   void Reset() {
     // Cluster reset.
-    cluster_iteration = 0;
-    centroids.clear(); centroids.resize(num_bins);
-    for (size_t i = 0; i < centroids.size(); ++i) { centroids[i].Set(0, 0, 0); }
-    for (size_t i = 0; i < cluster_ids.size(); ++i) { cluster_ids[i] = 0; }
+    kmeans.Reset(num_bins);
     Draw();
   }
 
@@ -270,7 +264,7 @@ public:
   /// Does everything that needs doing to enter cluster mode.
   void InitClusterMode() {
     page_mode = Mode::CLUSTER;
-    num_bins = std::min(std::max(1, EM_ASM_INT_V({ return $("#num_bins-param").val(); })), (int)points.size());
+    num_bins = std::min(std::max(1, EM_ASM_INT_V({ return $("#num_bins-param").val(); })), (int)kmeans.GetSize());
     Reset();
     UpdateDash();
   }
@@ -293,14 +287,12 @@ public:
 
   /// Add a single point to data.
   void AddPoint(const emp::Circle & circ) {
-    points.emplace_back(circ);
-    cluster_ids.emplace_back(0);
+    kmeans.AddPoint(circ.GetCenterX(), circ.GetCenterY());
   }
 
-  /// Add a single point to data.
-  void AddPoint(double x, double y, double r) {
-    points.emplace_back(x, y, r);
-    cluster_ids.emplace_back(0);
+  /// Add a single point to data (every point is drawn with radius point_radius).
+  void AddPoint(double x, double y) {
+    kmeans.AddPoint(x, y);
   }
 
   /// Generate n random points.
@@ -316,8 +308,8 @@ public:
         double x = random.GetDouble(point_radius, width - point_radius);
         c.SetCenter(x, y);
         sat = true;
-        for (size_t j = 0; j < points.size(); ++j) {
-          if (c.HasOverlap(points[j])) { sat = false; break; }
+        for (size_t j = 0; j < kmeans.GetSize(); ++j) {
+          if (c.HasOverlap(emp::Circle(kmeans.GetX(j), kmeans.GetY(j), point_radius))) { sat = false; break; }
         }
         if (sat) { break; }
         ++counter;
@@ -327,51 +319,6 @@ public:
     Draw();
   }
 
-  /// Take a single step in the k-means clustering algorithm.
-  void ClusterSingleStep() {
-    // If no points have been laid down... do nothing.
-    if (points.empty()) return;
-    // Assign membership.
-    if (cluster_iteration == 0) {
-      // Randomly if on initial iteration.
-      for (size_t i = 0; i < cluster_ids.size(); ++i) { cluster_ids[i] = i % num_bins; }
-      emp::Shuffle(random, cluster_ids);
-    } else {
-      // Assign each point to it's nearest centroid.
-      for (size_t i = 0; i < points.size(); ++i) {
-        double min_dist = std::numeric_limits<double>::max();
-        size_t cID = 0;
-        for (size_t c = 0; c < centroids.size(); ++c) {
-          double cen_dist = Distance(points[i], centroids[c]);
-          if (cen_dist < min_dist) { min_dist = cen_dist; cID = c; }
-        }
-        cluster_ids[i] = cID;
-      }
-    }
-    // Update centurions.
-    // - Reset all centroids to 0,0 (make maths easier for ourselves).
-    for (size_t i = 0; i < centroids.size(); ++i) { centroids[i].Set(0, 0, 0); }
-    for (size_t i = 0; i < points.size(); ++i) {
-      auto & centroid = centroids[cluster_ids[i]];
-      centroid.SetCenterX(centroid.GetCenterX() + points[i].GetCenterX());
-      centroid.SetCenterY(centroid.GetCenterY() + points[i].GetCenterY());
-      centroid.SetRadius(centroid.GetRadius() + 1);
-    }
-    for (size_t i = 0; i < centroids.size(); ++i) {
-      auto & centroid = centroids[i];
-      centroid.SetCenterX(centroid.GetCenterX() / centroid.GetRadius());
-      centroid.SetCenterY(centroid.GetCenterY() / centroid.GetRadius());
-      centroid.SetRadius(point_radius/2.0); // Set radius to normal size.
-    }
-    ++cluster_iteration;
-  }
-
-  /// Compute the euclidean distance between two points (a, b).
-  /// Used here as the point similarity metric for k-means clustering algorithm.
-  double Distance(const emp::Circle & a, const emp::Circle & b) {
-    return (std::sqrt( std::pow(a.GetCenterX() - b.GetCenterX(), 2) + std::pow(a.GetCenterY() - b.GetCenterY(), 2) ));
-  }
-
 };
 
 KMeansExample e;
@@ -0,0 +1,199 @@
+// K-means agreement tests (build and run with: make test; add ARCH_nat=-march=native to cover the AVX
+// kernels). KMeans is run next to a plain scalar k-means from the same seed and must match it exactly,
+// clusters and centroids, after every step, with and without Hamerly bounds and threads. Small data sets (one block) use random coordinates; bigger
+// ones use integer coordinates, so sums come out exact in any order.
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+
+#include "base/vector.h"
+#include "tools/Random.h"
+#include "tools/random_utils.h"
+#include "../source/KMeans.h"
+
+size_t failures = 0;
+
+#define CHECK(COND) do {                                                                   \
+    if (!(COND)) {                                                                         \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #COND << std::endl;   \
+      ++failures;                                                                          \
+    }                                                                                      \
+  } while (0)
+
+struct Points {
+  emp::vector<double> xs;
+  emp::vector<double> ys;
+};
+
+/// n points scattered around num_centers random centers (rounded to integers if integer).
+Points MakePoints(emp::Random & rnd, size_t n, size_t num_centers, bool integer) {
+  emp::vector<double> center_xs(num_centers), center_ys(num_centers);
+  for (size_t c = 0; c < num_centers; ++c) {
+    center_xs[c] = rnd.GetDouble(-1000.0, 1000.0);
+    center_ys[c] = rnd.GetDouble(-1000.0, 1000.0);
+  }
+  Points points;
+  for (size_t i = 0; i < n; ++i) {
+    const size_t c = rnd.GetUInt((uint32_t)num_centers);
+    double x = center_xs[c] + rnd.GetDouble(-150.0, 150.0);
+    double y = center_ys[c] + rnd.GetDouble(-150.0, 150.0);
+    if (integer) { x = std::round(x); y = std::round(y); }
+    points.xs.emplace_back(x);
+    points.ys.emplace_back(y);
+  }
+  return points;
+}
+
+/// Plain k-means, one point at a time, as KMeans.h describes it.
+struct ReferenceKMeans {
+  emp::Random random;
+  size_t num_bins;
+  size_t iteration;
+  Points points;
+  emp::vector<size_t> cluster_ids;
+  emp::vector<double> centroid_xs;
+  emp::vector<double> centroid_ys;
+
+  ReferenceKMeans(int seed, size_t _num_bins, const Points & _points)
+    : random(seed), num_bins(_num_bins), iteration(0), points(_points), cluster_ids(_points.xs.size(), 0),
+      centroid_xs(_num_bins, 0.0), centroid_ys(_num_bins, 0.0) { ; }
+
+  void Step() {
+    const size_t n = points.xs.size();
+    if (iteration == 0) {
+      for (size_t i = 0; i < n; ++i) cluster_ids[i] = i % num_bins;
+      emp::Shuffle(random, cluster_ids);
+    } else {
+      for (size_t i = 0; i < n; ++i) {
+        double min_dist = std::numeric_limits<double>::max();
+        for (size_t c = 0; c < num_bins; ++c) {
+          const double dx = points.xs[i] - centroid_xs[c];
+          const double dy = points.ys[i] - centroid_ys[c];
+          const double dist = dx * dx + dy * dy;
+          if (dist < min_dist) { min_dist = dist; cluster_ids[i] = c; }
+        }
+      }
+    }
+    emp::vector<double> sum_xs(num_bins, 0.0), sum_ys(num_bins, 0.0);
+    emp::vector<size_t> counts(num_bins, 0);
+    for (size_t i = 0; i < n; ++i) {
+      sum_xs[cluster_ids[i]] += points.xs[i];
+      sum_ys[cluster_ids[i]] += points.ys[i];
+      ++counts[cluster_ids[i]];
+    }
+    for (size_t c = 0; c < num_bins; ++c) {
+      if (!counts[c]) continue;
+      centroid_xs[c] = sum_xs[c] / (double)counts[c];
+      centroid_ys[c] = sum_ys[c] / (double)counts[c];
+    }
+    ++iteration;
+  }
+};
+
+/// Cluster points into k clusters with KMeans (set up by setup) and with ReferenceKMeans from seed;
+/// returns whether they agree after each of steps steps.
+bool MatchesReference(const Points & points, size_t k, int seed, const std::function<void(KMeans &)> & setup,
+                      size_t steps) {
+  emp::Random random(seed);
+  KMeans kmeans(random, k);
+  kmeans.Reserve(points.xs.size());
+  for (size_t i = 0; i < points.xs.size(); ++i) kmeans.AddPoint(points.xs[i], points.ys[i]);
+  setup(kmeans);
+  ReferenceKMeans reference(seed, k, points);
+  for (size_t step = 0; step < steps; ++step) {
+    kmeans.ClusterSingleStep();
+    reference.Step();
+    if (kmeans.GetClusterIDs() != reference.cluster_ids) return false;
+    for (size_t c = 0; c < k; ++c) {
+      if (kmeans.GetCentroidX(c) != reference.centroid_xs[c] || kmeans.GetCentroidY(c) != reference.centroid_ys[c]) return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  emp::Random rnd(40);
+  // Sizes that leave every kind of tail after the SIMD strides; one block.
+  const emp::vector<Points> small = { MakePoints(rnd, 1, 1, false), MakePoints(rnd, 7, 2, false),
+                                      MakePoints(rnd, 1001, 5, false), MakePoints(rnd, 16000, 9, false) };
+  // Several blocks.
+  const Points big = MakePoints(rnd, 70001, 12, true);
+  const emp::vector<size_t> ks = {1, 2, 3, 5, 8, 17, 33};
+
+  // SIMD (or scalar, without SSE2/AVX) assignment.
+  auto plain = [](KMeans &) { ; };
+  for (const Points & points : small) {
+    for (size_t k : ks) CHECK(MatchesReference(points, k, (int)k, plain, 12));
+  }
+  for (size_t k : {3, 16}) CHECK(MatchesReference(big, k, 7, plain, 10));
+
+  // Hamerly bounds: same result, most distances skipped once the clusters settle.
+  auto bounds = [](KMeans & kmeans) { kmeans.SetUseBounds(true); };
+  for (const Points & points : small) {
+    for (size_t k : ks) CHECK(MatchesReference(points, k, (int)k, bounds, 12));
+  }
+  for (size_t k : {3, 16}) CHECK(MatchesReference(big, k, 7, bounds, 10));
+  {
+    emp::Random random(3);
+    KMeans kmeans(random, 16);
+    for (size_t i = 0; i < big.xs.size(); ++i) kmeans.AddPoint(big.xs[i], big.ys[i]);
+    kmeans.SetUseBounds(true);
+    kmeans.Run(30);
+    CHECK(kmeans.GetFractionAvoided() > 0.5);
+    // Switching bounds off (or on) midway changes nothing either.
+    emp::Random random_ref(3);
+    KMeans reference(random_ref, 16);
+    for (size_t i = 0; i < big.xs.size(); ++i) reference.AddPoint(big.xs[i], big.ys[i]);
+    reference.Run(10);
+    reference.SetUseBounds(true);
+    reference.Run(10);
+    reference.SetUseBounds(false);
+    reference.Run(10);
+    CHECK(reference.GetClusterIDs() == kmeans.GetClusterIDs());
+  }
+
+  // Threads: blocks are summed in block order, so any number of threads gives the same result, exactly
+  // (random coordinates here, so a different summing order would show).
+  const Points big_random = MakePoints(rnd, 70001, 12, false);
+  for (bool use_bounds : {false, true}) {
+    emp::Random random(5);
+    KMeans single(random, 16);
+    for (size_t i = 0; i < big_random.xs.size(); ++i) single.AddPoint(big_random.xs[i], big_random.ys[i]);
+    single.SetUseBounds(use_bounds);
+    single.Run(15);
+    for (size_t num_threads : {2, 3, 8}) {
+      emp::Random random_threaded(5);
+      KMeans threaded(random_threaded, 16);
+      for (size_t i = 0; i < big_random.xs.size(); ++i) threaded.AddPoint(big_random.xs[i], big_random.ys[i]);
+      threaded.SetUseBounds(use_bounds);
+      threaded.SetNumThreads(num_threads);
+      threaded.Run(15);
+      CHECK(threaded.GetClusterIDs() == single.GetClusterIDs());
+      bool same_centroids = true;
+      for (size_t c = 0; c < 16; ++c) {
+        same_centroids = same_centroids && threaded.GetCentroidX(c) == single.GetCentroidX(c)
+                                        && threaded.GetCentroidY(c) == single.GetCentroidY(c);
+      }
+      CHECK(same_centroids);
+      CHECK(threaded.GetIteration() == single.GetIteration());
+    }
+  }
+  auto threads = [](KMeans & kmeans) { kmeans.SetNumThreads(4); };
+  for (size_t k : {3, 16}) CHECK(MatchesReference(big, k, 7, threads, 10));
+  {
+    // No clusters: nothing to do and nothing to measure.
+    emp::Random random(5);
+    KMeans kmeans(random, 0);
+    for (size_t i = 0; i < big.xs.size(); ++i) kmeans.AddPoint(big.xs[i], big.ys[i]);
+    kmeans.Run(3);
+    CHECK(kmeans.GetInertia() == 0.0);
+  }
+
+  if (failures) {
+    std::cout << "kmeans: " << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "kmeans: ok" << std::endl;
+  return 0;
+}